@@ -68,6 +68,29 @@ public:
      */
     virtual CameraSample sample(const Point2 &normalized,
                                 Sampler &rng) const = 0;
+
+    /**
+     * @brief Samples the camera model for several pixels at once, e.g., to
+     * trace the resulting rays as a packet. Every pixel uses its own random
+     * number generator, which is used in the same way as by @ref sample .
+     *
+     * @param pixels The pixel coordinates of the @c count samples.
+     * @param rng The random number generators of the pixels.
+     * @param samples Receives the sample of each pixel.
+     */
+    void samplePacket(const Point2i *pixels, Sampler *const *rng,
+                      CameraSample *samples, int count) const;
+
+    /**
+     * @brief Samples rays for several normalized coordinates at once (see
+     * @ref sample ). The default implementation samples the rays one by one,
+     * camera models can override this to share work among the rays.
+     */
+    virtual void samplePacket(const Point2 *normalized, Sampler *const *rng,
+                              CameraSample *samples, int count) const {
+        for (int i = 0; i < count; i++)
+            samples[i] = sample(normalized[i], *rng[i]);
+    }
 };
 
 } // namespace lightwave
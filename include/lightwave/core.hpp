@@ -109,6 +109,7 @@ class Entity;
 class Sampler;
 class Instance;
 struct Intersection;
+struct RayPacket;
 class Color;
 class Image;
 class Texture;
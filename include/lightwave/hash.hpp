@@ -28,6 +28,14 @@ public:
         return *this;
     }
 
+    /// @brief Updates the state by hashing a range of bytes.
+    fnv1a &update(const void *data, size_t size) {
+        const auto *bytes = static_cast<const uint8_t *>(data);
+        for (size_t pos = 0; pos < size; pos++)
+            hash = (hash ^ bytes[pos]) * 0x100000001b3;
+        return *this;
+    }
+
     /// @brief Returns the current state of the hash function.
     operator uint64_t() { return hash; }
 };
@@ -103,6 +103,36 @@ public:
      */
     bool intersect(const Ray &ray, Intersection &its,
                    Sampler &rng) const override;
+    /**
+     * @brief Like @ref intersect , but only records the hit and defers
+     * transforming the surface data to @ref populateHit . Instances with an
+     * alpha mask need the texture coordinates of every hit, and hence fall
+     * back to @ref intersect .
+     */
+    bool findHit(const Ray &ray, Intersection &its,
+                 Sampler &rng) const override;
+    /// @brief Computes the surface data of the hit recorded by @ref findHit
+    /// in world coordinates.
+    void populateHit(const Ray &ray, Intersection &its) const override;
+    /**
+     * @brief Tests whether the instance blocks a given ray in world
+     * coordinates before @c tMax , without computing any surface information
+     * (except for the texture coordinates needed for alpha masking).
+     */
+    bool occluded(const Ray &ray, float tMax, Sampler &rng) const override;
+    /**
+     * @brief Intersects the instance with a packet of rays in world
+     * coordinates, which are transformed into object coordinates and passed
+     * on to the shape as a packet.
+     */
+    int intersectPacket(const RayPacket &packet, int mask,
+                        Intersection *its) const override;
+    /**
+     * @brief Like @ref intersectPacket , but only records the hits and defers
+     * transforming the surface data to @ref populateHit (see @ref findHit ).
+     */
+    int findHitPacket(const RayPacket &packet, int mask,
+                      Intersection *its) const override;
     /// @brief Returns the bounding box of the instance in world coordinates.
     Bounds getBoundingBox() const override;
     /// @brief Returns the centroid of the instance in world coordinates.
@@ -113,6 +143,10 @@ public:
      * @param rng A random number generator used to steer sampling decisions.
      */
     AreaSample sampleArea(Sampler &rng) const override;
+    /// @brief Prepares the shape for area sampling.
+    void prepareAreaSampling(const Emission *emission) override {
+        m_shape->prepareAreaSampling(emission);
+    }
 
     /// @brief Returns a textual representation of this image.
     std::string toString() const override {
@@ -39,12 +39,22 @@ protected:
     ref<Image> m_image;
     /// @brief The scene that should be rendered.
     ref<Scene> m_scene;
+    /// @brief The number of pixels whose camera rays are traced together as a
+    /// packet (1 traces every camera ray on its own).
+    int m_packetSize;
 
 public:
     SamplingIntegrator(const Properties &properties) : Integrator(properties) {
         m_sampler = properties.getChild<Sampler>();
         m_image   = properties.getOptionalChild<Image>();
         m_scene   = properties.getChild<Scene>();
+
+        m_packetSize = properties.get<int>("packetSize", 1);
+        if (m_packetSize != 1 && m_packetSize != 4 && m_packetSize != 8 &&
+            m_packetSize != 16) {
+            lightwave_throw("unsupported packet size %d (must be 1, 4, 8 or 16)",
+                            m_packetSize);
+        }
     }
 
     /// @brief Sets the output image that should be populated by rendering.
@@ -71,6 +81,23 @@ public:
      * @ref execute function of the integrator.
      */
     virtual Color Li(const Ray &ray, Sampler &rng) = 0;
+
+    /**
+     * @brief Returns (an estimate of) the incident radiance for a ray whose
+     * first intersection with the scene has already been found, e.g., because
+     * camera rays were intersected as a packet (see the @c packetSize
+     * property). Integrators that start by intersecting the ray should
+     * override this to avoid tracing it a second time; the default ignores
+     * the intersection and calls @ref Li .
+     */
+    virtual Color Li(const Ray &ray, const Intersection &its, Sampler &rng) {
+        return Li(ray, rng);
+    }
+
+private:
+    /// @brief Renders the pixels of a block by intersecting the camera rays of
+    /// neighboring pixels as packets.
+    void renderPacketBlock(const Bounds2i &block);
 };
 
 } // namespace lightwave
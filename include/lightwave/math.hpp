@@ -945,6 +945,24 @@ struct SurfaceEvent {
     }
 };
 
+/**
+ * @brief The minimal information about a hit that is recorded while searching
+ * for the closest intersection, from which the surface data is computed once
+ * the closest hit is known (see @ref Shape::findHit ).
+ */
+struct HitRecord {
+    /// @brief The shape that recorded the hit and computes its surface data,
+    /// or @c nullptr if the surface data has already been computed.
+    const Shape *shape = nullptr;
+    /// @brief The instance through which the shape has been hit, which
+    /// transforms the surface data into its parent space, if any.
+    const Shape *instance = nullptr;
+    /// @brief The index of the primitive that was hit (e.g., the triangle).
+    int primitiveIndex = 0;
+    /// @brief The barycentric coordinates of the hit within the primitive.
+    Point2 uv;
+};
+
 /// @brief Describes an intersection of a ray with a surface.
 struct Intersection : public SurfaceEvent {
     /// @brief The direction of the ray that hit the surface, pointing away from
@@ -964,6 +982,8 @@ struct Intersection : public SurfaceEvent {
      * and the scene has defined one.
      */
     BackgroundLight *background = nullptr;
+    /// @brief The hit whose surface data still needs to be computed, if any.
+    HitRecord hit;
 
     /// @brief Statistics recorded while traversing acceleration structures.
     struct {
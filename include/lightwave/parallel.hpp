@@ -5,8 +5,10 @@
 
 #pragma once
 
+#include <algorithm>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 #include <lightwave/color.hpp>
 #include <lightwave/logger.hpp>
@@ -68,6 +70,14 @@ void for_each_parallel(Iterator it, UnaryFunction f) {
     for_each_parallel(it.begin(), it.end(), f);
 }
 
+/**
+ * @brief Returns the CPU time (in seconds) that the calling thread has consumed
+ * so far. Unlike wall-clock time, this does not advance while the thread is
+ * blocked (e.g., waiting for other threads), which makes it suitable to
+ * measure the actual work performed by parallel tasks.
+ */
+double threadCpuTime();
+
 /// @brief Atomically increment a floating point number.
 inline float atomicAdd(float &dst, float delta) {
 #if defined(__clang__)
@@ -57,9 +57,19 @@ public:
 
     /// @brief Finds the closest intersection of the scene for a given ray.
     Intersection intersect(const Ray &ray, Sampler &rng) const;
-    /// @brief Reports whether any intersection up to a given maximal distance
-    /// exists (used for testing visibility of light sources).
+    /**
+     * @brief Reports whether any intersection up to a given maximal distance
+     * exists (used for testing visibility of light sources). This stops at the
+     * first intersection found and is hence cheaper than finding the closest
+     * intersection.
+     */
     bool intersect(const Ray &ray, float tMax, Sampler &rng) const;
+    /**
+     * @brief Finds the closest intersections of the scene for all rays of a
+     * packet at once, storing the intersection of the i-th ray in @c its[i]
+     * (see @ref RayPacket ).
+     */
+    void intersect(const RayPacket &packet, Intersection *its) const;
 
     /// @brief Reports whether at least one light exists that could be sampled.
     bool hasLights() const;
@@ -30,6 +30,26 @@ struct AreaSample : public SurfaceEvent {
     }
 };
 
+/**
+ * @brief A group of coherent rays (e.g., camera rays of neighboring pixels)
+ * that are traced together, so that acceleration structures can share the
+ * work of traversing their nodes among the rays.
+ */
+struct RayPacket {
+    /// @brief The maximum number of rays in a packet.
+    static constexpr int MaxSize = 16;
+
+    /// @brief The number of rays in the packet.
+    int size = 0;
+    /// @brief The rays of the packet.
+    Ray rays[MaxSize];
+    /// @brief The random number generator of every ray.
+    Sampler *rng[MaxSize];
+
+    /// @brief Returns a bitmask in which the bits of all rays are set.
+    int mask() const { return (1 << size) - 1; }
+};
+
 /// @brief A shape represents a geometrical object that can be intersected by
 /// rays.
 class Shape : public Object {
@@ -42,6 +62,80 @@ public:
      */
     virtual bool intersect(const Ray &ray, Intersection &its,
                            Sampler &rng) const = 0;
+    /**
+     * @brief Like @ref intersect , but may only update @c its.t and record the
+     * hit in @c its.hit instead of computing the surface data, which is done
+     * by @ref completeHit once the closest hit along the ray is known. This
+     * avoids computing surface data for hits that are later replaced by
+     * closer ones.
+     * @note The default implementation falls back to @ref intersect .
+     */
+    virtual bool findHit(const Ray &ray, Intersection &its,
+                         Sampler &rng) const {
+        if (!intersect(ray, its, rng))
+            return false;
+        // the surface data is already there
+        its.hit = {};
+        return true;
+    }
+    /**
+     * @brief Computes the surface data of a hit that this shape has recorded
+     * in @c its.hit during @ref findHit .
+     */
+    virtual void populateHit(const Ray &ray, Intersection &its) const {}
+    /**
+     * @brief Computes the surface data of the hit found by @ref findHit ,
+     * unless it has already been computed.
+     */
+    static void completeHit(const Ray &ray, Intersection &its) {
+        const Shape *shape = its.hit.instance ? its.hit.instance : its.hit.shape;
+        if (shape)
+            shape->populateHit(ray, its);
+        its.hit = {};
+    }
+    /**
+     * @brief Tests whether the shape blocks a ray anywhere before @c tMax ,
+     * e.g., to test the visibility of a light source. Unlike @ref intersect ,
+     * this may stop at the first intersection that is found, and does not
+     * compute any surface information.
+     * @note The default implementation falls back to @ref intersect .
+     */
+    virtual bool occluded(const Ray &ray, float tMax, Sampler &rng) const {
+        Intersection its(-ray.direction, tMax);
+        return intersect(ray, its, rng);
+    }
+    /**
+     * @brief Tests the shape for intersection with those rays of a packet
+     * whose bit is set in @c mask , updating @c its[i] for the i-th ray like
+     * @ref intersect does. Returns the bitmask of the rays that hit the shape.
+     * @note The default implementation intersects the rays one by one.
+     */
+    virtual int intersectPacket(const RayPacket &packet, int mask,
+                                Intersection *its) const {
+        int hits = 0;
+        for (int i = 0; i < packet.size; i++) {
+            if ((mask >> i & 1) &&
+                intersect(packet.rays[i], its[i], *packet.rng[i]))
+                hits |= 1 << i;
+        }
+        return hits;
+    }
+    /**
+     * @brief Like @ref intersectPacket , but may only record the hits in
+     * @c its[i].hit like @ref findHit does, leaving the surface data to
+     * @ref completeHit .
+     * @note The default implementation falls back to @ref intersectPacket .
+     */
+    virtual int findHitPacket(const RayPacket &packet, int mask,
+                              Intersection *its) const {
+        const int hits = intersectPacket(packet, mask, its);
+        for (int i = 0; i < packet.size; i++) {
+            // the surface data is already there
+            if (hits >> i & 1)
+                its[i].hit = {};
+        }
+        return hits;
+    }
     /// @brief Returns a bounding box that tightly encapsulates the shape.
     virtual Bounds getBoundingBox() const = 0;
     /**
@@ -56,6 +150,13 @@ public:
     virtual Point getCentroid() const = 0;
     /// @brief Samples a random point on the surface of this shape.
     virtual AreaSample sampleArea(Sampler &rng) const { NOT_IMPLEMENTED }
+    /**
+     * @brief Called before @ref sampleArea is used by an area light, which
+     * allows shapes to precompute the distribution they sample points from.
+     * @param emission The emission of the light, which shapes may use to
+     * sample bright regions more often (can be null).
+     */
+    virtual void prepareAreaSampling(const Emission *emission) {}
 
     /**
      * @brief Marks that the shape is part of the scene geometry, i.e., can be
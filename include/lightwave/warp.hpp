@@ -7,6 +7,8 @@
 
 #include <lightwave/math.hpp>
 
+#include <vector>
+
 namespace lightwave {
 
 /**
@@ -82,4 +84,99 @@ inline float cosineHemispherePdf(const Vector &vector) {
     return InvPi * std::max(vector.z(), float(0));
 }
 
+/**
+ * @brief Warps a given point from the unit square ([0,0] to [1,1]) to the
+ * barycentric coordinates of a uniformly distributed point in a triangle,
+ * where [0,0] is the first vertex, [1,0] the second and [0,1] the third.
+ * @see Based on Heitz, "A Low-Distortion Map Between Triangle and Square".
+ */
+inline Point2 squareToUniformTriangle(const Point2 &sample) {
+    if (sample.y() > sample.x()) {
+        const float x = sample.x() / 2;
+        return { x, sample.y() - x };
+    }
+    const float y = sample.y() / 2;
+    return { sample.x() - y, y };
+}
+
+/**
+ * @brief Samples an index from a discrete distribution in constant time,
+ * using the alias method: every index owns a bucket of equal probability, in
+ * which it is picked with a given probability and its alias otherwise.
+ * @see Based on Vose, "A Linear Algorithm for Generating Random Numbers with
+ * a Given Distribution".
+ */
+class AliasTable {
+    struct Bucket {
+        /// @brief The probability of picking the bucket's own index.
+        float threshold;
+        /// @brief The index that is picked otherwise.
+        int alias;
+    };
+
+    std::vector<Bucket> m_buckets;
+    /// @brief The normalized probabilities of the indices.
+    std::vector<float> m_probabilities;
+
+public:
+    AliasTable() = default;
+
+    /// @brief Builds the table for the given non-negative weights, which do
+    /// not need to be normalized but must not all be zero.
+    explicit AliasTable(const std::vector<float> &weights) {
+        const int n = int(weights.size());
+        double total = 0;
+        for (float weight : weights)
+            total += weight;
+        if (!(total > 0)) {
+            lightwave_throw("cannot sample from weights that sum to %f", total);
+        }
+
+        m_buckets.resize(n);
+        m_probabilities.resize(n);
+        // scale the probabilities such that each bucket holds a mass of one
+        std::vector<double> mass(n);
+        std::vector<int> small, large;
+        for (int i = 0; i < n; i++) {
+            m_probabilities[i] = float(weights[i] / total);
+            mass[i]            = weights[i] / total * n;
+            (mass[i] < 1 ? small : large).push_back(i);
+        }
+
+        // fill up each small bucket with the excess of a large one
+        while (!small.empty() && !large.empty()) {
+            const int lower = small.back();
+            const int upper = large.back();
+            small.pop_back();
+            m_buckets[lower] = { float(mass[lower]), upper };
+            mass[upper] -= 1 - mass[lower];
+            if (mass[upper] < 1) {
+                large.pop_back();
+                small.push_back(upper);
+            }
+        }
+        // the remaining buckets are full up to rounding errors
+        for (int i : small)
+            m_buckets[i] = { 1, i };
+        for (int i : large)
+            m_buckets[i] = { 1, i };
+    }
+
+    /// @brief Returns whether the table has been built.
+    bool empty() const { return m_buckets.empty(); }
+    /// @brief Returns the number of indices in the distribution.
+    int size() const { return int(m_buckets.size()); }
+    /// @brief Returns the probability of sampling the given index.
+    float probability(int index) const { return m_probabilities[index]; }
+
+    /// @brief Maps a uniform sample in [0,1) to an index, distributed
+    /// according to the weights the table has been built with.
+    int sample(float sample) const {
+        const float scaled = sample * size();
+        const int bucket   = std::min(int(scaled), size() - 1);
+        const Bucket &b    = m_buckets[bucket];
+        return scaled - bucket < b.threshold ? bucket : b.alias;
+    }
+};
+
 } // namespace lightwave
@@ -46,6 +46,22 @@ public:
                              .weight = Color(1.0f) };
     }
 
+    void samplePacket(const Point2 *normalized, Sampler *const *rng,
+                      CameraSample *samples, int count) const override {
+        // all rays start at the camera position, which only needs to be
+        // transformed once per packet
+        const Point origin = m_transform->apply(Point(0.f));
+        for (int i = 0; i < count; i++) {
+            const auto direction = Vector(normalized[i].x() * factorX,
+                                          normalized[i].y() * factorY,
+                                          1.f);
+            samples[i] = CameraSample{
+                .ray    = Ray(origin, m_transform->apply(direction).normalized()),
+                .weight = Color(1.0f),
+            };
+        }
+    }
+
     std::string toString() const override {
         return tfm::format(
             "Perspective[\n"
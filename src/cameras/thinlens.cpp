@@ -60,6 +60,37 @@ public:
                              .weight = Color(1.0f) };
     }
 
+    void samplePacket(const Point2 *normalized, Sampler *const *rng,
+                      CameraSample *samples, int count) const override {
+        // the transform is affine, so transforming the lens center and the
+        // axes of the camera once per packet is enough to construct all rays
+        const Point center = m_transform->apply(Point(0.f));
+        const Vector axes[3] = { m_transform->apply(Vector(1.f, 0.f, 0.f)),
+                                 m_transform->apply(Vector(0.f, 1.f, 0.f)),
+                                 m_transform->apply(Vector(0.f, 0.f, 1.f)) };
+        const auto toWorld = [&](const Vector &local) {
+            return local.x() * axes[0] + local.y() * axes[1] +
+                   local.z() * axes[2];
+        };
+
+        for (int i = 0; i < count; i++) {
+            // same sampling of the aperture as for individual rays
+            const float radius = sqrt(rng[i]->next()) * apertureDiameter;
+            const float angle  = rng[i]->next() * 2 * Pi;
+            const Vector source =
+                Vector(radius * sin(angle), radius * cos(angle), 0.0);
+            const Vector target = Vector(normalized[i].x() * factorX,
+                                         normalized[i].y() * factorY,
+                                         focusDistance);
+
+            samples[i] = CameraSample{
+                .ray    = Ray(center + toWorld(source),
+                              toWorld((target - source).normalized())),
+                .weight = Color(1.0f),
+            };
+        }
+    }
+
     std::string toString() const override {
         return tfm::format(
             "Perspective[\n"
@@ -1,5 +1,6 @@
 #include <lightwave/camera.hpp>
 #include <lightwave/sampler.hpp>
+#include <lightwave/shape.hpp>
 
 namespace lightwave {
 
@@ -21,4 +22,24 @@ CameraSample Camera::sample(const Point2i &pixel, Sampler &rng) const {
     return cameraSample;
 }
 
+void Camera::samplePacket(const Point2i *pixels, Sampler *const *rng,
+                          CameraSample *samples, int count) const {
+    Point2 normalized[RayPacket::MaxSize];
+    for (int i = 0; i < count; i++) {
+        const auto pixelPlusRandomOffset =
+            Vector2(pixels[i].cast<float>()) + Vector2(rng[i]->next2D());
+        normalized[i] = Point2(2 * pixelPlusRandomOffset /
+                                   m_resolution.cast<float>() -
+                               Vector2(1));
+    }
+    samplePacket(normalized, rng, samples, count);
+    for (int i = 0; i < count; i++) {
+        assert_normalized(samples[i].ray.direction, {
+            logger(EError,
+                   "  your Camera::samplePacket() implementation returned a "
+                   "non-normalized direction");
+        });
+    }
+}
+
 } // namespace lightwave
@@ -115,6 +115,177 @@ bool Instance::intersect(const Ray &worldRay, Intersection &its,
     return wasIntersected;
 }
 
+bool Instance::findHit(const Ray &worldRay, Intersection &its,
+                       Sampler &rng) const {
+    if (m_alpha) {
+        return Shape::findHit(worldRay, its, rng);
+    }
+
+    // same steps as in intersect, apart from transforming the surface data
+    Ray localRay    = worldRay;
+    float rayLength = 1;
+    if (m_transform) {
+        localRay  = m_transform->inverse(worldRay);
+        rayLength = localRay.direction.length();
+        localRay  = localRay.normalized();
+    }
+
+    const float prevT       = its.t;
+    const HitRecord prevHit = its.hit;
+    its.t *= rayLength;
+    its.hit = {};
+    if (!m_shape->findHit(localRay, its, rng)) {
+        its.t   = prevT;
+        its.hit = prevHit;
+        return false;
+    }
+
+    its.instance = this;
+    validateIntersection(its);
+    if (its.hit.instance) {
+        // a nested instance needs its ray, which is only known here
+        completeHit(localRay, its);
+    }
+    its.t /= rayLength;
+    its.hit.instance = this;
+    return true;
+}
+
+void Instance::populateHit(const Ray &worldRay, Intersection &its) const {
+    if (!m_transform) {
+        if (its.hit.shape)
+            its.hit.shape->populateHit(worldRay, its);
+        return;
+    }
+
+    Ray localRay          = m_transform->inverse(worldRay);
+    const float rayLength = localRay.direction.length();
+    localRay              = localRay.normalized();
+
+    if (its.hit.shape) {
+        const float t = its.t;
+        its.t *= rayLength;
+        its.hit.shape->populateHit(localRay, its);
+        its.t = t;
+    }
+    transformFrame(its, -localRay.direction);
+}
+
+int Instance::intersectPacket(const RayPacket &worldPacket, int mask,
+                              Intersection *its) const {
+    // same steps as for individual rays, see intersect
+    Intersection prevIts[RayPacket::MaxSize];
+    float rayLength[RayPacket::MaxSize];
+    RayPacket localPacket = worldPacket;
+    for (int i = 0; i < worldPacket.size; i++) {
+        if (!(mask >> i & 1))
+            continue;
+        prevIts[i] = its[i];
+        if (m_transform) {
+            const Ray localRay = m_transform->inverse(worldPacket.rays[i]);
+            rayLength[i]       = localRay.direction.length();
+            localPacket.rays[i] = localRay.normalized();
+            its[i].t *= rayLength[i];
+        }
+    }
+
+    int hits = m_shape->intersectPacket(localPacket, mask, its);
+    for (int i = 0; i < worldPacket.size; i++) {
+        if (!(mask >> i & 1))
+            continue;
+        if (!(hits >> i & 1)) {
+            if (m_transform)
+                its[i] = prevIts[i];
+            continue;
+        }
+
+        validateIntersection(its[i]);
+        if (m_alpha &&
+            m_alpha->evaluate(its[i].uv).a() <= worldPacket.rng[i]->next()) {
+            its[i] = prevIts[i];
+            hits &= ~(1 << i);
+            continue;
+        }
+
+        its[i].instance = this;
+        if (m_transform) {
+            its[i].t /= rayLength[i];
+            transformFrame(its[i], -localPacket.rays[i].direction);
+        }
+    }
+    return hits;
+}
+
+int Instance::findHitPacket(const RayPacket &worldPacket, int mask,
+                            Intersection *its) const {
+    if (m_alpha) {
+        return Shape::findHitPacket(worldPacket, mask, its);
+    }
+
+    // same steps as in findHit, for all rays of the packet
+    float prevT[RayPacket::MaxSize];
+    HitRecord prevHit[RayPacket::MaxSize];
+    float rayLength[RayPacket::MaxSize];
+    RayPacket localPacket = worldPacket;
+    for (int i = 0; i < worldPacket.size; i++) {
+        if (!(mask >> i & 1))
+            continue;
+        prevT[i]     = its[i].t;
+        prevHit[i]   = its[i].hit;
+        rayLength[i] = 1;
+        if (m_transform) {
+            const Ray localRay  = m_transform->inverse(worldPacket.rays[i]);
+            rayLength[i]        = localRay.direction.length();
+            localPacket.rays[i] = localRay.normalized();
+            its[i].t *= rayLength[i];
+        }
+        its[i].hit = {};
+    }
+
+    const int hits = m_shape->findHitPacket(localPacket, mask, its);
+    for (int i = 0; i < worldPacket.size; i++) {
+        if (!(mask >> i & 1))
+            continue;
+        if (!(hits >> i & 1)) {
+            its[i].t   = prevT[i];
+            its[i].hit = prevHit[i];
+            continue;
+        }
+
+        its[i].instance = this;
+        validateIntersection(its[i]);
+        if (its[i].hit.instance) {
+            // a nested instance needs its ray, which is only known here
+            completeHit(localPacket.rays[i], its[i]);
+        }
+        its[i].t /= rayLength[i];
+        its[i].hit.instance = this;
+    }
+    return hits;
+}
+
+bool Instance::occluded(const Ray &worldRay, float tMax, Sampler &rng) const {
+    Ray localRay    = worldRay;
+    float rayLength = 1;
+    if (m_transform) {
+        localRay  = m_transform->inverse(worldRay);
+        rayLength = localRay.direction.length();
+        localRay  = localRay.normalized();
+    }
+
+    if (!m_alpha) {
+        return m_shape->occluded(localRay, tMax * rayLength, rng);
+    }
+
+    // alpha masking requires the texture coordinates of the closest hit, but
+    // the shading frame does not need to be transformed
+    Intersection its(-localRay.direction, tMax * rayLength);
+    if (!m_shape->intersect(localRay, its, rng)) {
+        return false;
+    }
+    return m_alpha->evaluate(its.uv).a() > rng.next();
+}
+
 Bounds Instance::getBoundingBox() const {
     if (!m_transform) {
         // fast path
@@ -151,7 +322,9 @@ Point Instance::getCentroid() const {
 
 AreaSample Instance::sampleArea(Sampler &rng) const {
     AreaSample sample = m_shape->sampleArea(rng);
-    transformFrame(sample, Vector());
+    if (m_transform) {
+        transformFrame(sample, Vector());
+    }
     return sample;
 }
 
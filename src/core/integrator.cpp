@@ -1,6 +1,7 @@
 #include <lightwave/camera.hpp>
 #include <lightwave/integrator.hpp>
 #include <lightwave/parallel.hpp>
+#include <lightwave/shape.hpp>
 
 #include <algorithm>
 #include <chrono>
@@ -24,6 +25,13 @@ void SamplingIntegrator::execute() {
     Streaming stream{ *m_image };
     ProgressReporter progress{ resolution.product() };
     for_each_parallel(BlockSpiral(resolution, Vector2i(64)), [&](auto block) {
+        if (m_packetSize > 1) {
+            renderPacketBlock(block);
+            progress += block.diagonal().product();
+            stream.updateBlock(block);
+            return;
+        }
+
         auto sampler = m_sampler->clone();
         for (auto pixel : block) {
             Color sum;
@@ -44,4 +52,67 @@ void SamplingIntegrator::execute() {
     m_image->save();
 }
 
+void SamplingIntegrator::renderPacketBlock(const Bounds2i &block) {
+    // packets cover tiles of neighboring pixels, which keeps their camera
+    // rays coherent
+    const Vector2i tileSize = m_packetSize == 4   ? Vector2i(2, 2)
+                              : m_packetSize == 8 ? Vector2i(4, 2)
+                                                  : Vector2i(4, 4);
+    const float norm        = 1.0f / m_sampler->samplesPerPixel();
+
+    // every pixel of a packet needs its own random number generator, so that
+    // it sees the same random numbers as when rendered on its own
+    ref<Sampler> samplers[RayPacket::MaxSize];
+    Sampler *rng[RayPacket::MaxSize];
+    for (int i = 0; i < m_packetSize; i++) {
+        samplers[i] = m_sampler->clone();
+        rng[i]      = samplers[i].get();
+    }
+
+    Point2i pixels[RayPacket::MaxSize];
+    CameraSample cameraSamples[RayPacket::MaxSize];
+    Intersection its[RayPacket::MaxSize];
+    Color sums[RayPacket::MaxSize];
+    RayPacket packet;
+
+    for (int y = block.min().y(); y < block.max().y(); y += tileSize.y()) {
+        for (int x = block.min().x(); x < block.max().x(); x += tileSize.x()) {
+            // collect the pixels of the tile that lie within the block
+            int count = 0;
+            for (int dy = 0; dy < tileSize.y(); dy++) {
+                for (int dx = 0; dx < tileSize.x(); dx++) {
+                    if (x + dx < block.max().x() && y + dy < block.max().y())
+                        pixels[count++] = Point2i(x + dx, y + dy);
+                }
+            }
+
+            for (int i = 0; i < count; i++)
+                sums[i] = Color(0);
+
+            for (int sample = 0; sample < m_sampler->samplesPerPixel();
+                 sample++) {
+                for (int i = 0; i < count; i++)
+                    rng[i]->seed(pixels[i], sample);
+                m_scene->camera()->samplePacket(
+                    pixels, rng, cameraSamples, count);
+
+                packet.size = count;
+                for (int i = 0; i < count; i++) {
+                    packet.rays[i] = cameraSamples[i].ray;
+                    packet.rng[i]  = rng[i];
+                }
+                m_scene->intersect(packet, its);
+
+                for (int i = 0; i < count; i++) {
+                    sums[i] += cameraSamples[i].weight *
+                               Li(cameraSamples[i].ray, its[i], *rng[i]);
+                }
+            }
+
+            for (int i = 0; i < count; i++)
+                m_image->get(pixels[i]) = norm * sums[i];
+        }
+    }
+}
+
 } // namespace lightwave
@@ -1,5 +1,6 @@
 #include <lightwave/core.hpp>
 #include <lightwave/logger.hpp>
+#include <lightwave/properties.hpp>
 #include <lightwave/registry.hpp>
 #include <catch_amalgamated.hpp>
 
@@ -28,6 +29,29 @@ int runUnitTests(int argc, const char *argv[]) {
     return Catch::Session().run( argc, argv );
 }
 
+/**
+ * @brief Converts a mesh file into a native mesh file, invoked as
+ * @code blob --convert in.ply out.lwmesh [--compact] @endcode .
+ */
+int convertMesh(int argc, const char *argv[]) {
+    if (argc < 4 || argc > 5 ||
+        (argc == 5 && std::string(argv[4]) != "--compact")) {
+        logger(EError,
+               "usage: %s --convert <input> <output.lwmesh> [--compact]",
+               argv[0]);
+        return 1;
+    }
+
+    Properties properties;
+    properties.set<std::string>("filename", argv[2]);
+    properties.set<std::string>("output", argv[3]);
+    properties.set<bool>("compactVertices", argc == 5);
+    const auto converter = std::dynamic_pointer_cast<Executable>(
+        Registry::create("convert", "mesh", properties));
+    converter->execute();
+    return 0;
+}
+
 int main(int argc, const char *argv[]) {
 #ifdef LW_DEBUG
     logger(EWarn, "lightwave was compiled in Debug mode, expect rendering to "
@@ -51,6 +75,10 @@ int main(int argc, const char *argv[]) {
 #endif
 
     try {
+        if (argc > 1 && std::string(argv[1]) == "--convert") {
+            return convertMesh(argc, argv);
+        }
+
         if (argc <= 1 || *argv[1] == '-') {
             logger(EInfo, "running unit tests since no scene path was given");
             return runUnitTests(argc, argv);
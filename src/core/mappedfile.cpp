@@ -0,0 +1,94 @@
+#include "mappedfile.hpp"
+
+#ifdef LW_OS_WINDOWS
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lightwave {
+
+#ifdef LW_OS_WINDOWS
+MappedFile::MappedFile(const std::filesystem::path &path) {
+    const HANDLE file = CreateFileW(path.c_str(),
+                                    GENERIC_READ,
+                                    FILE_SHARE_READ,
+                                    nullptr,
+                                    OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL,
+                                    nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        lightwave_throw("could not open file \"%s\"", path.generic_string());
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        lightwave_throw("could not determine size of file \"%s\"",
+                        path.generic_string());
+    }
+    m_size = size_t(size.QuadPart);
+
+    if (m_size > 0) {
+        m_mapping =
+            CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping) {
+            m_data = static_cast<const uint8_t *>(
+                MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+    }
+    CloseHandle(file);
+
+    if (m_size > 0 && !m_data) {
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        lightwave_throw("could not map file \"%s\"", path.generic_string());
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path &path) {
+    const int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        lightwave_throw("could not open file \"%s\"", path.generic_string());
+    }
+
+    struct stat status;
+    if (fstat(file, &status) != 0) {
+        close(file);
+        lightwave_throw("could not determine size of file \"%s\"",
+                        path.generic_string());
+    }
+    m_size = size_t(status.st_size);
+
+    if (m_size > 0) {
+        void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (data == MAP_FAILED) {
+            close(file);
+            lightwave_throw("could not map file \"%s\"",
+                            path.generic_string());
+        }
+        m_data = static_cast<const uint8_t *>(data);
+    }
+    // the mapping stays valid after the file descriptor is closed
+    close(file);
+}
+
+MappedFile::~MappedFile() {
+    if (m_data)
+        munmap(const_cast<uint8_t *>(m_data), m_size);
+}
+#endif
+
+} // namespace lightwave
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <lightwave/core.hpp>
+
+#include <filesystem>
+
+namespace lightwave {
+
+/**
+ * @brief A file that is mapped into memory for reading, which avoids copying
+ * its contents into buffers. The mapping is released when the object is
+ * destroyed.
+ */
+class MappedFile {
+    /// @brief The start of the mapped contents, or nullptr if the file is
+    /// empty.
+    const uint8_t *m_data = nullptr;
+    /// @brief The size of the file in bytes.
+    size_t m_size = 0;
+#ifdef LW_OS_WINDOWS
+    /// @brief The handle of the file mapping object.
+    void *m_mapping = nullptr;
+#endif
+
+public:
+    /// @brief Maps the given file, throws if it cannot be opened.
+    MappedFile(const std::filesystem::path &path);
+    MappedFile(const MappedFile &)            = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    /// @brief Returns the contents of the file.
+    const uint8_t *data() const { return m_data; }
+    /// @brief Returns the size of the file in bytes.
+    size_t size() const { return m_size; }
+};
+
+} // namespace lightwave
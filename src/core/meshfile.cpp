@@ -0,0 +1,115 @@
+#include "meshfile.hpp"
+
+#include <fstream>
+#include <random>
+
+namespace lightwave {
+
+/// @brief Converts a tag into the four characters stored in the file.
+static void encodeTag(const std::string &tag, char (&encoded)[4]) {
+    if (tag.size() != 4)
+        lightwave_throw("section tag \"%s\" must have four characters", tag);
+    std::memcpy(encoded, tag.data(), 4);
+}
+
+void MeshFileWriter::add(const std::string &tag, const void *data,
+                         size_t size) {
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    m_sections.push_back({ tag, std::vector<uint8_t>(bytes, bytes + size) });
+}
+
+void MeshFileWriter::write(const std::filesystem::path &path) const {
+    meshfile::Header header;
+    header.sectionCount = uint32_t(m_sections.size());
+
+    std::vector<meshfile::Section> table(m_sections.size());
+    uint64_t offset = sizeof(header) + table.size() * sizeof(meshfile::Section);
+    for (size_t i = 0; i < m_sections.size(); i++) {
+        offset = (offset + meshfile::SectionAlignment - 1) /
+                 meshfile::SectionAlignment * meshfile::SectionAlignment;
+        encodeTag(m_sections[i].tag, table[i].tag);
+        table[i].offset = offset;
+        table[i].size   = m_sections[i].data.size();
+        offset += table[i].size;
+    }
+
+    // write to a temporary file first, so that other processes never load a
+    // partially written mesh
+    std::filesystem::path temporary = path;
+    temporary += tfm::format(".%08x.tmp", std::random_device()());
+    {
+        std::ofstream stream(temporary, std::ios::binary);
+        stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        stream.write(reinterpret_cast<const char *>(table.data()),
+                     table.size() * sizeof(meshfile::Section));
+        for (size_t i = 0; i < m_sections.size(); i++) {
+            const std::vector<char> padding(
+                table[i].offset - uint64_t(stream.tellp()), 0);
+            stream.write(padding.data(), padding.size());
+            stream.write(
+                reinterpret_cast<const char *>(m_sections[i].data.data()),
+                m_sections[i].data.size());
+        }
+        if (!stream) {
+            std::error_code error;
+            std::filesystem::remove(temporary, error);
+            lightwave_throw("could not write \"%s\"", path.generic_string());
+        }
+    }
+    std::filesystem::rename(temporary, path);
+}
+
+MeshFileReader::MeshFileReader(const std::filesystem::path &path)
+    : m_file(path) {
+    meshfile::Header header;
+    if (m_file.size() < sizeof(header) ||
+        std::memcmp(m_file.data(), meshfile::Header().magic, 4) != 0)
+        lightwave_throw("file is not a native mesh file");
+    std::memcpy(&header, m_file.data(), sizeof(header));
+    if (header.version != meshfile::Header().version) {
+        lightwave_throw("unsupported native mesh version %d (expected %d)",
+                        header.version,
+                        meshfile::Header().version);
+    }
+
+    const size_t tableSize = header.sectionCount * sizeof(meshfile::Section);
+    if (m_file.size() < sizeof(header) + tableSize)
+        lightwave_throw("file is truncated");
+    m_sections.resize(header.sectionCount);
+    std::memcpy(m_sections.data(), m_file.data() + sizeof(header), tableSize);
+    for (const meshfile::Section &section : m_sections) {
+        if (section.offset > m_file.size() ||
+            section.size > m_file.size() - section.offset)
+            lightwave_throw("file is truncated");
+    }
+}
+
+const meshfile::Section &MeshFileReader::find(const std::string &tag) const {
+    char encoded[4];
+    encodeTag(tag, encoded);
+    for (const meshfile::Section &section : m_sections) {
+        if (std::memcmp(section.tag, encoded, 4) == 0)
+            return section;
+    }
+    lightwave_throw("file has no section %s", tag);
+}
+
+bool MeshFileReader::has(const std::string &tag) const {
+    char encoded[4];
+    encodeTag(tag, encoded);
+    for (const meshfile::Section &section : m_sections) {
+        if (std::memcmp(section.tag, encoded, 4) == 0)
+            return true;
+    }
+    return false;
+}
+
+const uint8_t *MeshFileReader::data(const std::string &tag) const {
+    return m_file.data() + find(tag).offset;
+}
+
+size_t MeshFileReader::size(const std::string &tag) const {
+    return find(tag).size;
+}
+
+} // namespace lightwave
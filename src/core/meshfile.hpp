@@ -0,0 +1,111 @@
+#pragma once
+
+#include "mappedfile.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace lightwave {
+
+/**
+ * @brief Native mesh files (.lwmesh) store the arrays of a mesh in the layout
+ * the renderer uses in memory, so that loading them only requires copying
+ * (or referencing) the mapped bytes instead of parsing them.
+ *
+ * A file consists of a header, followed by a table of sections and the
+ * sections themselves. Each section is identified by a four character tag and
+ * starts at an offset aligned to @ref SectionAlignment . All values are
+ * stored in the byte order of the machine that wrote the file.
+ */
+namespace meshfile {
+
+/// @brief The header at the start of every native mesh file.
+struct Header {
+    char magic[4] = { 'L', 'W', 'M', 'S' };
+    /// @brief Needs to be incremented whenever the layout of any section
+    /// changes, so that outdated files are rejected.
+    uint32_t version = 1;
+    uint32_t sectionCount;
+    uint32_t reserved = 0;
+};
+
+/// @brief An entry of the section table, which follows the header.
+struct Section {
+    char tag[4];
+    uint32_t reserved = 0;
+    /// @brief The offset of the section from the start of the file.
+    uint64_t offset;
+    /// @brief The size of the section in bytes.
+    uint64_t size;
+};
+
+/// @brief Sections start at multiples of this, so that their contents can be
+/// accessed in place.
+static constexpr size_t SectionAlignment = 64;
+
+} // namespace meshfile
+
+/// @brief Collects the sections of a native mesh file and writes them.
+class MeshFileWriter {
+    struct PendingSection {
+        std::string tag;
+        std::vector<uint8_t> data;
+    };
+    std::vector<PendingSection> m_sections;
+
+public:
+    /// @brief Adds a section with a copy of the given bytes.
+    void add(const std::string &tag, const void *data, size_t size);
+
+    /// @brief Adds a section holding the elements of a vector.
+    template <typename T>
+    void add(const std::string &tag, const std::vector<T> &elements) {
+        add(tag, elements.data(), elements.size() * sizeof(T));
+    }
+
+    /// @brief Writes all sections to a file, throws if this fails.
+    void write(const std::filesystem::path &path) const;
+};
+
+/// @brief Maps a native mesh file and provides access to its sections.
+class MeshFileReader {
+    MappedFile m_file;
+    std::vector<meshfile::Section> m_sections;
+
+public:
+    /// @brief Maps the file and validates its header and section table,
+    /// throws if the file is not a valid native mesh file.
+    MeshFileReader(const std::filesystem::path &path);
+
+    /// @brief Returns whether the file has a section with the given tag.
+    bool has(const std::string &tag) const;
+
+    /// @brief Returns the contents of a section, throws if there is none.
+    const uint8_t *data(const std::string &tag) const;
+    /// @brief Returns the size of a section in bytes, throws if there is
+    /// none.
+    size_t size(const std::string &tag) const;
+
+    /// @brief Copies a section into a vector, throws if there is none or if
+    /// its size is not a multiple of the element size.
+    template <typename T> std::vector<T> read(const std::string &tag) const {
+        const size_t bytes = size(tag);
+        if (bytes % sizeof(T) != 0) {
+            lightwave_throw("section %s has a size of %d bytes, which is not "
+                            "a multiple of %d",
+                            tag,
+                            bytes,
+                            sizeof(T));
+        }
+        std::vector<T> elements(bytes / sizeof(T));
+        std::memcpy(elements.data(), data(tag), bytes);
+        return elements;
+    }
+
+private:
+    const meshfile::Section &find(const std::string &tag) const;
+};
+
+} // namespace lightwave
@@ -0,0 +1,36 @@
+#include <lightwave/parallel.hpp>
+
+#ifdef LW_OS_WINDOWS
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <ctime>
+#endif
+
+namespace lightwave {
+
+double threadCpuTime() {
+#ifdef LW_OS_WINDOWS
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetThreadTimes(GetCurrentThread(),
+                        &creationTime,
+                        &exitTime,
+                        &kernelTime,
+                        &userTime))
+        return 0;
+
+    const auto toTicks = [](const FILETIME &time) {
+        return (uint64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    };
+    // FILETIME is measured in units of 100 nanoseconds
+    return (toTicks(kernelTime) + toTicks(userTime)) * 1e-7;
+#else
+    timespec time;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+        return 0;
+    return double(time.tv_sec) + double(time.tv_nsec) * 1e-9;
+#endif
+}
+
+} // namespace lightwave
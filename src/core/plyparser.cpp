@@ -1,8 +1,16 @@
 #include "plyparser.hpp"
+#include "mappedfile.hpp"
+#include <lightwave/iterators.hpp>
 #include <lightwave/logger.hpp>
+#include <lightwave/parallel.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <charconv>
 #include <climits>
-#include <fstream>
+#include <cstring>
+#include <numeric>
+#include <sstream>
 
 namespace lightwave {
 
@@ -23,6 +31,101 @@ template <typename T> inline T swap_endian(T u) {
     return dest.u;
 }
 
+/// @brief The scalar types that properties of PLY files can have.
+enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float, Double };
+
+/// @brief Parses the name of a scalar type, returns false if it is unknown.
+static bool parseType(const std::string &name, PlyType &type) {
+    static const std::pair<const char *, PlyType> types[] = {
+        { "char", PlyType::Int8 },     { "int8", PlyType::Int8 },
+        { "uchar", PlyType::UInt8 },   { "uint8", PlyType::UInt8 },
+        { "uint8_t", PlyType::UInt8 }, { "short", PlyType::Int16 },
+        { "int16", PlyType::Int16 },   { "ushort", PlyType::UInt16 },
+        { "uint16", PlyType::UInt16 }, { "int", PlyType::Int32 },
+        { "int32", PlyType::Int32 },   { "uint", PlyType::UInt32 },
+        { "uint32", PlyType::UInt32 }, { "float", PlyType::Float },
+        { "float32", PlyType::Float }, { "double", PlyType::Double },
+        { "float64", PlyType::Double },
+    };
+    for (const auto &[typeName, value] : types) {
+        if (name == typeName) {
+            type = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// @brief Returns the size of a scalar type in binary PLY files.
+static size_t typeSize(PlyType type) {
+    switch (type) {
+    case PlyType::Int8:
+    case PlyType::UInt8:
+        return 1;
+    case PlyType::Int16:
+    case PlyType::UInt16:
+        return 2;
+    case PlyType::Double:
+        return 8;
+    default:
+        return 4;
+    }
+}
+
+/// @brief Reads a value of type @c T from unaligned memory.
+template <typename T> static T load(const uint8_t *data, bool swap) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return swap ? swap_endian<T>(value) : value;
+}
+
+/// @brief Returns whether values of a type are floating point numbers.
+static bool isFloatingPoint(PlyType type) {
+    return type == PlyType::Float || type == PlyType::Double;
+}
+
+/// @brief Reads a value of the given type from unaligned memory, converted to
+/// @c T .
+template <typename T>
+static T loadAs(const uint8_t *data, PlyType type, bool swap) {
+    switch (type) {
+    case PlyType::Int8:
+        return T(load<int8_t>(data, swap));
+    case PlyType::UInt8:
+        return T(load<uint8_t>(data, swap));
+    case PlyType::Int16:
+        return T(load<int16_t>(data, swap));
+    case PlyType::UInt16:
+        return T(load<uint16_t>(data, swap));
+    case PlyType::Int32:
+        return T(load<int32_t>(data, swap));
+    case PlyType::UInt32:
+        return T(load<uint32_t>(data, swap));
+    case PlyType::Float:
+        return T(load<float>(data, swap));
+    default:
+        return T(load<double>(data, swap));
+    }
+}
+
+/// @brief A property of an element as declared in the header.
+struct PlyProperty {
+    std::string name;
+    /// @brief The type of the value, or of the items for list properties.
+    PlyType type;
+    /// @brief Whether this is a list, whose length precedes its items.
+    bool isList = false;
+    /// @brief The type of the length of a list.
+    PlyType countType;
+};
+
+/// @brief An element (e.g., vertex or face) as declared in the header.
+struct PlyElement {
+    std::string name;
+    int count = 0;
+    std::vector<PlyProperty> properties;
+};
+
 struct Header {
     int VertexCount       = 0;
     int FaceCount         = 0;
@@ -34,11 +137,14 @@ struct Header {
     int NZElem            = -1;
     int UElem             = -1;
     int VElem             = -1;
-    int VertexPropCount   = 0;
     int IndElem           = -1;
     int MatElem           = -1;
     bool SwitchEndianness = false;
     bool IsAscii          = false;
+    /// @brief The elements in the order their data appears in the file.
+    std::vector<PlyElement> Elements;
+    /// @brief The offset of the data following the header within the file.
+    size_t ContentOffset = 0;
 
     [[nodiscard]] inline bool hasVertices() const {
         return XElem >= 0 && YElem >= 0 && ZElem >= 0;
@@ -53,251 +159,764 @@ struct Header {
     [[nodiscard]] inline bool hasMaterials() const { return MatElem >= 0; }
 };
 
-static void readPlyContent(std::istream &stream, const Header &header,
-                           std::vector<Vector3i> &indices,
-                           std::vector<Vertex> &vertices) {
-    const auto readFloat = [&]() {
-        float val = 0;
-        stream.read(reinterpret_cast<char *>(&val), sizeof(val));
-        if (header.SwitchEndianness)
-            val = swap_endian<float>(val);
-        return val;
-    };
+/// @brief The vertex attributes that are read from PLY files.
+enum VertexAttribute { X, Y, Z, NX, NY, NZ, U, V, AttributeCount };
 
-    const auto readIdx = [&]() {
-        uint32_t val = 0;
-        stream.read(reinterpret_cast<char *>(&val), sizeof(val));
-        if (header.SwitchEndianness)
-            val = swap_endian<uint32_t>(val);
-        return val;
+/// @brief Maps the name of a vertex property to the attribute it stores, or
+/// returns -1 if the property is not needed.
+static int vertexAttribute(const std::string &name) {
+    static const char *attributeNames[][2] = {
+        { "x", "x" },   { "y", "y" },   { "z", "z" }, { "nx", "nx" },
+        { "ny", "ny" }, { "nz", "nz" }, { "u", "s" }, { "v", "t" },
     };
+    for (int a = 0; a < AttributeCount; a++) {
+        if (name == attributeNames[a][0] || name == attributeNames[a][1])
+            return a;
+    }
+    return -1;
+}
+
+/// @brief Assembles a vertex from the values of its attributes.
+static void assignVertex(Vertex &vertex, const float values[AttributeCount]) {
+    vertex.position = { values[X], values[Y], values[Z] };
+    vertex.normal   = Vector(values[NX], values[NY], values[NZ]).normalized();
+    vertex.uv       = Vector2(values[U], values[V]);
+}
 
-    vertices.reserve(header.VertexCount);
-    if (!header.hasNormals())
-        lightwave_throw("no normals found");
+/// @brief Throws if fewer than @c needed bytes are left after @c offset .
+static void checkAvailable(size_t offset, size_t needed, size_t size,
+                           const std::string &element) {
+    if (offset > size || needed > size - offset) {
+        lightwave_throw("file is truncated (%s data ends after %d bytes, "
+                        "but the file only has %d bytes)",
+                        element,
+                        offset + needed,
+                        size);
+    }
+}
+
+/// @brief Returns the size of records of an element, or 0 if the size
+/// varies since the element has list properties.
+static size_t fixedRecordSize(const PlyElement &element) {
+    size_t stride = 0;
+    for (const PlyProperty &property : element.properties) {
+        if (property.isList)
+            return 0;
+        stride += typeSize(property.type);
+    }
+    return stride;
+}
 
-    for (int i = 0; i < header.VertexCount; ++i) {
-        float x = 0, y = 0, z = 0;
-        float nx = 0, ny = 0, nz = 0;
-        float u = 0, v = 0;
+/**
+ * @brief Returns the offset past a record that starts at @c offset , which
+ * requires reading the lengths of its lists. If @c listProperty is given,
+ * the location and length of that list are reported.
+ */
+static size_t skipRecord(const uint8_t *data, size_t size, size_t offset,
+                         const PlyElement &element, bool swap,
+                         int listProperty = -1, size_t *list = nullptr,
+                         int64_t *listLength = nullptr) {
+    for (size_t i = 0; i < element.properties.size(); i++) {
+        const PlyProperty &property = element.properties[i];
+        if (!property.isList) {
+            offset += typeSize(property.type);
+            continue;
+        }
 
-        if (header.IsAscii) {
-            std::string line;
-            if (!std::getline(stream, line))
-                lightwave_throw("not enough vertices given");
-
-            std::stringstream sstream(line);
-            int elem = 0;
-            while (sstream) {
-                float val = 0;
-                sstream >> val;
-
-                if (header.XElem == elem)
-                    x = val;
-                else if (header.YElem == elem)
-                    y = val;
-                else if (header.ZElem == elem)
-                    z = val;
-                else if (header.NXElem == elem)
-                    nx = val;
-                else if (header.NYElem == elem)
-                    ny = val;
-                else if (header.NZElem == elem)
-                    nz = val;
-                else if (header.UElem == elem)
-                    u = val;
-                else if (header.VElem == elem)
-                    v = val;
-
-                elem++;
+        checkAvailable(
+            offset, typeSize(property.countType), size, element.name);
+        const auto length =
+            loadAs<int64_t>(data + offset, property.countType, swap);
+        if (length < 0)
+            lightwave_throw("list of %s has negative length", element.name);
+        offset += typeSize(property.countType);
+        if (int(i) == listProperty) {
+            *list       = offset;
+            *listLength = length;
+        }
+        offset += size_t(length) * typeSize(property.type);
+    }
+    checkAvailable(offset, 0, size, element.name);
+    return offset;
+}
+
+/// @brief Returns the offset past all records of an element that is not
+/// needed.
+static size_t skipElement(const uint8_t *data, size_t size, size_t offset,
+                          const PlyElement &element, bool swap) {
+    if (const size_t stride = fixedRecordSize(element)) {
+        checkAvailable(offset, element.count * stride, size, element.name);
+        return offset + element.count * stride;
+    }
+    for (int i = 0; i < element.count; i++)
+        offset = skipRecord(data, size, offset, element, swap);
+    return offset;
+}
+
+/// @brief The number of records or triangles processed by each parallel
+/// chunk.
+static constexpr int ChunkSize = 16384;
+
+/// @brief Invokes @c f for chunks of [0, count) in parallel, or directly if
+/// there is only a single chunk, which is not worth starting threads for.
+template <typename F> static void forEachChunk(int count, F f) {
+    if (count <= ChunkSize) {
+        f(Range(0, count));
+        return;
+    }
+    for_each_parallel(ChunkedRange(count, ChunkSize), f);
+}
+
+/**
+ * @brief Decodes the vertex records starting at @c offset in parallel, and
+ * returns the offset past them. Attributes of any scalar type are converted
+ * to float.
+ */
+static size_t readBinaryVertices(const uint8_t *data, size_t size,
+                                 size_t offset, const PlyElement &element,
+                                 bool swap, std::vector<Vertex> &vertices) {
+    // the offset of each attribute within a record, or -1 if it is missing
+    int offsets[AttributeCount];
+    PlyType types[AttributeCount];
+    std::fill(std::begin(offsets), std::end(offsets), -1);
+
+    size_t stride = 0;
+    for (const PlyProperty &property : element.properties) {
+        if (property.isList) {
+            lightwave_throw("cannot read list property %s of vertices",
+                            property.name);
+        }
+        const int attribute = vertexAttribute(property.name);
+        if (attribute >= 0) {
+            offsets[attribute] = int(stride);
+            types[attribute]   = property.type;
+        }
+        stride += typeSize(property.type);
+    }
+    checkAvailable(offset, element.count * stride, size, element.name);
+
+    const uint8_t *records = data + offset;
+    vertices.resize(element.count);
+    forEachChunk(element.count, [&](Range chunk) {
+        for (int i : chunk) {
+            const uint8_t *record = records + i * stride;
+            float values[AttributeCount];
+            for (int a = 0; a < AttributeCount; a++) {
+                values[a] =
+                    offsets[a] >= 0
+                        ? loadAs<float>(record + offsets[a], types[a], swap)
+                        : 0;
             }
-        } else {
-            for (int elem = 0; elem < header.VertexPropCount; ++elem) {
-                float val = readFloat();
-                if (header.XElem == elem)
-                    x = val;
-                else if (header.YElem == elem)
-                    y = val;
-                else if (header.ZElem == elem)
-                    z = val;
-                else if (header.NXElem == elem)
-                    nx = val;
-                else if (header.NYElem == elem)
-                    ny = val;
-                else if (header.NZElem == elem)
-                    nz = val;
-                else if (header.UElem == elem)
-                    u = val;
-                else if (header.VElem == elem)
-                    v = val;
+            assignVertex(vertices[i], values);
+        }
+    });
+    return offset + element.count * stride;
+}
+
+/**
+ * @brief Decodes the face records starting at @c offset , and returns the
+ * offset past them. Polygons are split into fans of triangles, which is
+ * correct for convex polygons.
+ *
+ * As most meshes only consist of triangles, the records are first decoded in
+ * parallel under the assumption that each holds a triangle, which is correct
+ * if every record read this way does. Otherwise, the records are walked one
+ * after another.
+ */
+static size_t readBinaryFaces(const uint8_t *data, size_t size, size_t offset,
+                              const PlyElement &element,
+                              const Header &header, bool swap,
+                              std::vector<Vector3i> &indices) {
+    const PlyProperty &list = element.properties[header.IndElem];
+    const size_t countSize  = typeSize(list.countType);
+    const size_t indexSize  = typeSize(list.type);
+
+    // the size of a triangle record, which is only known if the vertex
+    // indices are the only list
+    size_t listOffset = 0, triangleStride = countSize + 3 * indexSize;
+    for (int i = 0; i < int(element.properties.size()); i++) {
+        const PlyProperty &property = element.properties[i];
+        if (i == header.IndElem)
+            continue;
+        if (property.isList) {
+            triangleStride = 0;
+            break;
+        }
+        triangleStride += typeSize(property.type);
+        if (i < header.IndElem)
+            listOffset += typeSize(property.type);
+    }
+
+    if (triangleStride > 0 && offset <= size &&
+        element.count * triangleStride <= size - offset) {
+        // errors cannot be thrown from the worker threads, so the first
+        // invalid face is remembered instead
+        std::atomic<int> invalidFace = INT_MAX;
+        const auto reportInvalid     = [&](int face) {
+            int current = invalidFace.load();
+            while (face < current &&
+                   !invalidFace.compare_exchange_weak(current, face)) {
+            }
+        };
+
+        const uint8_t *records = data + offset + listOffset;
+        indices.resize(element.count);
+        forEachChunk(element.count, [&](Range chunk) {
+            for (int i : chunk) {
+                const uint8_t *record = records + i * triangleStride;
+                if (loadAs<int64_t>(record, list.countType, swap) != 3) {
+                    reportInvalid(i);
+                    return;
+                }
+                for (int elem = 0; elem < 3; elem++) {
+                    const auto index = loadAs<int64_t>(
+                        record + countSize + elem * indexSize, list.type, swap);
+                    if (index < 0 || index >= header.VertexCount) {
+                        reportInvalid(i);
+                        return;
+                    }
+                    indices[i][elem] = int(index);
+                }
+            }
+        });
+
+        if (invalidFace == INT_MAX)
+            return offset + element.count * triangleStride;
+
+        // all faces before the invalid one are triangles, so its record was
+        // read from the right location
+        const int face = invalidFace;
+        if (loadAs<int64_t>(records + face * triangleStride,
+                            list.countType,
+                            swap) == 3) {
+            lightwave_throw("face %d references a vertex that does not exist",
+                            face);
+        }
+    }
+
+    indices.clear();
+    indices.reserve(element.count);
+    for (int face = 0; face < element.count; face++) {
+        size_t first;
+        int64_t length;
+        offset = skipRecord(
+            data, size, offset, element, swap, header.IndElem, &first, &length);
+        if (length < 3) {
+            lightwave_throw("face %d has only %d vertices", face, length);
+        }
+
+        int polygon[3];
+        for (int64_t elem = 0; elem < length; elem++) {
+            const auto index = loadAs<int64_t>(
+                data + first + elem * indexSize, list.type, swap);
+            if (index < 0 || index >= header.VertexCount) {
+                lightwave_throw(
+                    "face %d references a vertex that does not exist", face);
+            }
+            polygon[std::min(elem, int64_t(2))] = int(index);
+            if (elem >= 2) {
+                indices.emplace_back(polygon[0], polygon[1], polygon[2]);
+                polygon[1] = polygon[2];
             }
         }
+    }
+    return offset;
+}
+
+/**
+ * @brief Decodes the vertices and faces of a binary PLY file straight from
+ * the mapped file, where the records of each are decoded in parallel.
+ */
+static void readBinaryContent(const uint8_t *data, size_t size,
+                              const Header &header,
+                              std::vector<Vector3i> &indices,
+                              std::vector<Vertex> &vertices) {
+    const bool swap = header.SwitchEndianness;
+
+    size_t offset    = header.ContentOffset;
+    bool hasVertices = false;
+    bool hasFaces    = false;
+    for (const PlyElement &element : header.Elements) {
+        if (hasVertices && hasFaces)
+            break; // the remaining elements are not needed
+
+        if (element.name == "vertex") {
+            offset = readBinaryVertices(
+                data, size, offset, element, swap, vertices);
+            hasVertices = true;
+        } else if (element.name == "face") {
+            offset = readBinaryFaces(
+                data, size, offset, element, header, swap, indices);
+            hasFaces = true;
+        } else {
+            offset = skipElement(data, size, offset, element, swap);
+        }
+    }
+}
+
+/// @brief Parses the whitespace separated values of one line of an ASCII
+/// PLY file.
+class LineParser {
+public:
+    LineParser(const char *begin, const char *end) : m_cur(begin), m_end(end) {}
+
+    /// @brief Parses the next value, returns false if there is none or if it
+    /// is malformed.
+    template <typename T> bool next(T &value) {
+        while (m_cur < m_end &&
+               (*m_cur == ' ' || *m_cur == '\t' || *m_cur == '\r'))
+            m_cur++;
+        const auto [ptr, ec] = std::from_chars(m_cur, m_end, value);
+        if (ec != std::errc() || ptr == m_cur)
+            return false;
+        m_cur = ptr;
+        return true;
+    }
+
+private:
+    const char *m_cur;
+    const char *m_end;
+};
+
+/// @brief The first error encountered while parsing a chunk of an ASCII file.
+struct AsciiError {
+    /// @brief The line of the error, counted from the start of the file.
+    size_t line = SIZE_MAX;
+    std::string message;
+};
+
+/// @brief A triangle of a polygon beyond its first, which is inserted after
+/// the first triangle of its face once all faces have been parsed.
+struct ExtraTriangle {
+    int face;
+    Vector3i triangle;
+};
 
-        Vertex vertex;
-        vertex.position = { x, y, z };
-        vertex.normal   = Vector(nx, ny, nz).normalized();
-        vertex.uv       = Vector2(u, v);
-        vertices.push_back(vertex);
+/// @brief Inserts the additional triangles of polygons (sorted by face) after
+/// the first triangle of their face.
+static void insertTriangles(std::vector<Vector3i> &indices,
+                            const std::vector<ExtraTriangle> &extra) {
+    if (extra.empty())
+        return;
+
+    std::vector<Vector3i> result;
+    result.reserve(indices.size() + extra.size());
+    size_t next = 0;
+    for (size_t face = 0; face < indices.size(); face++) {
+        result.push_back(indices[face]);
+        while (next < extra.size() && extra[next].face == int(face))
+            result.push_back(extra[next++].triangle);
     }
+    indices = std::move(result);
+}
 
-    if (vertices.empty())
-        lightwave_throw("no vertices found");
+/**
+ * @brief Parses the vertices and faces of an ASCII PLY file in parallel.
+ * The content is split into line-aligned chunks, whose lines are counted first
+ * so that every chunk knows which records it holds, and then each chunk is
+ * parsed straight into the preallocated arrays. The first triangle of every
+ * face is stored in place, while further triangles of polygons are collected
+ * per chunk and inserted afterwards.
+ */
+static void readAsciiContent(const uint8_t *data, size_t size,
+                             const Header &header,
+                             std::vector<Vector3i> &indices,
+                             std::vector<Vertex> &vertices) {
+    constexpr size_t ChunkSize = 1 << 20;
+
+    const char *text  = reinterpret_cast<const char *>(data);
+    const char *begin = text + header.ContentOffset;
+    const char *end   = text + size;
+    const size_t headerLines =
+        std::count(text, begin, '\n'); // lines before the first record
+
+    // split the content into chunks that start at the beginning of a line
+    std::vector<const char *> boundaries = { begin };
+    while (size_t(end - boundaries.back()) > ChunkSize) {
+        const char *split   = boundaries.back() + ChunkSize;
+        const void *newline = std::memchr(split, '\n', size_t(end - split));
+        if (!newline)
+            break;
+        boundaries.push_back(static_cast<const char *>(newline) + 1);
+    }
+    boundaries.push_back(end);
+    const int chunkCount = int(boundaries.size()) - 1;
+
+    // the index of the first record in each chunk
+    std::vector<size_t> firstRecord(chunkCount + 1, 0);
+    for_each_parallel(Range(0, chunkCount), [&](int chunk) {
+        firstRecord[chunk + 1] =
+            std::count(boundaries[chunk], boundaries[chunk + 1], '\n');
+    });
+    for (int chunk = 0; chunk < chunkCount; chunk++)
+        firstRecord[chunk + 1] += firstRecord[chunk];
+    size_t recordCount = firstRecord[chunkCount];
+    if (begin < end && end[-1] != '\n')
+        recordCount++; // the last line is not terminated
+
+    // records of elements are stored one per line, in declaration order
+    size_t vertexStart = 0, faceStart = 0, recordOffset = 0;
+    const PlyElement *vertexElement = nullptr, *faceElement = nullptr;
+    int attributes[AttributeCount];
+    std::fill(std::begin(attributes), std::end(attributes), -1);
+    for (const PlyElement &element : header.Elements) {
+        if (element.name == "vertex") {
+            vertexStart   = recordOffset;
+            vertexElement = &element;
+            for (size_t i = 0; i < element.properties.size(); i++) {
+                const PlyProperty &property = element.properties[i];
+                if (property.isList)
+                    lightwave_throw("cannot read list property %s of vertices",
+                                    property.name);
+                const int attribute = vertexAttribute(property.name);
+                if (attribute >= 0)
+                    attributes[attribute] = int(i);
+            }
+        } else if (element.name == "face") {
+            faceStart   = recordOffset;
+            faceElement = &element;
+        }
+        recordOffset += element.count;
+    }
+    if (recordCount < vertexStart + header.VertexCount)
+        lightwave_throw("not enough vertices given");
+    if (recordCount < faceStart + header.FaceCount)
+        lightwave_throw("not enough indices given");
 
+    vertices.resize(header.VertexCount);
     indices.resize(header.FaceCount);
-    size_t indicesIndex = 0;
 
-    if (header.IsAscii) {
-        for (int i = 0; i < header.FaceCount; ++i) {
-            std::string line;
-            if (!std::getline(stream, line))
-                lightwave_throw("not enough indices given");
+    const auto parseVertex = [&](LineParser &parser, Vertex &vertex) {
+        float row[AttributeCount] = {};
+        for (size_t i = 0; i < vertexElement->properties.size(); i++) {
+            float value;
+            if (!parser.next(value))
+                return false;
+            for (int a = 0; a < AttributeCount; a++) {
+                if (attributes[a] == int(i))
+                    row[a] = value;
+            }
+        }
+        assignVertex(vertex, row);
+        return true;
+    };
 
-            std::stringstream sstream(line);
+    const auto parseFace = [&](LineParser &parser, std::vector<int> &polygon,
+                               std::string &error) {
+        polygon.clear();
+        for (size_t i = 0; i < faceElement->properties.size(); i++) {
+            const PlyProperty &property = faceElement->properties[i];
+            double ignored;
+            int64_t length = 1;
+            if (property.isList && (!parser.next(length) || length < 0)) {
+                error = "invalid face";
+                return false;
+            }
+            for (int64_t elem = 0; elem < length; elem++) {
+                if (int(i) != header.IndElem) {
+                    if (!parser.next(ignored)) {
+                        error = "invalid face";
+                        return false;
+                    }
+                    continue;
+                }
 
-            uint32_t elems = 0;
-            sstream >> elems;
-            if (elems != 3)
-                lightwave_throw("only triangles supported");
+                int64_t index;
+                if (!parser.next(index)) {
+                    error = "invalid face";
+                    return false;
+                }
+                if (index < 0 || index >= header.VertexCount) {
+                    error =
+                        tfm::format("vertex index %d is out of range", index);
+                    return false;
+                }
+                polygon.push_back(int(index));
+            }
+        }
+        if (polygon.size() < 3) {
+            error = tfm::format("face has only %d vertices", polygon.size());
+            return false;
+        }
+        return true;
+    };
 
-            for (uint32_t elem = 0; elem < elems; ++elem) {
-                sstream >> indices[indicesIndex][elem];
+    std::vector<AsciiError> errors(chunkCount);
+    std::vector<std::vector<ExtraTriangle>> extraTriangles(chunkCount);
+    for_each_parallel(Range(0, chunkCount), [&](int chunk) {
+        size_t record    = firstRecord[chunk];
+        const char *line = boundaries[chunk];
+        const char *last = boundaries[chunk + 1];
+        std::vector<int> polygon;
+        while (line < last) {
+            const void *newline = std::memchr(line, '\n', size_t(last - line));
+            const char *lineEnd =
+                newline ? static_cast<const char *>(newline) : last;
+            LineParser parser(line, lineEnd);
+
+            std::string error;
+            if (record - vertexStart < size_t(header.VertexCount)) {
+                if (!parseVertex(parser, vertices[record - vertexStart]))
+                    error = "invalid vertex";
+            } else if (record - faceStart < size_t(header.FaceCount)) {
+                const int face = int(record - faceStart);
+                if (parseFace(parser, polygon, error)) {
+                    indices[face] = { polygon[0], polygon[1], polygon[2] };
+                    for (size_t elem = 3; elem < polygon.size(); elem++) {
+                        const Vector3i triangle = {
+                            polygon[0], polygon[elem - 1], polygon[elem]
+                        };
+                        extraTriangles[chunk].push_back({ face, triangle });
+                    }
+                }
             }
-            indicesIndex++;
+            if (!error.empty()) {
+                errors[chunk] = { headerLines + record + 1, error };
+                return;
+            }
+
+            record++;
+            line = lineEnd + 1;
         }
-    } else {
-        for (int i = 0; i < header.FaceCount; ++i) {
-            uint8_t elems = 0;
-            stream.read(reinterpret_cast<char *>(&elems), sizeof(elems));
-            if (elems != 3)
-                lightwave_throw("only triangles supported");
-
-            for (uint32_t elem = 0; elem < elems; ++elem) {
-                indices[indicesIndex][elem] = readIdx();
+    });
+
+    for (const AsciiError &error : errors) {
+        if (error.line != SIZE_MAX)
+            lightwave_throw("line %d: %s", error.line, error.message);
+    }
+
+    std::vector<ExtraTriangle> extra;
+    for (const auto &chunkTriangles : extraTriangles)
+        extra.insert(extra.end(), chunkTriangles.begin(), chunkTriangles.end());
+    insertTriangles(indices, extra);
+}
+
+/**
+ * @brief Computes smooth normals for meshes without any, by averaging the
+ * normals of the adjacent triangles weighted by their angle at the vertex
+ * (Thürmer and Wüthrich), which unlike weighting by area does not depend on
+ * how the surface around a vertex is triangulated.
+ * @param weld Whether vertices at the same position share their normal.
+ * This hides seams where vertices were split for their texture coordinates,
+ * but also smooths hard edges that were modeled by splitting vertices.
+ */
+static void generateNormals(const std::vector<Vector3i> &indices,
+                            std::vector<Vertex> &vertices, bool weld) {
+    // the weighted normal of every corner of every triangle
+    std::vector<Vector> corners(3 * indices.size());
+    forEachChunk(int(indices.size()), [&](Range chunk) {
+        for (int i : chunk) {
+            const Point p[3] = { vertices[indices[i][0]].position,
+                                 vertices[indices[i][1]].position,
+                                 vertices[indices[i][2]].position };
+            const Vector normal = (p[1] - p[0]).cross(p[2] - p[0]);
+            const float length  = normal.length();
+            for (int corner = 0; corner < 3; corner++) {
+                if (!(length > 0)) {
+                    // degenerate triangles do not contribute
+                    corners[3 * i + corner] = Vector(0);
+                    continue;
+                }
+                const Point &origin = p[corner];
+                const Vector a = (p[(corner + 1) % 3] - origin).normalized();
+                const Vector b = (p[(corner + 2) % 3] - origin).normalized();
+                const float angle = std::acos(clamp(a.dot(b), -1.f, 1.f));
+                corners[3 * i + corner] = normal * (angle / length);
             }
-            indicesIndex++;
+        }
+    });
+
+    // when welding, vertices that have been split (e.g., at texture seams)
+    // are treated as one, so that the seams do not show in the shading
+    std::vector<int> representative(vertices.size());
+    std::iota(representative.begin(), representative.end(), 0);
+    if (weld) {
+        std::vector<int> order(vertices.size());
+        std::iota(order.begin(), order.end(), 0);
+        const auto positionLess = [&](int a, int b) {
+            return vertices[a].position.data() < vertices[b].position.data();
+        };
+        std::sort(order.begin(), order.end(), positionLess);
+        for (size_t i = 1; i < order.size(); i++) {
+            if (!positionLess(order[i - 1], order[i]))
+                representative[order[i]] = representative[order[i - 1]];
         }
     }
 
-    if (indicesIndex != indices.size())
-        lightwave_throw("too few faces (%d found, %d needed)",
-                        indicesIndex,
-                        indices.size());
-
-    if (!header.hasUVs()) {
-        Bounds bbox;
-        for (const Vertex &v : vertices)
-            bbox.extend(v.position);
-
-        for (size_t i = 0; i < vertices.size(); ++i) {
-            auto &v        = vertices.at(i);
-            const Vector d = bbox.diagonal();
-            const Vector t = v.position - bbox.min();
-
-            Vector2 p = Vector2(0);
-            if (d.x() > Epsilon)
-                p.x() = t.x() / d.x();
-            if (d.y() > Epsilon)
-                p.y() = t.y() / d.y();
-            v.uv = p; // Drop the z coordinate
+    // the corners adjacent to each vertex, stored contiguously
+    std::vector<int> firstCorner(vertices.size() + 1, 0);
+    for (const Vector3i &triangle : indices) {
+        for (int corner = 0; corner < 3; corner++)
+            firstCorner[representative[triangle[corner]] + 1]++;
+    }
+    for (size_t v = 0; v < vertices.size(); v++)
+        firstCorner[v + 1] += firstCorner[v];
+    std::vector<int> adjacentCorners(corners.size());
+    std::vector<int> next(firstCorner.begin(), firstCorner.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        for (int corner = 0; corner < 3; corner++) {
+            const int vertex = representative[indices[i][corner]];
+            adjacentCorners[next[vertex]++] = int(3 * i + corner);
         }
     }
+
+    std::vector<Vector> normals(vertices.size());
+    forEachChunk(int(vertices.size()), [&](Range chunk) {
+        for (int v : chunk) {
+            Vector sum(0);
+            for (int k = firstCorner[v]; k < firstCorner[v + 1]; k++)
+                sum += corners[adjacentCorners[k]];
+            // vertices without proper triangles need some valid normal
+            normals[v] = sum.length() > 0 ? sum.normalized() : Vector(0, 0, 1);
+        }
+    });
+    for (size_t v = 0; v < vertices.size(); v++)
+        vertices[v].normal = normals[representative[v]];
 }
 
-static inline bool isAllowedVertIndType(const std::string &str) {
-    return str == "uchar" || str == "int" || str == "uint8_t" || str == "uint";
+/// @brief Assigns texture coordinates to meshes without any, by projecting
+/// the vertices onto the xy-plane of their bounding box.
+static void generateUVs(std::vector<Vertex> &vertices) {
+    Bounds bbox;
+    for (const Vertex &v : vertices)
+        bbox.extend(v.position);
+
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        auto &v        = vertices.at(i);
+        const Vector d = bbox.diagonal();
+        const Vector t = v.position - bbox.min();
+
+        Vector2 p = Vector2(0);
+        if (d.x() > Epsilon)
+            p.x() = t.x() / d.x();
+        if (d.y() > Epsilon)
+            p.y() = t.y() / d.y();
+        v.uv = p; // Drop the z coordinate
+    }
+}
+
+/// @brief Parses the header of a PLY file, which ends with an @c end_header
+/// line.
+static Header readHeader(const uint8_t *data, size_t size) {
+    static const std::string_view terminator = "end_header";
+    const std::string_view contents(reinterpret_cast<const char *>(data),
+                                    size);
+    size_t end = contents.find(terminator);
+    if (end == std::string_view::npos)
+        lightwave_throw("file is not in PLY format");
+    end = contents.find('\n', end);
+    if (end == std::string_view::npos)
+        lightwave_throw("file ends after its header");
+
+    std::istringstream stream(std::string(contents.substr(0, end + 1)));
+
+    std::string magic;
+    stream >> magic;
+    if (magic != "ply")
+        lightwave_throw("file is not in PLY format");
+
+    std::string method;
+    Header header;
+    header.ContentOffset = end + 1;
+
+    for (std::string line; std::getline(stream, line);) {
+        std::stringstream sstream(line);
+
+        std::string action;
+        sstream >> action;
+        if (action == "comment")
+            continue;
+        else if (action == "format") {
+            sstream >> method;
+        } else if (action == "element") {
+            PlyElement element;
+            sstream >> element.name >> element.count;
+            if (element.name == "vertex")
+                header.VertexCount = element.count;
+            else if (element.name == "face")
+                header.FaceCount = element.count;
+            header.Elements.push_back(element);
+        } else if (action == "property") {
+            if (header.Elements.empty())
+                lightwave_throw("property declared before any element");
+
+            PlyElement &element = header.Elements.back();
+            PlyProperty property;
+            std::string type;
+            sstream >> type;
+            if (type == "list") {
+                std::string countType, itemType;
+                sstream >> countType >> itemType >> property.name;
+                property.isList = true;
+                if (!parseType(countType, property.countType) ||
+                    isFloatingPoint(property.countType)) {
+                    lightwave_throw("list lengths must be integers, not %s",
+                                    countType);
+                }
+                if (!parseType(itemType, property.type))
+                    lightwave_throw("unknown property type %s", itemType);
+
+                if (element.name == "face" &&
+                    (property.name == "vertex_indices" ||
+                     property.name == "vertex_index")) {
+                    if (isFloatingPoint(property.type)) {
+                        lightwave_throw("vertex indices must be integers, "
+                                        "not %s",
+                                        itemType);
+                    }
+                    header.IndElem = int(element.properties.size());
+                }
+            } else {
+                if (!parseType(type, property.type))
+                    lightwave_throw("unknown property type %s", type);
+                sstream >> property.name;
+
+                int *attributeElems[] = {
+                    &header.XElem,  &header.YElem,  &header.ZElem,
+                    &header.NXElem, &header.NYElem, &header.NZElem,
+                    &header.UElem,  &header.VElem,
+                };
+                const int attribute = vertexAttribute(property.name);
+                if (element.name == "vertex" && attribute >= 0)
+                    *attributeElems[attribute] = int(element.properties.size());
+            }
+            element.properties.push_back(property);
+        } else if (action == "end_header")
+            break;
+    }
+
+    // Content
+    if (!header.hasVertices() || !header.hasIndices() ||
+        header.VertexCount <= 0 || header.FaceCount <= 0)
+        lightwave_throw("does not contain valid mesh data");
+
+    header.SwitchEndianness = (method == "binary_big_endian");
+    header.IsAscii          = (method == "ascii");
+    return header;
 }
 
 void readPLY(const std::filesystem::path &path, std::vector<Vector3i> &indices,
-             std::vector<Vertex> &vertices) {
+             std::vector<Vertex> &vertices, bool weldNormals) {
     logger(EInfo, "loading mesh %s", path);
     try {
-        std::ifstream stream(path, std::ios::in | std::ios::binary);
-        if (!stream)
-            lightwave_throw("error opening file");
-
-        // Header
-        std::string magic;
-        stream >> magic;
-        if (magic != "ply")
-            lightwave_throw("file is not in PLY format");
-
-        std::string method;
-        Header header;
-
-        int facePropCounter = 0;
-        for (std::string line; std::getline(stream, line);) {
-            std::stringstream sstream(line);
-
-            std::string action;
-            sstream >> action;
-            if (action == "comment")
-                continue;
-            else if (action == "format") {
-                sstream >> method;
-            } else if (action == "element") {
-                std::string type;
-                sstream >> type;
-                if (type == "vertex")
-                    sstream >> header.VertexCount;
-                else if (type == "face")
-                    sstream >> header.FaceCount;
-            } else if (action == "property") {
-                std::string type;
-                sstream >> type;
-                if (type == "float") {
-                    std::string name;
-                    sstream >> name;
-                    if (name == "x")
-                        header.XElem = header.VertexPropCount;
-                    else if (name == "y")
-                        header.YElem = header.VertexPropCount;
-                    else if (name == "z")
-                        header.ZElem = header.VertexPropCount;
-                    else if (name == "nx")
-                        header.NXElem = header.VertexPropCount;
-                    else if (name == "ny")
-                        header.NYElem = header.VertexPropCount;
-                    else if (name == "nz")
-                        header.NZElem = header.VertexPropCount;
-                    else if (name == "u" || name == "s")
-                        header.UElem = header.VertexPropCount;
-                    else if (name == "v" || name == "t")
-                        header.VElem = header.VertexPropCount;
-                    ++header.VertexPropCount;
-                } else if (type == "list") {
-                    ++facePropCounter;
-
-                    std::string countType;
-                    sstream >> countType;
-
-                    std::string indType;
-                    sstream >> indType;
-
-                    std::string name;
-                    sstream >> name;
-                    if (!isAllowedVertIndType(countType)) {
-                        lightwave_throw(
-                            "only 'property list uchar int' is supported");
-                        continue;
-                    }
-
-                    if (name == "vertex_indices" || name == "vertex_index")
-                        header.IndElem = facePropCounter - 1;
-                } else {
-                    lightwave_throw("only float or list properties allowed");
-                }
-            } else if (action == "end_header")
-                break;
+        const MappedFile file(path);
+        const Header header = readHeader(file.data(), file.size());
+        if (header.IsAscii) {
+            readAsciiContent(
+                file.data(), file.size(), header, indices, vertices);
+        } else {
+            readBinaryContent(
+                file.data(), file.size(), header, indices, vertices);
         }
 
-        // Content
-        if (!header.hasVertices() || !header.hasIndices() ||
-            header.VertexCount <= 0 || header.FaceCount <= 0)
-            lightwave_throw("does not contain valid mesh data");
-
-        header.SwitchEndianness = (method == "binary_big_endian");
-        header.IsAscii          = (method == "ascii");
-        readPlyContent(stream, header, indices, vertices);
+        if (!header.hasNormals()) {
+            logger(EInfo,
+                   "generating normals for %d vertices",
+                   vertices.size());
+            generateNormals(indices, vertices, weldNormals);
+        }
+        if (!header.hasUVs())
+            generateUVs(vertices);
     } catch (...) {
         lightwave_throw_nested("while parsing %s", path);
     }
@@ -6,7 +6,13 @@
 
 namespace lightwave {
 
+/**
+ * @brief Reads the triangles and vertices of a PLY file, generating normals
+ * and texture coordinates if the file has none.
+ * @param weldNormals Whether generated normals are shared by vertices at the
+ * same position, which hides texture seams but smooths hard edges.
+ */
 void readPLY(const std::filesystem::path &path, std::vector<Vector3i> &indices,
-             std::vector<Vertex> &vertices);
+             std::vector<Vertex> &vertices, bool weldNormals = false);
 
 }
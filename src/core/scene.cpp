@@ -121,11 +121,24 @@ Intersection Scene::intersect(const Ray &ray, Sampler &rng) const {
     return its;
 }
 
+void Scene::intersect(const RayPacket &packet, Intersection *its) const {
+    PROFILE("Intersect")
+
+    for (int i = 0; i < packet.size; i++)
+        its[i] = Intersection(-packet.rays[i].direction);
+    m_shape->intersectPacket(packet, packet.mask(), its);
+    for (int i = 0; i < packet.size; i++) {
+        if (!its[i]) {
+            its[i].background = m_background.get();
+        }
+        its[i].lightProbability = m_lightSampling->probability(its[i].light());
+    }
+}
+
 bool Scene::intersect(const Ray &ray, float tMax, Sampler &rng) const {
     PROFILE("Shadow ray")
 
-    Intersection its(-ray.direction, tMax * (1 - Epsilon));
-    return m_shape->intersect(ray, its, rng);
+    return m_shape->occluded(ray, tMax, rng);
 }
 
 LightSample Scene::sampleLight(Sampler &rng) const {
@@ -1,51 +1,77 @@
 #include "xml.hpp"
+#include "mappedfile.hpp"
 
-#include <fstream>
+#include <algorithm>
+#include <iterator>
+#include <string_view>
 
 namespace lightwave {
 
+static bool isWhitespace(char chr) {
+    return chr == ' ' || chr == '\n' || chr == '\t' || chr == '\r' ||
+           chr == '\f' || chr == '\v';
+}
+
+static bool isAlpha(char chr) {
+    return (chr >= 'a' && chr <= 'z') || (chr >= 'A' && chr <= 'Z');
+}
+
+static bool isAlnum(char chr) {
+    return isAlpha(chr) || (chr >= '0' && chr <= '9');
+}
+
 XMLParser::XMLParser(Delegate &delegate, std::istream &stream)
-    : m_delegate(delegate), m_stream(&stream) {
-    m_loc.filename = "stream";
-    parse();
+    : m_delegate(delegate), m_filename("stream") {
+    const std::string contents{ std::istreambuf_iterator<char>(stream),
+                                std::istreambuf_iterator<char>() };
+    parse(contents.data(), contents.data() + contents.size());
 }
 
 XMLParser::XMLParser(Delegate &delegate, const std::filesystem::path &path)
-    : m_delegate(delegate) {
-    m_loc.filename = path.string();
-    std::ifstream file{ path };
+    : m_delegate(delegate), m_filename(path.string()) {
     if (!std::filesystem::is_regular_file(path)) {
         lightwave_throw("%s is not a file", path.string());
     }
-    if (!file.is_open()) {
-        lightwave_throw("could not open %s", path.string());
-    }
-    m_stream = &file;
-    parse();
+    const MappedFile file{ path };
+    const char *data = reinterpret_cast<const char *>(file.data());
+    parse(data, data + file.size());
 }
 
-void XMLParser::parse() {
+void XMLParser::parse(const char *begin, const char *end) {
+    m_begin = m_current = m_counted = m_lineStart = begin;
+    m_end                                          = end;
     try {
         while (readNode(""))
             ;
     } catch (...) {
         m_delegate.stop();
-        lightwave_throw_nested("while parsing %s:%d:%d", m_loc.filename,
-                               m_loc.line, m_loc.column);
+        const SourceLocation loc = location(m_current);
+        lightwave_throw_nested(
+            "while parsing %s:%d:%d", loc.filename, loc.line, loc.column);
+    }
+}
+
+XMLParser::SourceLocation XMLParser::location(const char *position) {
+    if (position < m_counted) {
+        m_counted = m_lineStart = m_begin;
+        m_line                  = 1;
+    }
+    for (const char *chr = m_counted; chr < position; chr++) {
+        if (*chr == '\n') {
+            m_line++;
+            m_lineStart = chr + 1;
+        }
     }
+    m_counted = position;
+    return { m_filename, m_line, int(position - m_lineStart) + 1 };
 }
 
-int XMLParser::peek() { return m_stream->peek(); }
+int XMLParser::peek() const {
+    return m_current < m_end ? (unsigned char) *m_current : EOF;
+}
 
 int XMLParser::get() {
-    const int chr = m_stream->get();
-    if (chr == '\n') {
-        m_loc.line++;
-        m_loc.column = 1;
-    } else {
-        m_loc.column++;
-    }
-    return chr;
+    return m_current < m_end ? (unsigned char) *m_current++ : EOF;
 }
 
 void XMLParser::expectToken(char token) {
@@ -58,14 +84,14 @@ void XMLParser::expectToken(char token) {
 std::string XMLParser::readIdentifier() {
     skipWhitespace();
 
-    if (!isalpha(peek())) {
+    if (m_current == m_end || !isAlpha(*m_current)) {
         lightwave_throw("expected identifier");
     }
 
-    std::string identifier = std::string("") + char(get());
-    while (isalnum(peek()))
-        identifier += char(get());
-    return identifier;
+    const char *start = m_current++;
+    while (m_current < m_end && isAlnum(*m_current))
+        m_current++;
+    return std::string(start, m_current);
 }
 
 std::string XMLParser::readString() {
@@ -75,8 +101,13 @@ std::string XMLParser::readString() {
 
     std::string string = "";
     while (true) {
-        int chr = get();
-        switch (chr) {
+        // copy everything up to the next quote or escape sequence at once
+        const char *start = m_current;
+        while (m_current < m_end && *m_current != '"' && *m_current != '\\')
+            m_current++;
+        string.append(start, m_current);
+
+        switch (get()) {
             case '\\':
                 switch (get()) {
                     case 'n':
@@ -94,27 +125,23 @@ std::string XMLParser::readString() {
                 lightwave_throw("expected end of string");
             case '"':
                 return string;
-            default:
-                string += (std::string::value_type) chr;
         }
     }
 }
 
 void XMLParser::readComment() {
-    int dashCount = 0;
-    while (true) {
-        int chr = get();
-        if (chr == '>' && dashCount == 2)
-            return;
-        if (chr == EOF)
-            lightwave_throw("expected end of comment");
-        dashCount = chr == '-' ? dashCount + 1 : 0;
+    const std::string_view rest(m_current, m_end - m_current);
+    const size_t end = rest.find("-->");
+    if (end == std::string_view::npos) {
+        m_current = m_end;
+        lightwave_throw("expected end of comment");
     }
+    m_current += end + 3;
 }
 
 void XMLParser::skipWhitespace() {
-    while (isspace(peek()))
-        get();
+    while (m_current < m_end && isWhitespace(*m_current))
+        m_current++;
 }
 
 bool XMLParser::readNode(std::string enclosingTag) {
@@ -155,7 +182,7 @@ bool XMLParser::readNode(std::string enclosingTag) {
     }
 
     const std::string tag = readIdentifier();
-    m_delegate.open(tag, m_loc);
+    m_delegate.open(tag, location(m_current));
     while (true) {
         skipWhitespace();
 
@@ -27,16 +27,28 @@ public:
 
 private:
     Delegate &m_delegate;
-    std::istream *m_stream;
-    SourceLocation m_loc;
+    std::string m_filename;
+
+    /// @brief The input, which is read as a whole before parsing.
+    const char *m_begin;
+    const char *m_end;
+    /// @brief The next character to be read.
+    const char *m_current;
+
+    /// @brief Lines are only counted when a location is needed, and the
+    /// counting resumes from the last location computed.
+    const char *m_counted;
+    const char *m_lineStart;
+    int m_line = 1;
 
 public:
     XMLParser(Delegate &delegate, std::istream &stream);
     XMLParser(Delegate &delegate, const std::filesystem::path &path);
 
 private:
-    void parse();
-    int peek();
+    void parse(const char *begin, const char *end);
+    SourceLocation location(const char *position);
+    int peek() const;
     int get();
     void expectToken(char token);
     std::string readIdentifier();
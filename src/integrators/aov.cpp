@@ -28,8 +28,10 @@ public:
     }
 
     Color Li(const Ray &ray, Sampler &rng) override {
-        Intersection its = m_scene->intersect(ray, rng);
+        return Li(ray, m_scene->intersect(ray, rng), rng);
+    }
 
+    Color Li(const Ray &ray, const Intersection &its, Sampler &rng) override {
         switch (m_variable) {
         case AovNormals:
             return its ? (Color(its.shadingNormal) + Color(1)) / 2
@@ -9,7 +9,10 @@ public:
 
     Color Li(const Ray &ray, Sampler &rng) override {
         // Scene intersection
-        const Intersection its = m_scene->intersect(ray, rng);
+        return Li(ray, m_scene->intersect(ray, rng), rng);
+    }
+
+    Color Li(const Ray &ray, const Intersection &its, Sampler &rng) override {
         if (!its) {
             return its.evaluateEmission().value;
         }
@@ -25,11 +28,11 @@ public:
 
             const Ray lightRay(its.position, directLight.wi);
 
-            const Intersection lightOcclusionIts =
-                m_scene->intersect(lightRay, rng);
+            // anything that is hit before the light (with a tolerance of
+            // Epsilon) blocks it
             if (directLight.distance >= Epsilon &&
-                (!lightOcclusionIts ||
-                 lightOcclusionIts.t - Epsilon >= directLight.distance)) {
+                !m_scene->intersect(
+                    lightRay, directLight.distance + Epsilon, rng)) {
 
                 const Color fr = its.evaluateBsdf(directLight.wi).value;
 
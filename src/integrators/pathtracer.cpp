@@ -12,11 +12,16 @@ public:
     }
 
     Color Li(const Ray &ray, Sampler &rng) override {
+        return Li(ray, m_scene->intersect(ray, rng), rng);
+    }
+
+    Color Li(const Ray &ray, const Intersection &primaryIts,
+             Sampler &rng) override {
         Color weight   = Color::white();
         Color emission = Color::black();
         Ray currentRay = ray;
 
-        Intersection its = m_scene->intersect(currentRay, rng);
+        Intersection its = primaryIts;
         emission += its.evaluateEmission().value;
 
         for (int i = 0; its && i < m_depth - 1; i++) {
@@ -30,12 +35,11 @@ public:
 
                 const Ray lightRay(its.position, directLight.wi);
 
-                const Intersection lightOcclusionIts =
-                    m_scene->intersect(lightRay, rng);
-
+                // anything that is hit before the light (with a tolerance of
+                // Epsilon) blocks it
                 if (directLight.distance >= Epsilon &&
-                    (!lightOcclusionIts ||
-                     lightOcclusionIts.t - Epsilon >= directLight.distance)) {
+                    !m_scene->intersect(
+                        lightRay, directLight.distance + Epsilon, rng)) {
 
                     const Color fr = its.evaluateBsdf(directLight.wi).value;
 
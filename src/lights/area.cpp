@@ -9,6 +9,7 @@ private:
 public:
     AreaLight(const Properties &properties) : Light(properties) {
         m_instance = properties.getChild<Instance>();
+        m_instance->prepareAreaSampling(m_instance->emission());
     }
 
     DirectLightSample sampleDirect(const Point &origin,
@@ -19,9 +20,13 @@ public:
         const EmissionEval emission =
             m_instance->emission()->evaluate(sample.uv, wiLocal);
         const float distance = wi.length();
+        // converts the pdf from area to solid angle measure
+        const float cosTheta =
+            std::abs(sample.geometryNormal.dot(wi)) / distance;
         return {
             .wi       = wi.normalized(),
-            .weight   = emission.value / (sample.pdf * sqr(distance)),
+            .weight   = emission.value * cosTheta /
+                      (sample.pdf * sqr(distance)),
             .distance = distance,
         };
     }
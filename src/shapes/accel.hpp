@@ -1,10 +1,26 @@
 #pragma once
 
 #include <lightwave/core.hpp>
+#include <lightwave/hash.hpp>
+#include <lightwave/iterators.hpp>
 #include <lightwave/math.hpp>
+#include <lightwave/parallel.hpp>
 #include <lightwave/shape.hpp>
 
+#include "../core/mappedfile.hpp"
+#include "lbvhbuilder.hpp"
+#include "sahbuilder.hpp"
+#include "sbvhbuilder.hpp"
+#include "simd.hpp"
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <fstream>
 #include <numeric>
+#include <optional>
+#include <random>
 
 namespace lightwave {
 
@@ -23,53 +39,54 @@ namespace lightwave {
  * - getCentroid(primitiveIndex)    -- return the centroid of a single child
  * (used for building the BVH)
  *
+ * The BVH is always built as a binary tree, but can be collapsed into a
+ * 4-wide or 8-wide tree for traversal, which is chosen per shape with the
+ * @c bvh property ( @c bvh2 , @c bvh4 or @c bvh8 ). The nodes of wide trees
+ * can further be compressed (using the @c compress property) to reduce memory
+ * usage. Subclasses need to pass their properties to the constructor for
+ * this.
+ *
+ * The binary tree is built with binned SAH by default. Setting the @c builder
+ * property to @c sbvh enables spatial splits, which clip primitives at split
+ * planes and reference them from several leaves if that reduces the overlap
+ * of nodes (which helps for long, thin triangles). The @c splitBudget
+ * property limits the number of additional references, relative to the
+ * number of primitives. Subclasses can override getClippedBoundingBox() to
+ * provide tight bounds for the clipped parts of their primitives. For quick
+ * previews of large meshes, @c lbvh sorts the primitives along a Morton curve
+ * instead, which builds much faster at the cost of tree quality. After the
+ * build, the nodes are reordered for locality according to the @c nodeOrder
+ * property ( @c depthfirst by default, @c treelets or @c build ). Nodes with
+ * at most @c leafSize primitives (2 by default) are not split any further.
+ *
+ * Leaves reference their primitives through m_primitiveIndices. Subclasses
+ * that override permutePrimitives() can instead store their primitives in
+ * leaf order if the @c reorderPrimitives property is set, which saves this
+ * lookup during traversal.
+ *
+ * When primitives move (e.g., for animations), refitAccelerationStructure()
+ * updates the bounds of the nodes instead of building the BVH from scratch,
+ * and only rebuilds subtrees whose quality has degraded by more than the
+ * @c rebuildThreshold property. This requires the binary tree, which wide
+ * BVHs only keep if the @c dynamic property is set.
+ *
+ * Setting the @c statistics property logs the SAH cost, leaf size and depth
+ * histograms, the overlap of sibling nodes and the memory usage of the BVH
+ * after every build. The @c statisticsFile property names a CSV file that
+ * receives the bounds and primitive ranges of all nodes for offline analysis.
+ *
+ * Subclasses that derive from StaticAccelerationStructure instead have their
+ * per-primitive methods called without virtual dispatch.
+ *
  * @example For a simple example of how to use this class, look at @ref
  * shapes/group.cpp
  * @see Group
  * @see TriangleMesh
  */
 class AccelerationStructure : public Shape {
-    /// @brief The datatype used to index BVH nodes and the primitive index
-    /// remapping.
-    typedef int32_t NodeIndex;
-
-    /// @brief A node in our binary BVH tree.
-    struct Node {
-        /// @brief The axis aligned bounding box of this node.
-        Bounds aabb;
-        /**
-         * @brief Either the index of the left child node in m_nodes (for
-         * internal nodes), or the first primitive in m_primitiveIndices
-         * (for leaf nodes).
-         * @note For efficiency, we store the BVH nodes so that the right
-         * child always directly follows the left child, i.e., the index of
-         * the right child is always @code leftFirst + 1 @endcode .
-         * @note For efficiency, we store primitives so that children of a
-         * leaf node are always contigous in m_primitiveIndices.
-         */
-        NodeIndex leftFirst;
-        /// @brief The number of primitives in a leaf node, or 0 to indicate
-        /// that this node is not a leaf node.
-        NodeIndex primitiveCount;
-
-        /// @brief Whether this BVH node is a leaf node.
-        bool isLeaf() const { return primitiveCount != 0; }
-
-        /// @brief For internal nodes: The index of the left child node in
-        /// m_nodes.
-        NodeIndex leftChildIndex() const { return leftFirst; }
-        /// @brief For internal nodes: The index of the right child node in
-        /// m_nodes.
-        NodeIndex rightChildIndex() const { return leftFirst + 1; }
-
-        /// @brief For leaf nodes: The first index in m_primitiveIndices.
-        NodeIndex firstPrimitiveIndex() const { return leftFirst; }
-        /// @brief For leaf nodes: The last index in m_primitiveIndices
-        /// (still included).
-        NodeIndex lastPrimitiveIndex() const {
-            return leftFirst + primitiveCount - 1;
-        }
-    };
+    typedef bvh::NodeIndex NodeIndex;
+    typedef bvh::Node Node;
+    typedef bvh::BuildContext BuildContext;
 
     /// @brief A list of all BVH nodes.
     std::vector<Node> m_nodes;
@@ -84,6 +101,10 @@ class AccelerationStructure : public Shape {
      * user of this class expects.
      */
     std::vector<int> m_primitiveIndices;
+    /// @brief Whether the primitives have been permuted into leaf order, in
+    /// which case m_primitiveIndices is the identity (see @ref
+    /// permuteToLeafOrder ).
+    bool m_primitivesInLeafOrder = false;
 
     /// @brief Returns the root BVH node.
     const Node &rootNode() const {
@@ -91,80 +112,282 @@ class AccelerationStructure : public Shape {
         return m_nodes.front();
     }
 
-    struct Bin {
-        Bounds aabb;
-        NodeIndex primitiveCount = 0;
+    /**
+     * @brief A node of a wide BVH, which has up to @c Width children. The
+     * bounding boxes of all children are stored in structure-of-arrays form,
+     * so that a single SIMD slab test can intersect all of them at once.
+     * Leaves are stored directly in their parent node.
+     */
+    template <int Width> struct alignas(64) WideNode {
+        /// @brief The bounding boxes of the children, indexed as @code
+        /// bounds[0 = min, 1 = max][axis][child] @endcode . Unused child slots
+        /// have empty bounding boxes, which can never be hit.
+        float bounds[2][3][Width];
+        /**
+         * @brief Either the index of the child node (for internal children),
+         * or the first primitive in m_primitiveIndices (for leaf children).
+         */
+        NodeIndex child[Width];
+        /// @brief The number of primitives of a leaf child, or 0 to indicate
+        /// that the child is an internal node.
+        NodeIndex primitiveCount[Width];
 
-        inline void add(Bounds bounds) {
-            aabb.extend(bounds);
-            primitiveCount++;
+        WideNode() {
+            for (int i = 0; i < Width; i++) {
+                setChild(i, Bounds::empty(), -1, 0);
+            }
+        }
+
+        /// @brief Sets the bounding box and the reference of a child slot.
+        void setChild(int i, const Bounds &aabb, NodeIndex index,
+                      NodeIndex count) {
+            for (int axis = 0; axis < 3; axis++) {
+                bounds[0][axis][i] = aabb.min()[axis];
+                bounds[1][axis][i] = aabb.max()[axis];
+            }
+            child[i]          = index;
+            primitiveCount[i] = count;
         }
     };
 
     /**
-     * @brief Intersects a BVH node, recursing into children (for internal
-     * nodes), or intersecting all primitives (for leaf nodes).
+     * @brief A compressed version of @ref WideNode . The bounding boxes of
+     * the children are quantized to 8 bits per plane relative to the bounding
+     * box of the node (rounding outwards, so they remain conservative), and
+     * each child reference is packed into a single 32 bit word. A 4-wide node
+     * fits into a single cache line, an 8-wide node into two.
      */
-    bool intersectNode(const Node &node, const Ray &ray, Intersection &its,
-                       Sampler &rng) const {
-        // update the statistic tracking how many BVH nodes have been tested
-        // for intersection
-        its.stats.bvhCounter++;
+    template <int Width> struct alignas(64) CompressedNode {
+        /// @brief Marks a child reference as a leaf.
+        static constexpr uint32_t LeafFlag = 1u << 31;
+        /// @brief The number of bits used to store the first primitive of a
+        /// leaf, the remaining bits store the primitive count minus one.
+        static constexpr int LeafIndexBits = 27;
+        /// @brief The maximum number of primitives of a leaf child.
+        static constexpr NodeIndex MaxLeafSize = 1 << (31 - LeafIndexBits);
+        /// @brief Marks an unused child slot.
+        static constexpr uint32_t EmptyChild = ~0u;
 
-        bool wasIntersected = false;
-        if (node.isLeaf()) {
-            for (NodeIndex i = 0; i < node.primitiveCount; i++) {
-                // update the statistic tracking how many children have been
-                // tested for intersection
-                its.stats.primCounter++;
-                // test the child for intersection
-                wasIntersected |= intersect(
-                    m_primitiveIndices[node.leftFirst + i], ray, its, rng);
+        /// @brief The minimum corner of the bounding box of this node.
+        float origin[3];
+        /// @brief The size of one quantization step for each axis (always a
+        /// power of two).
+        float scale[3];
+        /// @brief The quantized bounding boxes of the children, indexed as
+        /// @code bounds[0 = min, 1 = max][axis][child] @endcode .
+        uint8_t bounds[2][3][Width];
+        /// @brief The packed child references, i.e., either the index of a
+        /// child node, or @ref LeafFlag combined with the first primitive and
+        /// primitive count of a leaf.
+        uint32_t child[Width];
+
+        static uint32_t packLeaf(NodeIndex first, NodeIndex count) {
+            return LeafFlag | (uint32_t(count - 1) << LeafIndexBits) |
+                   uint32_t(first);
+        }
+        static bool isLeaf(uint32_t ref) { return ref & LeafFlag; }
+        static NodeIndex leafFirst(uint32_t ref) {
+            return NodeIndex(ref & ((1u << LeafIndexBits) - 1));
+        }
+        static NodeIndex leafCount(uint32_t ref) {
+            return NodeIndex((ref & ~LeafFlag) >> LeafIndexBits) + 1;
+        }
+
+        /// @brief Sets up the quantization grid to cover the given box.
+        explicit CompressedNode(const Bounds &aabb) {
+            for (int axis = 0; axis < 3; axis++) {
+                origin[axis] = aabb.min()[axis];
+                // the smallest power of two that covers the box in 255 steps
+                const float extent = aabb.max()[axis] - aabb.min()[axis];
+                scale[axis] = extent > 0 ? std::exp2(std::ceil(
+                                               std::log2(extent / 255)))
+                                         : 1;
+                while (dequantize(axis, 255) < aabb.max()[axis])
+                    scale[axis] *= 2;
+            }
+            for (int i = 0; i < Width; i++) {
+                for (int axis = 0; axis < 3; axis++) {
+                    bounds[0][axis][i] = 255;
+                    bounds[1][axis][i] = 0;
+                }
+                child[i] = EmptyChild;
             }
-        } else { // internal node
-            // test which bounding box is intersected first by the ray.
-            // this allows us to traverse the children in the order they are
-            // intersected in, which can help prune a lot of unnecessary
-            // intersection tests.
-            const auto leftT =
-                intersectAABB(m_nodes[node.leftChildIndex()].aabb, ray);
-            const auto rightT =
-                intersectAABB(m_nodes[node.rightChildIndex()].aabb, ray);
-            if (leftT < rightT) { // left child is hit first; test left
-                                  // child first, then right child
-                if (leftT < its.t)
-                    wasIntersected |= intersectNode(
-                        m_nodes[node.leftChildIndex()], ray, its, rng);
-                if (rightT < its.t)
-                    wasIntersected |= intersectNode(
-                        m_nodes[node.rightChildIndex()], ray, its, rng);
-            } else { // right child is hit first; test right child first,
-                     // then left child
-                if (rightT < its.t)
-                    wasIntersected |= intersectNode(
-                        m_nodes[node.rightChildIndex()], ray, its, rng);
-                if (leftT < its.t)
-                    wasIntersected |= intersectNode(
-                        m_nodes[node.leftChildIndex()], ray, its, rng);
+        }
+
+        /// @brief Returns the position of a quantized plane (computed in the
+        /// same way as during traversal).
+        float dequantize(int axis, int q) const {
+            return origin[axis] + float(q) * scale[axis];
+        }
+
+        /// @brief Returns the (conservative) bounding box of a child.
+        Bounds childBounds(int i) const {
+            Point lower, upper;
+            for (int axis = 0; axis < 3; axis++) {
+                lower[axis] = dequantize(axis, bounds[0][axis][i]);
+                upper[axis] = dequantize(axis, bounds[1][axis][i]);
             }
+            return { lower, upper };
         }
-        return wasIntersected;
-    }
+
+        /// @brief Quantizes the bounding box of a child, rounding outwards.
+        void setChild(int i, const Bounds &aabb, uint32_t ref) {
+            for (int axis = 0; axis < 3; axis++) {
+                const float lower =
+                    (aabb.min()[axis] - origin[axis]) / scale[axis];
+                const float upper =
+                    (aabb.max()[axis] - origin[axis]) / scale[axis];
+                int lo = clamp(int(std::floor(lower)), 0, 255);
+                int hi = clamp(int(std::ceil(upper)), 0, 255);
+                // guard against rounding errors
+                while (lo > 0 && dequantize(axis, lo) > aabb.min()[axis])
+                    lo--;
+                while (hi < 255 && dequantize(axis, hi) < aabb.max()[axis])
+                    hi++;
+                bounds[0][axis][i] = uint8_t(lo);
+                bounds[1][axis][i] = uint8_t(hi);
+            }
+            child[i] = ref;
+        }
+    };
+
+    /// @brief The supported branching factors of the BVH.
+    enum class Layout {
+        /// @brief Traverse the binary tree that is built.
+        Binary = 2,
+        /// @brief Collapse the binary tree into a tree with four children
+        /// per node.
+        Wide4 = 4,
+        /// @brief Collapse the binary tree into a tree with eight children
+        /// per node.
+        Wide8 = 8,
+    };
+
+    /// @brief The orders in which the nodes of the binary tree can be stored.
+    enum class NodeOrder {
+        /// @brief Nodes are stored in the order in which they were created.
+        Build,
+        /// @brief Nodes are stored in depth-first order.
+        DepthFirst,
+        /// @brief Small treelets are stored breadth-first, so that the nodes
+        /// visited by a ray after entering a treelet share few cache lines.
+        Treelets,
+    };
+
+    /// @brief The algorithms available to build the binary tree.
+    enum class Builder {
+        /// @brief Binned SAH that partitions the primitives.
+        SAH,
+        /// @brief Binned SAH that can also split space, duplicating
+        /// references to primitives that straddle the split plane.
+        SpatialSplits,
+        /// @brief Sorts the primitives along a Morton curve and splits at the
+        /// highest differing bit, which is much faster but yields worse trees.
+        Linear,
+    };
+
+    /// @brief The branching factor of the BVH used for traversal.
+    Layout m_layout = Layout::Binary;
+    /// @brief The algorithm used to build the binary tree.
+    Builder m_builder = Builder::SAH;
+    /// @brief The order in which the nodes of the binary tree are stored.
+    NodeOrder m_nodeOrder = NodeOrder::DepthFirst;
+    /// @brief The maximum number of references the spatial split builder may
+    /// add, relative to the number of primitives.
+    float m_splitBudget = 0.3f;
+    /// @brief The number of primitives up to which nodes are not split any
+    /// further. Larger leaves suit primitives that are intersected several at
+    /// a time (e.g., with SIMD).
+    NodeIndex m_leafSize = 2;
+    /// @brief Whether wide BVHs keep the binary tree, so that they can be
+    /// refit.
+    bool m_dynamic = false;
+    /// @brief Subtrees are rebuilt during refitting if their SAH cost grows
+    /// by more than this factor compared to when they were built.
+    float m_rebuildThreshold = 1.5f;
+    /// @brief Whether to permute the primitives into leaf order after the
+    /// build (if supported by the subclass).
+    bool m_reorderPrimitives = false;
+    /// @brief Whether to log statistics about the quality and memory usage of
+    /// the BVH after it has been built.
+    bool m_statistics = false;
+    /// @brief The file the nodes of the binary tree are written to for
+    /// offline analysis, or an empty path if they should not be written.
+    std::filesystem::path m_statisticsFile;
+    /**
+     * @brief The SAH cost of every subtree of m_nodes at the time it was
+     * built, relative to the surface area of its root (see @ref
+     * relativeCost ). Only computed once the BVH is refit for the first time.
+     */
+    std::vector<float> m_nodeCosts;
+    /// @brief The nodes of the BVH if the 4-wide layout is used. The root
+    /// node is always the first element.
+    std::vector<WideNode<4>> m_wideNodes4;
+    /// @brief The nodes of the BVH if the 8-wide layout is used. The root
+    /// node is always the first element.
+    std::vector<WideNode<8>> m_wideNodes8;
+    /// @brief The nodes of the BVH if the compressed 4-wide layout is used.
+    std::vector<CompressedNode<4>> m_compressedNodes4;
+    /// @brief The nodes of the BVH if the compressed 8-wide layout is used.
+    std::vector<CompressedNode<8>> m_compressedNodes8;
+    /// @brief Whether the nodes of wide BVHs are compressed.
+    bool m_compress = false;
+    /// @brief The bounding box of all primitives.
+    Bounds m_bounds;
+
+    /// @brief The number of sibling pairs stored in each treelet for @ref
+    /// NodeOrder::Treelets , i.e., three levels of the tree.
+    static constexpr int TreeletPairs = 7;
+    /// @brief Refitting hands subtrees to separate threads up to this depth.
+    static constexpr int ParallelRefitDepth = 6;
+    /// @brief The maximum number of levels added to a compressed BVH to split
+    /// leaves that exceed the maximum leaf size of compressed nodes.
+    static constexpr int CompressedLeafDepth = 16;
+    /// @brief The number of consecutive levels that share a bucket of the
+    /// depth histogram reported by the BVH statistics.
+    static constexpr int DepthBucketSize = 4;
+
+    /**
+     * @brief A ray prepared for BVH traversal, caching quantities that would
+     * otherwise need to be recomputed for every bounding box that is tested.
+     */
+    struct TraversalRay {
+        /// @brief The origin of the ray.
+        Point origin;
+        /// @brief The reciprocal of the ray direction, which turns the
+        /// divisions of the slab test into multiplications.
+        Vector invDirection;
+        /// @brief For each axis, whether the ray direction is negative, i.e.,
+        /// whether the ray enters the slab through its maximum plane.
+        bool isNegative[3];
+
+        explicit TraversalRay(const Ray &ray) : origin(ray.origin) {
+            for (int axis = 0; axis < 3; axis++) {
+                invDirection[axis] = 1 / ray.direction[axis];
+                isNegative[axis]   = invDirection[axis] < 0;
+            }
+        }
+    };
 
     /// @brief Performs a slab test to intersect a bounding box with a ray,
     /// returning Infinity in case the ray misses.
-    float intersectAABB(const Bounds &bounds, const Ray &ray) const {
-        const auto t1 = (bounds.min() - ray.origin) / ray.direction;
-        // intersect all axes at once with the maximum slabs of the bounding
-        // box
-        const auto t2 = (bounds.max() - ray.origin) / ray.direction;
-
-        // the elementwiseMin picks the near slab for each axis, of which we
-        // then take the maximum
-        const auto tNear = elementwiseMin(t1, t2).maxComponent();
-        // the elementwiseMax picks the far slab for each axis, of which we
-        // then take the minimum
-        const auto tFar = elementwiseMax(t1, t2).minComponent();
+    float intersectAABB(const Bounds &bounds, const TraversalRay &ray) const {
+        float tNear = -Infinity;
+        float tFar  = +Infinity;
+        for (int axis = 0; axis < 3; axis++) {
+            // the sign of the direction tells us which slab is entered first,
+            // so no min/max is needed to sort the two distances per axis
+            const Point &nearCorner =
+                ray.isNegative[axis] ? bounds.max() : bounds.min();
+            const Point &farCorner =
+                ray.isNegative[axis] ? bounds.min() : bounds.max();
+            const float t1 = (nearCorner[axis] - ray.origin[axis]) *
+                             ray.invDirection[axis];
+            const float t2 = (farCorner[axis] - ray.origin[axis]) *
+                             ray.invDirection[axis];
+            tNear = max(tNear, t1);
+            tFar  = min(tFar, t2);
+        }
 
         if (tFar < tNear)
             return Infinity; // the ray does not intersect the bounding box
@@ -175,234 +398,1971 @@ class AccelerationStructure : public Shape {
                       // (may also be negative!)
     }
 
-    /// @brief Computes the axis aligned bounding box for a leaf BVH node
-    void computeAABB(Node &node) {
-        node.aabb = Bounds::empty();
-        for (NodeIndex i = 0; i < node.primitiveCount; i++) {
-            const Bounds childAABB =
-                getBoundingBox(m_primitiveIndices[node.leftFirst + i]);
-            node.aabb.extend(childAABB);
+    /**
+     * @brief Traverses the binary BVH front to back, invoking @c
+     * intersectLeaf for every leaf whose bounding box is hit closer than @c
+     * its.t .
+     *
+     * Instead of recursing, the nodes that still need to be visited are kept
+     * on a small fixed-size stack (the build guarantees that the tree is at
+     * most @ref bvh::MaxDepth levels deep).
+     *
+     * @param intersectLeaf Called as @code intersectLeaf(first, count)
+     * @endcode with the range of the leaf in m_primitiveIndices, returning
+     * whether any of its primitives was hit.
+     */
+    template <bool AnyHit, typename LeafFunction>
+    bool traverseBinary(const TraversalRay &traversalRay, Intersection &its,
+                        LeafFunction &&intersectLeaf) const {
+        // test root bounding box for potential hit
+        if (!(intersectAABB(rootNode().aabb, traversalRay) < its.t))
+            return false;
+
+        // a node that still needs to be visited, along with the distance at
+        // which the ray enters its bounding box
+        struct StackEntry {
+            const Node *node;
+            float tNear;
+        } stack[bvh::MaxDepth];
+        int stackSize = 0;
+
+        bool wasIntersected = false;
+        const Node *node    = &rootNode();
+        while (true) {
+            // update the statistic tracking how many BVH nodes have been
+            // tested for intersection
+            its.stats.bvhCounter++;
+
+            if (node->isLeaf()) {
+                if (intersectLeaf(node->firstPrimitiveIndex(),
+                                  node->primitiveCount)) {
+                    if constexpr (AnyHit)
+                        return true;
+                    wasIntersected = true;
+                }
+            } else { // internal node
+                // test which bounding box is intersected first by the ray.
+                // this allows us to traverse the children in the order they
+                // are intersected in, which can help prune a lot of
+                // unnecessary intersection tests.
+                const Node *nearChild = &m_nodes[node->leftChildIndex()];
+                const Node *farChild  = &m_nodes[node->rightChildIndex()];
+                float nearT = intersectAABB(nearChild->aabb, traversalRay);
+                float farT  = intersectAABB(farChild->aabb, traversalRay);
+                if (!(nearT < farT)) {
+                    std::swap(nearChild, farChild);
+                    std::swap(nearT, farT);
+                }
+
+                // the far child is visited after the near child, at which
+                // point we might already have found a closer hit
+                if (farT < its.t)
+                    stack[stackSize++] = { farChild, farT };
+                if (nearT < its.t) {
+                    node = nearChild;
+                    continue;
+                }
+            }
+
+            // continue with the next node on the stack that can still
+            // contain a closer hit
+            do {
+                if (stackSize == 0)
+                    return wasIntersected;
+                stackSize--;
+            } while (!(stack[stackSize].tNear < its.t));
+            node = stack[stackSize].node;
         }
     }
 
-    /// @brief Computes the surface area of a bounding box.
-    float surfaceArea(const Bounds &bounds) const {
-        const auto size = bounds.diagonal();
-        return 2 * (size.x() * size.y() + size.x() * size.z() +
-                    size.y() * size.z());
+    /**
+     * @brief Intersects the bounding boxes of all children of a wide node
+     * with the ray, returning a bitmask of the children that are hit closer
+     * than @c tMax . The entry distances are written to @c tNear .
+     */
+    template <int Width>
+    static int intersectChildren(const WideNode<Width> &node,
+                                 const TraversalRay &ray, float tMax,
+                                 float *tNear) {
+        using Float = simd::Float<Width>;
+        Float nearT = Float::broadcast(-Infinity);
+        Float farT  = Float::broadcast(+Infinity);
+        for (int axis = 0; axis < 3; axis++) {
+            // the sign of the direction tells us which slab is entered first
+            const Float origin       = Float::broadcast(ray.origin[axis]);
+            const Float invDirection = Float::broadcast(ray.invDirection[axis]);
+            const int nearSide       = ray.isNegative[axis] ? 1 : 0;
+            nearT = max(nearT,
+                        (Float::load(node.bounds[nearSide][axis]) - origin) *
+                            invDirection);
+            farT = min(farT,
+                       (Float::load(node.bounds[1 - nearSide][axis]) - origin) *
+                           invDirection);
+        }
+
+        nearT.store(tNear);
+        // same conditions as in the scalar intersectAABB, plus the test
+        // whether the box could contain a closer hit
+        return lessEqual(nearT, farT) &
+               lessEqual(Float::broadcast(Epsilon), farT) &
+               lessThan(nearT, Float::broadcast(tMax));
     }
 
     /**
-     * For a given node, computes split axis and split position that
-     * minimize the surface area heuristic.
-     * @param node The BVH node to compute the split for.
-     * @param out bestSplitAxis The optimal split axis, or -1 if no useful
-     * split exists
-     * @param out bestSplitPosition The optimal split position, undefined if
-     * no useful split exists
+     * @brief Traverses a wide BVH front to back, invoking @c intersectLeaf
+     * for every leaf whose bounding box is hit closer than @c its.t .
+     * @see traverseBinary
      */
-    void binning(const Node &node, int &bestSplitAxis,
-                 float &bestSplitPosition) {
-        static constexpr NodeIndex binCount = 16;
+    template <bool AnyHit, int Width, typename LeafFunction>
+    bool traverseWide(const std::vector<WideNode<Width>> &nodes,
+                      const TraversalRay &traversalRay, Intersection &its,
+                      LeafFunction &&intersectLeaf) const {
+        // an internal node (primitiveCount = 0) or leaf that still needs to
+        // be visited, along with the distance at which the ray enters its
+        // bounding box. every level of the tree adds at most Width - 1
+        // entries to the stack.
+        struct StackEntry {
+            NodeIndex index;
+            NodeIndex primitiveCount;
+            float tNear;
+        } stack[bvh::MaxDepth * (Width - 1) + 1];
+        int stackSize = 0;
 
-        // find smallest box that contains all centroids
-        Bounds centroidBounds;
-        for (int i = node.firstPrimitiveIndex(); i <= node.lastPrimitiveIndex();
-             i++) {
-            centroidBounds.extend(getCentroid(m_primitiveIndices[i]));
-        }
+        bool wasIntersected = false;
+        stack[stackSize++]  = { 0, 0, -Infinity };
+        while (stackSize > 0) {
+            const StackEntry entry = stack[--stackSize];
+            if (!(entry.tNear < its.t))
+                continue; // a closer hit has been found in the meantime
+
+            if (entry.primitiveCount > 0) {
+                if (intersectLeaf(entry.index, entry.primitiveCount)) {
+                    if constexpr (AnyHit)
+                        return true;
+                    wasIntersected = true;
+                }
+                continue;
+            }
+
+            // update the statistic tracking how many BVH nodes have been
+            // tested for intersection
+            its.stats.bvhCounter++;
+
+            const WideNode<Width> &node = nodes[entry.index];
+            float tNear[Width];
+            int hitMask =
+                intersectChildren(node, traversalRay, its.t, tNear);
 
-        float lowestSAH = surfaceArea(node.aabb) * node.primitiveCount;
-        bestSplitAxis   = -1;
+            // push the children that were hit sorted by decreasing
+            // distance, so that the closest child is visited next
+            const int first = stackSize;
+            while (hitMask) {
+                const int i = simd::firstBit(hitMask);
+                hitMask &= hitMask - 1;
 
+                int j = stackSize++;
+                // the order does not matter if any hit will do
+                while (!AnyHit && j > first && stack[j - 1].tNear < tNear[i]) {
+                    stack[j] = stack[j - 1];
+                    j--;
+                }
+                stack[j] = { node.child[i], node.primitiveCount[i], tNear[i] };
+            }
+        }
+        return wasIntersected;
+    }
+
+    /**
+     * @brief Intersects the quantized bounding boxes of all children of a
+     * compressed node with the ray.
+     * @see intersectChildren
+     */
+    template <int Width>
+    static int intersectChildren(const CompressedNode<Width> &node,
+                                 const TraversalRay &ray, float tMax,
+                                 float *tNear) {
+        using Float = simd::Float<Width>;
+        Float nearT = Float::broadcast(-Infinity);
+        Float farT  = Float::broadcast(+Infinity);
         for (int axis = 0; axis < 3; axis++) {
+            const Float origin       = Float::broadcast(ray.origin[axis]);
+            const Float invDirection = Float::broadcast(ray.invDirection[axis]);
+            const Float nodeOrigin   = Float::broadcast(node.origin[axis]);
+            const Float scale        = Float::broadcast(node.scale[axis]);
+            const int nearSide       = ray.isNegative[axis] ? 1 : 0;
+            // dequantize the planes exactly as during the build, so that the
+            // boxes remain conservative
+            const Float nearPlane =
+                nodeOrigin + Float::load(node.bounds[nearSide][axis]) * scale;
+            const Float farPlane =
+                nodeOrigin +
+                Float::load(node.bounds[1 - nearSide][axis]) * scale;
+            nearT = max(nearT, (nearPlane - origin) * invDirection);
+            farT  = min(farT, (farPlane - origin) * invDirection);
+        }
+
+        nearT.store(tNear);
+        return lessEqual(nearT, farT) &
+               lessEqual(Float::broadcast(Epsilon), farT) &
+               lessThan(nearT, Float::broadcast(tMax));
+    }
 
-            const float stepSize = centroidBounds.diagonal()[axis] / binCount;
-            if (stepSize < Epsilon) {
-                // There is no usefull split in this axis (primitives are
-                // aligned on one line parallel to the axis) However, there can
-                // be a usefull split in another axis
+    /**
+     * @brief Traverses a compressed wide BVH front to back.
+     * @see traverseWide
+     */
+    template <bool AnyHit, int Width, typename LeafFunction>
+    bool traverseCompressed(const std::vector<CompressedNode<Width>> &nodes,
+                            const TraversalRay &traversalRay,
+                            Intersection &its,
+                            LeafFunction &&intersectLeaf) const {
+        using CompressedNode = CompressedNode<Width>;
+        // large leaves are split into additional levels during compression,
+        // which adds at most CompressedLeafDepth levels to the tree
+        struct StackEntry {
+            uint32_t ref;
+            float tNear;
+        } stack[(bvh::MaxDepth + CompressedLeafDepth) * (Width - 1) + 1];
+        int stackSize = 0;
+
+        bool wasIntersected = false;
+        stack[stackSize++]  = { 0, -Infinity };
+        while (stackSize > 0) {
+            const StackEntry entry = stack[--stackSize];
+            if (!(entry.tNear < its.t))
+                continue; // a closer hit has been found in the meantime
+
+            if (CompressedNode::isLeaf(entry.ref)) {
+                if (intersectLeaf(CompressedNode::leafFirst(entry.ref),
+                                  CompressedNode::leafCount(entry.ref))) {
+                    if constexpr (AnyHit)
+                        return true;
+                    wasIntersected = true;
+                }
                 continue;
             }
 
-            const float boundsMin = centroidBounds.min()[axis];
+            // update the statistic tracking how many BVH nodes have been
+            // tested for intersection
+            its.stats.bvhCounter++;
 
-            Bin bins[binCount];
+            const CompressedNode &node = nodes[entry.ref];
+            float tNear[Width];
+            int hitMask =
+                intersectChildren(node, traversalRay, its.t, tNear);
 
-            // assign the primitives to bins
-            for (NodeIndex i = node.firstPrimitiveIndex();
-                 i <= node.lastPrimitiveIndex();
-                 i++) {
-                NodeIndex binIdx = clamp(
-                    (NodeIndex) ((getCentroid(m_primitiveIndices[i])[axis] -
-                                  boundsMin) /
-                                 stepSize),
-                    0,
-                    binCount - 1);
-                bins[binIdx].add(getBoundingBox(m_primitiveIndices[i]));
+            const int first = stackSize;
+            while (hitMask) {
+                const int i = simd::firstBit(hitMask);
+                hitMask &= hitMask - 1;
+                if (node.child[i] == CompressedNode::EmptyChild)
+                    continue;
+
+                int j = stackSize++;
+                // the order does not matter if any hit will do
+                while (!AnyHit && j > first && stack[j - 1].tNear < tNear[i]) {
+                    stack[j] = stack[j - 1];
+                    j--;
+                }
+                stack[j] = { node.child[i], tNear[i] };
+            }
+        }
+        return wasIntersected;
+    }
+
+    /**
+     * @brief Traverses the BVH front to back, invoking @c intersectLeaf for
+     * every leaf whose bounding box is hit closer than @c its.t .
+     *
+     * @tparam AnyHit Whether to stop traversal as soon as the first leaf
+     * reports a hit (used for occlusion tests).
+     * @param intersectLeaf Called as @code intersectLeaf(first, count)
+     * @endcode with the range of the leaf in m_primitiveIndices, returning
+     * whether any of its primitives was hit.
+     */
+    template <bool AnyHit = false, typename LeafFunction>
+    bool traverse(const Ray &ray, Intersection &its,
+                  LeafFunction &&intersectLeaf) const {
+        const TraversalRay traversalRay(ray);
+        switch (m_layout) {
+        case Layout::Wide4:
+            if (m_compress)
+                return traverseCompressed<AnyHit>(
+                    m_compressedNodes4, traversalRay, its, intersectLeaf);
+            return traverseWide<AnyHit>(
+                m_wideNodes4, traversalRay, its, intersectLeaf);
+        case Layout::Wide8:
+            if (m_compress)
+                return traverseCompressed<AnyHit>(
+                    m_compressedNodes8, traversalRay, its, intersectLeaf);
+            return traverseWide<AnyHit>(
+                m_wideNodes8, traversalRay, its, intersectLeaf);
+        default:
+            return traverseBinary<AnyHit>(traversalRay, its, intersectLeaf);
+        }
+    }
+
+    /**
+     * @brief A ray packet prepared for BVH traversal, stored in
+     * structure-of-arrays form so that a bounding box can be tested against
+     * groups of @ref PacketGroupSize rays with a single SIMD slab test.
+     */
+    struct TraversalPacket {
+        /// @brief The origins of the rays, indexed as @code origin[axis][ray]
+        /// @endcode .
+        float origin[3][RayPacket::MaxSize];
+        /// @brief The reciprocals of the ray directions.
+        float invDirection[3][RayPacket::MaxSize];
+        /// @brief The distance of the closest hit found so far for every ray,
+        /// or -Infinity for rays that are not traced (so that they never hit
+        /// a bounding box).
+        float tMax[RayPacket::MaxSize];
+
+        TraversalPacket(const RayPacket &packet, int mask,
+                        const Intersection *its) {
+            for (int i = 0; i < RayPacket::MaxSize; i++) {
+                const bool active = i < packet.size && (mask >> i & 1);
+                for (int axis = 0; axis < 3; axis++) {
+                    origin[axis][i] =
+                        active ? packet.rays[i].origin[axis] : 0;
+                    invDirection[axis][i] =
+                        active ? 1 / packet.rays[i].direction[axis] : 0;
+                }
+                tMax[i] = active ? its[i].t : -Infinity;
+            }
+        }
+    };
+
+    /// @brief The number of rays of a packet that are tested against a
+    /// bounding box at once.
+    static constexpr int PacketGroupSize = 4;
+
+    /**
+     * @brief Intersects a bounding box with the rays of a packet whose bit is
+     * set in @c mask , returning the bitmask of the rays that hit it closer
+     * than their closest hit so far. The entry distances are written to @c
+     * tNear .
+     */
+    static int intersectAABB(const Bounds &bounds,
+                             const TraversalPacket &packet, int mask,
+                             float *tNear) {
+        using Float = simd::Float<PacketGroupSize>;
+        constexpr int GroupMask = (1 << PacketGroupSize) - 1;
+        int hitMask = 0;
+        for (int first = 0; first < RayPacket::MaxSize;
+             first += PacketGroupSize) {
+            if (!(mask >> first & GroupMask))
+                continue; // no ray of this group is traced
+
+            Float nearT = Float::broadcast(-Infinity);
+            Float farT  = Float::broadcast(+Infinity);
+            for (int axis = 0; axis < 3; axis++) {
+                // the rays of a packet may differ in the signs of their
+                // directions, hence the distances need to be sorted
+                const Float origin = Float::load(packet.origin[axis] + first);
+                const Float invDirection =
+                    Float::load(packet.invDirection[axis] + first);
+                const Float t1 =
+                    (Float::broadcast(bounds.min()[axis]) - origin) *
+                    invDirection;
+                const Float t2 =
+                    (Float::broadcast(bounds.max()[axis]) - origin) *
+                    invDirection;
+                nearT = max(nearT, min(t1, t2));
+                farT  = min(farT, max(t1, t2));
+            }
+
+            nearT.store(tNear + first);
+            hitMask |= (lessEqual(nearT, farT) &
+                        lessEqual(Float::broadcast(Epsilon), farT) &
+                        lessThan(nearT, Float::load(packet.tMax + first)))
+                       << first;
+        }
+        return hitMask & mask;
+    }
+
+    /**
+     * @brief Traverses the binary BVH with a packet of rays, sharing a single
+     * node stack among them. Every node is visited with the bitmask of the
+     * rays that hit its bounding box, and leaves intersect their primitives
+     * with those rays only.
+     * @param intersectLeaf Called as @code intersectLeaf(first, count, mask)
+     * @endcode with the range of positions of a leaf, returning the bitmask
+     * of the rays that hit one of its primitives.
+     * @return The bitmask of the rays that hit a primitive.
+     */
+    template <typename LeafFunction>
+    int traversePacket(const RayPacket &packet, int mask, Intersection *its,
+                       LeafFunction &&intersectLeaf) const {
+        TraversalPacket traversalPacket(packet, mask, its);
+        float tNear[RayPacket::MaxSize];
+        int active = intersectAABB(rootNode().aabb, traversalPacket, mask, tNear);
+
+        struct StackEntry {
+            const Node *node;
+            int mask;
+        } stack[bvh::MaxDepth];
+        int stackSize = 0;
+
+        int hits         = 0;
+        const Node *node = &rootNode();
+        while (active) {
+            for (int m = active; m; m &= m - 1)
+                its[simd::firstBit(m)].stats.bvhCounter++;
+
+            if (node->isLeaf()) {
+                const int leafHits = intersectLeaf(
+                    node->firstPrimitiveIndex(), node->primitiveCount, active);
+                for (int m = leafHits; m; m &= m - 1) {
+                    const int ray = simd::firstBit(m);
+                    traversalPacket.tMax[ray] = its[ray].t;
+                }
+                hits |= leafHits;
+                active = 0;
+            } else {
+                const Node *nearChild = &m_nodes[node->leftChildIndex()];
+                const Node *farChild  = &m_nodes[node->rightChildIndex()];
+                int nearMask = intersectAABB(
+                    nearChild->aabb, traversalPacket, active, tNear);
+                const int firstRay = simd::firstBit(active);
+                const float leftT  = tNear[firstRay];
+                int farMask        = intersectAABB(
+                    farChild->aabb, traversalPacket, active, tNear);
+
+                // the order in which the first ray enters the children is
+                // used for the whole packet, which is coherent
+                if (!(leftT <= tNear[firstRay])) {
+                    std::swap(nearChild, farChild);
+                    std::swap(nearMask, farMask);
+                }
+
+                if (farMask)
+                    stack[stackSize++] = { farChild, farMask };
+                if (nearMask) {
+                    node   = nearChild;
+                    active = nearMask;
+                    continue;
+                }
+                active = 0;
+            }
+
+            // continue with the next node on the stack for the rays that
+            // might still find a closer hit in it
+            while (!active && stackSize > 0) {
+                stackSize--;
+                node   = stack[stackSize].node;
+                active = intersectAABB(
+                    node->aabb, traversalPacket, stack[stackSize].mask, tNear);
+            }
+        }
+        return hits;
+    }
+
+    /**
+     * @brief Converts the subtree of the binary BVH rooted at @c binaryNode
+     * into wide nodes, returning the index of the wide node in @c nodes .
+     *
+     * The children of the wide node are found by repeatedly replacing the
+     * internal child with the largest surface area by its two children,
+     * until there are @c Width children or all children are leaves.
+     */
+    template <int Width>
+    NodeIndex collapse(const Node &binaryNode,
+                       std::vector<WideNode<Width>> &nodes) const {
+        const Node *children[Width];
+        int childCount = 0;
+        if (binaryNode.isLeaf()) {
+            children[childCount++] = &binaryNode;
+        } else {
+            children[childCount++] = &m_nodes[binaryNode.leftChildIndex()];
+            children[childCount++] = &m_nodes[binaryNode.rightChildIndex()];
+        }
+
+        while (childCount < Width) {
+            int largestChild  = -1;
+            float largestArea = -Infinity;
+            for (int i = 0; i < childCount; i++) {
+                if (children[i]->isLeaf())
+                    continue;
+                const float area = bvh::surfaceArea(children[i]->aabb);
+                if (area > largestArea) {
+                    largestChild = i;
+                    largestArea  = area;
+                }
             }
+            if (largestChild < 0)
+                break; // all children are leaves
 
-            Bounds leftBox, rightBox;
-            NodeIndex leftSum = 0, rightSum = 0;
-            // leftArea[i], leftCount[i] contains bins 0, 1, ..., i
-            // rightArea[i], rightCount[i] contains bins
-            //     i+1, i+2, ..., binCount-1
-            float leftArea[binCount - 1], rightArea[binCount - 1];
-            NodeIndex leftCount[binCount - 1], rightCount[binCount - 1];
-
-            // compute prefix and suffix sums on bins
-            for (NodeIndex i = 0; i < binCount - 1; i++) {
-                leftBox.extend(bins[i].aabb);
-                leftArea[i] = surfaceArea(leftBox);
-                leftSum += bins[i].primitiveCount;
-                leftCount[i] = leftSum;
-
-                rightBox.extend(bins[binCount - i - 1].aabb);
-                rightArea[binCount - i - 2] = surfaceArea(rightBox);
-                rightSum += bins[binCount - i - 1].primitiveCount;
-                rightCount[binCount - i - 2] = rightSum;
+            const Node *opened     = children[largestChild];
+            children[largestChild] = &m_nodes[opened->leftChildIndex()];
+            children[childCount++] = &m_nodes[opened->rightChildIndex()];
+        }
+
+        const NodeIndex index = NodeIndex(nodes.size());
+        nodes.emplace_back();
+        for (int i = 0; i < childCount; i++) {
+            const Node &child = *children[i];
+            if (child.isLeaf()) {
+                nodes[index].setChild(i,
+                                      child.aabb,
+                                      child.firstPrimitiveIndex(),
+                                      child.primitiveCount);
+            } else {
+                // the recursion might reallocate nodes, so we cannot hold a
+                // reference to our node across this call
+                const NodeIndex childIndex = collapse(child, nodes);
+                nodes[index].setChild(i, child.aabb, childIndex, 0);
             }
+        }
+        return index;
+    }
+
+    /**
+     * @brief Creates the reference to a leaf of a compressed BVH. Leaves that
+     * exceed the maximum size of compressed leaves are split into chunks,
+     * which are stored under additional nodes appended to @c nodes .
+     */
+    template <int Width>
+    uint32_t compressLeaf(const Bounds &aabb, NodeIndex first,
+                          NodeIndex count,
+                          std::vector<CompressedNode<Width>> &nodes) const {
+        using CompressedNode = CompressedNode<Width>;
+        if (count <= CompressedNode::MaxLeafSize)
+            return CompressedNode::packLeaf(first, count);
+
+        // distribute the primitives evenly among the children of a new node
+        const NodeIndex index = NodeIndex(nodes.size());
+        nodes.emplace_back(aabb);
+        const NodeIndex chunkSize = (count + Width - 1) / Width;
+        for (int i = 0; i < Width && i * chunkSize < count; i++) {
+            const NodeIndex chunkFirst = first + i * chunkSize;
+            const NodeIndex chunkCount = min(chunkSize, count - i * chunkSize);
+            Bounds chunkBounds;
+            for (NodeIndex j = chunkFirst; j < chunkFirst + chunkCount; j++)
+                chunkBounds.extend(getBoundingBox(m_primitiveIndices[j]));
+
+            const uint32_t ref =
+                compressLeaf(chunkBounds, chunkFirst, chunkCount, nodes);
+            nodes[index].setChild(i, chunkBounds, ref);
+        }
+        return uint32_t(index);
+    }
 
-            // find split with lowest surface area
-            for (NodeIndex i = 0; i < binCount - 1; i++) {
-                if (leftCount[i] > 0 && rightCount[i] > 0) {
-                    float sah = leftCount[i] * leftArea[i] +
-                                rightCount[i] * rightArea[i];
-
-                    if (sah < lowestSAH) {
-                        lowestSAH         = sah;
-                        bestSplitPosition = boundsMin + (i + 1) * stepSize;
-                        bestSplitAxis     = axis;
-                    }
+    /**
+     * @brief Converts a wide BVH into compressed nodes. The compressed nodes
+     * share the indices of the wide nodes, except for additional nodes that
+     * are appended for large leaves.
+     */
+    template <int Width>
+    void compressTree(const std::vector<WideNode<Width>> &wideNodes,
+                      std::vector<CompressedNode<Width>> &nodes) const {
+        using CompressedNode = CompressedNode<Width>;
+        if (m_primitiveIndices.size() >
+            (size_t(1) << CompressedNode::LeafIndexBits)) {
+            lightwave_throw("too many primitives (%d) for a compressed BVH",
+                            m_primitiveIndices.size());
+        }
+
+        // the bounding box of a node (which defines its quantization grid)
+        // is only known to its parent, so the nodes are set up when visiting
+        // their parent. this works since parents are always stored before
+        // their children.
+        nodes.assign(wideNodes.size(), CompressedNode(Bounds::empty()));
+        nodes[0] = CompressedNode(m_bounds);
+
+        for (size_t index = 0; index < wideNodes.size(); index++) {
+            const WideNode<Width> &wide = wideNodes[index];
+            for (int i = 0; i < Width; i++) {
+                if (wide.child[i] < 0)
+                    continue; // unused slot
+
+                Bounds aabb;
+                for (int axis = 0; axis < 3; axis++) {
+                    aabb.min()[axis] = wide.bounds[0][axis][i];
+                    aabb.max()[axis] = wide.bounds[1][axis][i];
+                }
+
+                uint32_t ref;
+                if (wide.primitiveCount[i] > 0) {
+                    ref = compressLeaf(
+                        aabb, wide.child[i], wide.primitiveCount[i], nodes);
+                } else {
+                    ref                  = uint32_t(wide.child[i]);
+                    nodes[wide.child[i]] = CompressedNode(aabb);
                 }
+                nodes[index].setChild(i, aabb, ref);
             }
         }
+        nodes.shrink_to_fit();
     }
 
-    /// @brief Attempts to subdivide a given BVH node.
-    void subdivide(Node &parent) {
-        // only subdivide if enough children are available.
-        if (parent.primitiveCount <= 2) {
+    /**
+     * @brief Computes the SAH cost of a wide BVH, i.e., the expected number of
+     * node visits and primitive tests for a random ray that hits the root.
+     */
+    template <int Width>
+    float sahCost(const std::vector<WideNode<Width>> &nodes) const {
+        const float rootArea = bvh::surfaceArea(m_bounds);
+        float cost           = 1; // the root is always visited
+        for (const auto &node : nodes) {
+            for (int i = 0; i < Width; i++) {
+                if (node.child[i] < 0)
+                    continue; // unused slot
+
+                Bounds aabb;
+                for (int axis = 0; axis < 3; axis++) {
+                    aabb.min()[axis] = node.bounds[0][axis][i];
+                    aabb.max()[axis] = node.bounds[1][axis][i];
+                }
+                cost += bvh::surfaceArea(aabb) / rootArea *
+                        max(node.primitiveCount[i], 1);
+            }
+        }
+        return cost;
+    }
+
+    /// @brief Computes the SAH cost of a compressed BVH.
+    /// @see sahCost
+    template <int Width>
+    float sahCost(const std::vector<CompressedNode<Width>> &nodes) const {
+        using CompressedNode = CompressedNode<Width>;
+        const float rootArea = bvh::surfaceArea(m_bounds);
+        float cost           = 1; // the root is always visited
+        for (const auto &node : nodes) {
+            for (int i = 0; i < Width; i++) {
+                const uint32_t ref = node.child[i];
+                if (ref == CompressedNode::EmptyChild)
+                    continue;
+
+                cost += bvh::surfaceArea(node.childBounds(i)) / rootArea *
+                        (CompressedNode::isLeaf(ref)
+                             ? CompressedNode::leafCount(ref)
+                             : 1);
+            }
+        }
+        return cost;
+    }
+
+    /// @brief Fetches the bounding boxes and centroids of all primitives into
+    /// the build context.
+    void fetchPrimitives(BuildContext &ctx) const {
+        const int primitiveCount = numberOfPrimitives();
+        ctx.primitiveBounds.resize(primitiveCount);
+        ctx.primitiveCentroids.resize(primitiveCount);
+        const auto fetch = [&](Range chunk) {
+            const double start = threadCpuTime();
+            getPrimitiveBounds(chunk,
+                               ctx.primitiveBounds.data(),
+                               ctx.primitiveCentroids.data());
+            ctx.addCpuTime(start);
+        };
+        // a single chunk is not worth starting threads for
+        if (primitiveCount <= bvh::ParallelChunkSize) {
+            fetch(Range(0, primitiveCount));
             return;
         }
+        for_each_parallel(ChunkedRange(primitiveCount, bvh::ParallelChunkSize),
+                          fetch);
+    }
+
+    /**
+     * @brief The SAH cost of an internal node relative to its surface area,
+     * i.e., the expected number of nodes and primitives that a ray that hits
+     * the node needs to be tested against, given the relative costs of its
+     * children. The relative cost of a leaf is its primitive count.
+     */
+    float relativeCost(const Node &node, float leftCost,
+                       float rightCost) const {
+        const float area = bvh::surfaceArea(node.aabb);
+        if (!(area > 0))
+            return 1 + leftCost + rightCost;
+        return 1 + (bvh::surfaceArea(m_nodes[node.leftChildIndex()].aabb) *
+                        leftCost +
+                    bvh::surfaceArea(m_nodes[node.rightChildIndex()].aabb) *
+                        rightCost) /
+                       area;
+    }
+
+    /// @brief Computes the relative SAH cost of all nodes in a subtree.
+    float computeCosts(NodeIndex index, std::vector<float> &costs) const {
+        const Node &node = m_nodes[index];
+        if (node.isLeaf())
+            return costs[index] = float(node.primitiveCount);
 
-        // set to true when implementing binning
-        static constexpr bool UseSAH = true;
+        const float leftCost  = computeCosts(node.leftChildIndex(), costs);
+        const float rightCost = computeCosts(node.rightChildIndex(), costs);
+        return costs[index]   = relativeCost(node, leftCost, rightCost);
+    }
 
-        int splitAxis = -1;
-        float splitPosition;
-        if (UseSAH) {
-            // pick split axis and position using binned SAH
-            binning(parent, splitAxis, splitPosition);
+    /**
+     * @brief Recomputes the bounding boxes (and relative SAH costs) of all
+     * nodes in a subtree from the current bounding boxes of the primitives.
+     * Subtrees up to a depth of @c parallelDepth are refit on separate
+     * threads (if the thread budget allows).
+     */
+    void refitNode(NodeIndex index, std::vector<float> &costs,
+                   int parallelDepth) {
+        Node &node = m_nodes[index];
+        if (node.isLeaf()) {
+            node.aabb = Bounds::empty();
+            for (NodeIndex i = node.firstPrimitiveIndex();
+                 i <= node.lastPrimitiveIndex();
+                 i++) {
+                node.aabb.extend(getBoundingBox(m_primitiveIndices[i]));
+            }
+            costs[index] = float(node.primitiveCount);
+            return;
+        }
+
+        std::thread worker;
+        if (parallelDepth > 0 && bvh::acquireBuildThread()) {
+            worker = std::thread([this, &costs, &node, parallelDepth]() {
+                refitNode(node.leftChildIndex(), costs, parallelDepth - 1);
+                bvh::releaseBuildThread();
+            });
         } else {
-            // split in the middle of the longest axis
-            splitAxis     = parent.aabb.diagonal().maxComponentIndex();
-            splitPosition = parent.aabb.center()[splitAxis];
+            refitNode(node.leftChildIndex(), costs, parallelDepth - 1);
+        }
+        refitNode(node.rightChildIndex(), costs, parallelDepth - 1);
+        if (worker.joinable()) {
+            worker.join();
         }
 
-        if (splitAxis == -1) {
-            // a split axis of -1 indicates that no useful split exists
+        const Node &left  = m_nodes[node.leftChildIndex()];
+        const Node &right = m_nodes[node.rightChildIndex()];
+        node.aabb         = left.aabb;
+        node.aabb.extend(right.aabb);
+        costs[index] = relativeCost(node,
+                                    costs[node.leftChildIndex()],
+                                    costs[node.rightChildIndex()]);
+    }
+
+    /**
+     * @brief Collects the topmost subtrees whose relative SAH cost exceeds
+     * the cost they had when they were built by more than @ref
+     * m_rebuildThreshold , along with their depth.
+     */
+    void findDegradedSubtrees(
+        NodeIndex index, int depth, const std::vector<float> &costs,
+        std::vector<std::pair<NodeIndex, int>> &degraded) const {
+        const Node &node = m_nodes[index];
+        if (node.isLeaf())
+            return;
+        if (costs[index] > m_rebuildThreshold * m_nodeCosts[index]) {
+            degraded.emplace_back(index, depth);
             return;
         }
+        findDegradedSubtrees(node.leftChildIndex(), depth + 1, costs, degraded);
+        findDegradedSubtrees(
+            node.rightChildIndex(), depth + 1, costs, degraded);
+    }
 
-        // the point at which to split (note that primitives must be
-        // re-ordered so that all children of the left node will have a
-        // smaller index than firstRightIndex, and nodes on the right will
-        // have an index larger or equal to firstRightIndex)
-        NodeIndex firstRightIndex = parent.firstPrimitiveIndex();
-        NodeIndex lastLeftIndex   = parent.lastPrimitiveIndex();
-
-        // partition algorithm (you might remember this from quicksort)
-        while (firstRightIndex <= lastLeftIndex) {
-            if (getCentroid(m_primitiveIndices[firstRightIndex])[splitAxis] <
-                splitPosition) {
-                firstRightIndex++;
+    /**
+     * @brief Rebuilds a subtree from scratch using the SAH builder. The new
+     * nodes are appended to m_nodes, while the old ones remain unused until
+     * @ref reorderNodes is called.
+     * @param ctx A build context whose primitives have already been fetched,
+     * which is shared by all subtrees rebuilt by the same refit.
+     * @return The number of primitives in the subtree.
+     */
+    NodeIndex rebuildSubtree(NodeIndex index, int depth, BuildContext &ctx) {
+        // the SAH and linear builders store the primitives of every subtree
+        // contiguously
+        NodeIndex first = std::numeric_limits<NodeIndex>::max();
+        NodeIndex count = 0;
+        std::vector<NodeIndex> stack{ index };
+        while (!stack.empty()) {
+            const Node &node = m_nodes[stack.back()];
+            stack.pop_back();
+            if (node.isLeaf()) {
+                first = std::min(first, node.firstPrimitiveIndex());
+                count += node.primitiveCount;
             } else {
-                std::swap(m_primitiveIndices[firstRightIndex],
-                          m_primitiveIndices[lastLeftIndex--]);
+                stack.push_back(node.leftChildIndex());
+                stack.push_back(node.rightChildIndex());
             }
         }
 
-        const NodeIndex firstLeftIndex = parent.firstPrimitiveIndex();
-        const NodeIndex leftCount      = firstRightIndex - firstLeftIndex;
-        const NodeIndex rightCount     = parent.primitiveCount - leftCount;
+        bvh::SAHBuilder(m_nodes, m_primitiveIndices, m_leafSize)
+            .rebuild(index, first, count, depth, ctx);
 
-        if (leftCount == 0 || rightCount == 0) {
-            // if either child gets no primitives, we abort subdividing
-            return;
+        m_nodes.resize(ctx.nodeCount);
+        m_nodeCosts.resize(m_nodes.size());
+        computeCosts(index, m_nodeCosts);
+        return count;
+    }
+
+    /**
+     * @brief Lays out the nodes of the binary tree according to @ref
+     * m_nodeOrder , keeping siblings next to each other. This also removes
+     * nodes that are no longer part of the tree.
+     */
+    void reorderNodes() {
+        // laying out treelets of a single pair of siblings results in
+        // depth-first order
+        const int treeletPairs =
+            m_nodeOrder == NodeOrder::Treelets ? TreeletPairs : 1;
+        if (m_primitiveIndices.empty())
+            return; // the root is not a valid node in this case
+        const bool hasCosts = !m_nodeCosts.empty();
+
+        std::vector<Node> nodes;
+        std::vector<float> costs;
+        nodes.reserve(m_nodes.size());
+        nodes.push_back(m_nodes[0]);
+        if (hasCosts) {
+            costs.reserve(m_nodes.size());
+            costs.push_back(m_nodeCosts[0]);
+        }
+
+        // nodes whose children start a new treelet, processed depth-first
+        std::vector<NodeIndex> treeletRoots{ 0 };
+        std::vector<NodeIndex> treelet, remaining;
+        while (!treeletRoots.empty()) {
+            treelet.assign(1, treeletRoots.back());
+            treeletRoots.pop_back();
+            remaining.clear();
+
+            // within a treelet, pairs of siblings are laid out breadth-first
+            int pairs = 0;
+            for (size_t next = 0; next < treelet.size(); next++) {
+                const NodeIndex index = treelet[next];
+                if (nodes[index].isLeaf())
+                    continue;
+                if (pairs == treeletPairs) {
+                    remaining.push_back(index);
+                    continue;
+                }
+
+                // children still refer to the old indices at this point
+                const NodeIndex oldLeft = nodes[index].leftChildIndex();
+                const NodeIndex newLeft = NodeIndex(nodes.size());
+                nodes[index].leftFirst  = newLeft;
+                for (NodeIndex child = oldLeft; child <= oldLeft + 1; child++) {
+                    nodes.push_back(m_nodes[child]);
+                    if (hasCosts)
+                        costs.push_back(m_nodeCosts[child]);
+                }
+                treelet.push_back(newLeft);
+                treelet.push_back(newLeft + 1);
+                pairs++;
+            }
+
+            // continue with the subtrees below the treelet from left to right
+            treeletRoots.insert(
+                treeletRoots.end(), remaining.rbegin(), remaining.rend());
         }
 
-        // the two children will always be contiguous in our m_nodes list
-        const NodeIndex leftChildIndex  = (NodeIndex) (m_nodes.size() + 0);
-        const NodeIndex rightChildIndex = (NodeIndex) (m_nodes.size() + 1);
-        parent.primitiveCount = 0; // mark the parent node as internal node
-        parent.leftFirst      = leftChildIndex;
+        m_nodes     = std::move(nodes);
+        m_nodeCosts = std::move(costs);
+    }
 
-        m_nodes.emplace_back();
-        m_nodes[leftChildIndex].leftFirst      = firstLeftIndex;
-        m_nodes[leftChildIndex].primitiveCount = leftCount;
+    /// @brief Quality measures of the binary tree (see @ref
+    /// computeStatistics ).
+    struct Statistics {
+        NodeIndex internalCount = 0;
+        NodeIndex leafCount     = 0;
+        /// @brief The SAH cost of the tree, i.e., the expected number of node
+        /// visits and primitive tests for a random ray that hits the root.
+        float sahCost = 0;
+        /// @brief The surface area in which the children of internal nodes
+        /// overlap, summed over all nodes and relative to the root, i.e., the
+        /// expected number of nodes whose children both need to be visited.
+        float overlap = 0;
+        /// @brief The overlap of the children of internal nodes relative to
+        /// the surface area of the node, averaged over all internal nodes.
+        float meanNodeOverlap = 0;
+        /// @brief The number of leaves by size, where bucket @c i holds the
+        /// leaves with more than @code 2^(i-1) @endcode and at most @code
+        /// 2^i @endcode primitives.
+        std::vector<NodeIndex> leafSizes;
+        /// @brief The number of leaves by depth, in buckets of @ref
+        /// DepthBucketSize levels.
+        std::vector<NodeIndex> leafDepths;
+        float meanLeafDepth = 0;
+        int maxLeafDepth    = 0;
+    };
 
-        m_nodes.emplace_back();
-        m_nodes[rightChildIndex].leftFirst      = firstRightIndex;
-        m_nodes[rightChildIndex].primitiveCount = rightCount;
+    /**
+     * @brief Invokes @c f for all nodes of the binary tree in depth-first
+     * order as @code f(index, parentIndex, depth) @endcode , where the
+     * parent index of the root is -1.
+     */
+    template <typename F> void forEachNode(F f) const {
+        struct StackEntry {
+            NodeIndex index;
+            NodeIndex parent;
+            int depth;
+        };
+        std::vector<StackEntry> stack{ { 0, -1, 0 } };
+        while (!stack.empty()) {
+            const StackEntry entry = stack.back();
+            stack.pop_back();
+            f(entry.index, entry.parent, entry.depth);
 
-        // first, process the left child node (and all of its children)
-        computeAABB(m_nodes[leftChildIndex]);
-        subdivide(m_nodes[leftChildIndex]);
-        // then, process the right child node (and all of its children)
-        computeAABB(m_nodes[rightChildIndex]);
-        subdivide(m_nodes[rightChildIndex]);
+            const Node &node = m_nodes[entry.index];
+            if (!node.isLeaf()) {
+                stack.push_back(
+                    { node.rightChildIndex(), entry.index, entry.depth + 1 });
+                stack.push_back(
+                    { node.leftChildIndex(), entry.index, entry.depth + 1 });
+            }
+        }
+    }
+
+    /// @brief Returns the surface area in which the bounding boxes of the two
+    /// children of an internal node overlap.
+    float childOverlap(const Node &node) const {
+        const Bounds &left  = m_nodes[node.leftChildIndex()].aabb;
+        const Bounds &right = m_nodes[node.rightChildIndex()].aabb;
+        const Bounds overlap(elementwiseMax(left.min(), right.min()),
+                             elementwiseMin(left.max(), right.max()));
+        return overlap.isEmpty() ? 0 : bvh::surfaceArea(overlap);
+    }
+
+    /// @brief Computes the quality measures of the binary tree.
+    Statistics computeStatistics() const {
+        Statistics stats;
+        const float rootArea = bvh::surfaceArea(rootNode().aabb);
+        const auto relativeArea = [&](const Bounds &aabb) {
+            return rootArea > 0 ? bvh::surfaceArea(aabb) / rootArea : 1.f;
+        };
+
+        double depthSum = 0;
+        forEachNode([&](NodeIndex index, NodeIndex parent, int depth) {
+            const Node &node = m_nodes[index];
+            // the root is always visited, while other nodes are visited with
+            // a probability proportional to their surface area
+            const float visitCost =
+                parent < 0 ? 1 : relativeArea(node.aabb);
+
+            if (!node.isLeaf()) {
+                stats.internalCount++;
+                stats.sahCost += visitCost;
+
+                const float overlap = childOverlap(node);
+                if (rootArea > 0)
+                    stats.overlap += overlap / rootArea;
+                const float area = bvh::surfaceArea(node.aabb);
+                if (area > 0)
+                    stats.meanNodeOverlap += overlap / area;
+                return;
+            }
+
+            stats.leafCount++;
+            stats.sahCost += visitCost * node.primitiveCount;
+
+            const size_t sizeBucket =
+                std::bit_width(uint32_t(node.primitiveCount - 1));
+            if (stats.leafSizes.size() <= sizeBucket)
+                stats.leafSizes.resize(sizeBucket + 1);
+            stats.leafSizes[sizeBucket]++;
+
+            const size_t depthBucket = depth / DepthBucketSize;
+            if (stats.leafDepths.size() <= depthBucket)
+                stats.leafDepths.resize(depthBucket + 1);
+            stats.leafDepths[depthBucket]++;
+            depthSum += depth;
+            stats.maxLeafDepth = std::max(stats.maxLeafDepth, depth);
+        });
+
+        if (stats.internalCount > 0)
+            stats.meanNodeOverlap /= stats.internalCount;
+        stats.meanLeafDepth = float(depthSum / stats.leafCount);
+        return stats;
+    }
+
+    /// @brief Formats the non-empty buckets of a histogram as a list of
+    /// @code label: count @endcode pairs.
+    template <typename Label>
+    static std::string formatHistogram(const std::vector<NodeIndex> &buckets,
+                                       Label label) {
+        std::string result;
+        for (size_t i = 0; i < buckets.size(); i++) {
+            if (buckets[i] == 0)
+                continue;
+            if (!result.empty())
+                result += ", ";
+            result += tfm::format("%s: %d", label(int(i)), buckets[i]);
+        }
+        return result;
+    }
+
+    /// @brief Logs the statistics of the binary tree along with the SAH cost
+    /// and memory usage of the nodes used for traversal.
+    void logStatistics(const Statistics &stats) const {
+        const auto sizeLabel = [](int bucket) {
+            const int upper = 1 << bucket;
+            const int lower = bucket > 0 ? (upper >> 1) + 1 : 1;
+            return lower == upper ? tfm::format("%d", upper)
+                                  : tfm::format("%d-%d", lower, upper);
+        };
+        const auto depthLabel = [](int bucket) {
+            return tfm::format("%d-%d",
+                               bucket * DepthBucketSize,
+                               (bucket + 1) * DepthBucketSize - 1);
+        };
+
+        float traversalCost = stats.sahCost;
+        if (m_layout == Layout::Wide4) {
+            traversalCost = m_compress ? sahCost(m_compressedNodes4)
+                                       : sahCost(m_wideNodes4);
+        } else if (m_layout == Layout::Wide8) {
+            traversalCost = m_compress ? sahCost(m_compressedNodes8)
+                                       : sahCost(m_wideNodes8);
+        }
+
+        const auto bytes = [](const auto &vector) {
+            return vector.size() * sizeof(vector[0]);
+        };
+        const size_t nodeBytes = bytes(m_nodes) + bytes(m_wideNodes4) +
+                                 bytes(m_wideNodes8) +
+                                 bytes(m_compressedNodes4) +
+                                 bytes(m_compressedNodes8);
+        const size_t indexBytes = bytes(m_primitiveIndices);
+
+        logger(EInfo,
+               "BVH statistics: %ld internal nodes, %ld leaves, SAH cost %.2f "
+               "(%.2f for %d-wide traversal), child overlap %.2f (%.1f%% of "
+               "the node on average)",
+               stats.internalCount,
+               stats.leafCount,
+               stats.sahCost,
+               traversalCost,
+               int(m_layout),
+               stats.overlap,
+               100 * stats.meanNodeOverlap);
+        logger(EInfo,
+               "BVH leaf sizes: %s",
+               formatHistogram(stats.leafSizes, sizeLabel));
+        logger(EInfo,
+               "BVH leaf depths (mean %.1f, max %d): %s",
+               stats.meanLeafDepth,
+               stats.maxLeafDepth,
+               formatHistogram(stats.leafDepths, depthLabel));
+        logger(EInfo,
+               "BVH memory: %.2f MiB for nodes, %.2f MiB for primitive "
+               "indices",
+               nodeBytes / (1024.0 * 1024.0),
+               indexBytes / (1024.0 * 1024.0));
+    }
+
+    /**
+     * @brief Writes one line per node of the binary tree to a CSV file, listing
+     * its position in the tree, its primitives, its bounds and how much its
+     * children overlap.
+     */
+    void dumpNodes(const std::filesystem::path &file) const {
+        std::error_code error;
+        if (file.has_parent_path())
+            std::filesystem::create_directories(file.parent_path(), error);
+
+        std::ofstream stream(file);
+        NodeIndex count = 0;
+        stream << "index,parent,depth,leaf,first,count,minX,minY,minZ,maxX,"
+                  "maxY,maxZ,area,overlap\n";
+        forEachNode([&](NodeIndex index, NodeIndex parent, int depth) {
+            const Node &node   = m_nodes[index];
+            const Bounds &aabb = node.aabb;
+            count++;
+            stream << tfm::format(
+                "%d,%d,%d,%d,%d,%d,%g,%g,%g,%g,%g,%g,%g,%g\n",
+                index,
+                parent,
+                depth,
+                node.isLeaf(),
+                node.isLeaf() ? node.firstPrimitiveIndex() : -1,
+                node.primitiveCount,
+                aabb.min().x(),
+                aabb.min().y(),
+                aabb.min().z(),
+                aabb.max().x(),
+                aabb.max().y(),
+                aabb.max().z(),
+                bvh::surfaceArea(aabb),
+                node.isLeaf() ? 0.f : childOverlap(node));
+        });
+
+        if (!stream) {
+            logger(EWarn,
+                   "could not write BVH nodes to \"%s\"",
+                   file.generic_string());
+            return;
+        }
+        logger(EInfo,
+               "wrote %ld BVH nodes to \"%s\"",
+               count,
+               file.generic_string());
     }
 
 protected:
     /// @brief Returns the number of children (individual shapes) that are
     /// part of this acceleration structure.
     virtual int numberOfPrimitives() const = 0;
-    /// @brief Intersect a single child (identified by the index) with the
-    /// given ray.
+    /**
+     * @brief Intersect a single child (identified by the index) with the
+     * given ray. Like @ref Shape::findHit , this only needs to record the hit
+     * in @c its.hit , as the surface data of the closest hit is computed after
+     * the traversal.
+     */
     virtual bool intersect(int primitiveIndex, const Ray &ray,
                            Intersection &its, Sampler &rng) const = 0;
+    /**
+     * @brief Tests whether a single child (identified by the index) blocks
+     * the given ray before @c tMax . The default implementation falls back
+     * to @ref intersect , subclasses can override this to avoid computing
+     * surface information that is not needed for occlusion.
+     */
+    virtual bool occluded(int primitiveIndex, const Ray &ray, float tMax,
+                          Sampler &rng) const {
+        Intersection its(-ray.direction, tMax);
+        return intersect(primitiveIndex, ray, its, rng);
+    }
+    /**
+     * @brief Intersects a single child (identified by the index) with the
+     * rays of a packet whose bit is set in @c mask , returning the bitmask of
+     * the rays that hit it. Like @ref intersect , this only needs to record
+     * the hits. The default implementation intersects the rays one by one,
+     * subclasses whose children are shapes themselves can pass the packet on
+     * to them (see @ref Shape::findHitPacket ).
+     */
+    virtual int intersectPacket(int primitiveIndex, const RayPacket &packet,
+                                int mask, Intersection *its) const {
+        int hits = 0;
+        for (int m = mask; m; m &= m - 1) {
+            const int i = simd::firstBit(m);
+            if (intersect(primitiveIndex, packet.rays[i], its[i],
+                          *packet.rng[i]))
+                hits |= 1 << i;
+        }
+        return hits;
+    }
     /// @brief Returns the axis aligned bounding box of the given child.
     virtual Bounds getBoundingBox(int primitiveIndex) const = 0;
     /// @brief Returns the centroid of the given child.
     virtual Point getCentroid(int primitiveIndex) const = 0;
+    /**
+     * @brief Writes the bounding boxes and centroids of the children in @c
+     * range to @code bounds[i] @endcode and @code centroids[i] @endcode ,
+     * which is called with large ranges before building the BVH.
+     */
+    virtual void getPrimitiveBounds(Range range, Bounds *bounds,
+                                    Point *centroids) const {
+        for (int i : range) {
+            bounds[i]    = getBoundingBox(i);
+            centroids[i] = getCentroid(i);
+        }
+    }
+    /**
+     * @brief Returns the bounding box of the part of the given child that
+     * lies within @c clip , or an empty bounding box if no part of it does
+     * (used by the spatial split builder). The default implementation clamps
+     * the bounding box of the child to @c clip , which is conservative but
+     * not tight.
+     */
+    virtual Bounds getClippedBoundingBox(int primitiveIndex,
+                                         const Bounds &clip) const {
+        return clip.clip(getBoundingBox(primitiveIndex));
+    }
+    /**
+     * @brief Reorders the primitives such that the primitive previously at
+     * index @code order[i] @endcode ends up at index @c i . Returns false if
+     * the subclass does not support this (which is the default).
+     */
+    virtual bool permutePrimitives(const std::vector<int> &order) {
+        return false;
+    }
+
+    /// @brief Computes the surface data of the rays of a packet whose bit is
+    /// set in @c hits , see @ref Shape::completeHit .
+    static void completeHits(const RayPacket &packet, int hits,
+                             Intersection *its) {
+        for (; hits; hits &= hits - 1) {
+            const int i = simd::firstBit(hits);
+            completeHit(packet.rays[i], its[i]);
+        }
+    }
+
+    /**
+     * @brief Finds the closest intersection of a ray, invoking @code
+     * intersectPrimitive(primitiveIndex) @endcode for every primitive in the
+     * leaves that the ray visits.
+     */
+    template <typename PrimitiveFunction>
+    bool intersectPrimitives(const Ray &ray, Intersection &its,
+                             PrimitiveFunction &&intersectPrimitive) const {
+        if (m_primitiveIndices.empty())
+            return false; // exit early if no children exist
+        return traverse(ray, its, [&](NodeIndex first, NodeIndex count) {
+            bool wasIntersected = false;
+            for (NodeIndex i = first; i < first + count; i++) {
+                // update the statistic tracking how many children have been
+                // tested for intersection
+                its.stats.primCounter++;
+                // test the child for intersection
+                wasIntersected |= intersectPrimitive(primitiveAt(i));
+            }
+            return wasIntersected;
+        });
+    }
+
+    /**
+     * @brief Finds the closest intersections of a packet of rays, invoking
+     * @code intersectPrimitive(primitiveIndex, mask) @endcode for the
+     * primitives in the leaves that the rays visit.
+     */
+    template <typename PrimitiveFunction>
+    int intersectPrimitives(const RayPacket &packet, int mask,
+                            Intersection *its,
+                            PrimitiveFunction &&intersectPrimitive) const {
+        return traversePacketLeaves(
+            packet, mask, its,
+            [&](NodeIndex first, NodeIndex count, int active) {
+                int hits = 0;
+                for (NodeIndex i = first; i < first + count; i++) {
+                    for (int m = active; m; m &= m - 1)
+                        its[simd::firstBit(m)].stats.primCounter++;
+                    hits |= intersectPrimitive(primitiveAt(i), active);
+                }
+                return hits;
+            });
+    }
+
+    /**
+     * @brief Tests whether a ray is blocked before @c tMax , invoking @code
+     * occludedPrimitive(primitiveIndex) @endcode for the primitives in the
+     * leaves that the ray visits until one of them blocks it.
+     */
+    template <typename PrimitiveFunction>
+    bool occludedPrimitives(const Ray &ray, float tMax,
+                            PrimitiveFunction &&occludedPrimitive) const {
+        if (m_primitiveIndices.empty())
+            return false; // exit early if no children exist
+        // the intersection only serves to track the maximum distance and the
+        // traversal statistics
+        Intersection its(-ray.direction, tMax);
+        return traverse<true>(ray, its, [&](NodeIndex first, NodeIndex count) {
+            for (NodeIndex i = first; i < first + count; i++) {
+                its.stats.primCounter++;
+                if (occludedPrimitive(primitiveAt(i)))
+                    return true;
+            }
+            return false;
+        });
+    }
+
+    /// @brief Returns the primitive at the given position of a leaf range.
+    int primitiveAt(NodeIndex index) const {
+        return m_primitivesInLeafOrder ? int(index) : m_primitiveIndices[index];
+    }
+
+    /// @brief Returns the number of positions that leaf ranges refer to,
+    /// which exceeds the number of primitives if spatial splits reference
+    /// primitives from several leaves.
+    NodeIndex leafRangeSize() const {
+        return NodeIndex(m_primitiveIndices.size());
+    }
+
+    /**
+     * @brief Traverses the BVH, invoking @code intersectLeaf(first, count)
+     * @endcode for the leaves that the ray visits, with a range of positions
+     * that can be resolved with @ref primitiveAt . Subclasses can use this to
+     * intersect several primitives of a leaf at once.
+     * @tparam AnyHit Whether to stop at the first leaf that reports a hit.
+     */
+    template <bool AnyHit = false, typename LeafFunction>
+    bool traverseLeaves(const Ray &ray, Intersection &its,
+                        LeafFunction &&intersectLeaf) const {
+        if (m_primitiveIndices.empty())
+            return false; // exit early if no children exist
+        return traverse<AnyHit>(ray, its, intersectLeaf);
+    }
+
+    /**
+     * @brief Finds the closest hits of a packet of rays, invoking @code
+     * intersectLeaf(first, count, mask) @endcode for the leaves that the rays
+     * visit (see @ref traversePacket ). This is the packet counterpart of
+     * @ref traverseLeaves . Wide BVHs trace the rays one by one through
+     * @ref findHit instead.
+     */
+    template <typename LeafFunction>
+    int traversePacketLeaves(const RayPacket &packet, int mask,
+                             Intersection *its,
+                             LeafFunction &&intersectLeaf) const {
+        if (m_primitiveIndices.empty())
+            return 0; // exit early if no children exist
+        if (m_layout == Layout::Binary)
+            return traversePacket(packet, mask, its, intersectLeaf);
+
+        int hits = 0;
+        for (int m = mask; m; m &= m - 1) {
+            const int i = simd::firstBit(m);
+            if (findHit(packet.rays[i], its[i], *packet.rng[i]))
+                hits |= 1 << i;
+        }
+        return hits;
+    }
 
     /// @brief Builds the acceleration structure.
     void buildAccelerationStructure() {
+        buildBinaryTree();
+        permuteToLeafOrder();
+        finishBuild();
+    }
+
+    /**
+     * @brief Builds the acceleration structure, reusing the binary tree that
+     * an earlier run stored in @c cacheDirectory if it was built for the same
+     * primitives (identified by @c contentHash ) with the same settings.
+     * Otherwise, the tree is built and stored in @c cacheDirectory .
+     */
+    void buildAccelerationStructure(const std::filesystem::path &cacheDirectory,
+                                    uint64_t contentHash) {
+        const uint64_t key = cacheKey(contentHash);
+        const std::filesystem::path cacheFile =
+            cacheDirectory / tfm::format("%016x.bvh", key);
+        if (!loadBinaryTree(cacheFile, key)) {
+            buildBinaryTree();
+            saveBinaryTree(cacheFile, key);
+        }
+        // the cache stores the tree for the original order of the primitives
+        permuteToLeafOrder();
+        finishBuild();
+    }
+
+    /**
+     * @brief Builds the acceleration structure from a binary tree that was
+     * stored along with the primitives (see @ref writeBinaryTree ), which is
+     * only built from scratch if there is no tree or if it was built for
+     * other primitives (identified by @c contentHash ) or settings.
+     */
+    void buildAccelerationStructure(const uint8_t *tree, size_t size,
+                                    uint64_t contentHash,
+                                    const std::string &source) {
+        if (!tree || !readBinaryTree(tree, size, cacheKey(contentHash), source))
+            buildBinaryTree();
+        permuteToLeafOrder();
+        finishBuild();
+    }
+
+    /// @brief Builds the binary tree with the configured builder.
+    void buildBinaryTree() {
         Timer buildTimer;
+        const double start = threadCpuTime();
+        BuildContext ctx;
+        m_nodeCosts.clear();
+        fetchPrimitives(ctx);
+
+        if (m_builder == Builder::SpatialSplits) {
+            bvh::SpatialSplitBuilder(
+                m_nodes,
+                m_primitiveIndices,
+                m_leafSize,
+                m_splitBudget,
+                [this](int primitiveIndex, const Bounds &clip) {
+                    return getClippedBoundingBox(primitiveIndex, clip);
+                })
+                .build(ctx);
+        } else if (m_builder == Builder::Linear) {
+            bvh::LinearBuilder(m_nodes, m_primitiveIndices, m_leafSize)
+                .build(ctx);
+        } else {
+            bvh::SAHBuilder(m_nodes, m_primitiveIndices, m_leafSize)
+                .build(ctx);
+        }
+
+        // release the nodes that were not needed
+        m_nodes.resize(ctx.nodeCount);
+        m_nodes.shrink_to_fit();
+        m_bounds = rootNode().aabb;
+        if (m_nodeOrder != NodeOrder::Build)
+            reorderNodes();
+
+        // the CPU time spent by all threads relative to the elapsed
+        // wall-clock time is the average number of busy cores, which is a
+        // measure of utilization rather than of speedup over a serial build
+        ctx.addCpuTime(start);
+        const float buildTime = buildTimer.getElapsedTime();
+        logger(EInfo,
+               "built BVH with %ld nodes for %ld primitives in %.1f ms "
+               "(%.1f cores busy on average)",
+               m_nodes.size(),
+               numberOfPrimitives(),
+               buildTime * 1000,
+               buildTime > 0 ? std::max(ctx.cpuTime * 1e-6 / buildTime, 1.0)
+                             : 1.0);
+        if (m_builder == Builder::SpatialSplits) {
+            const size_t added = m_primitiveIndices.size() -
+                                 size_t(numberOfPrimitives());
+            logger(EInfo,
+                   "spatial splits added %ld references (%.1f%% of the "
+                   "primitives)",
+                   added,
+                   numberOfPrimitives() > 0
+                       ? 100.0 * added / numberOfPrimitives()
+                       : 0.0);
+        }
+    }
+
+    /**
+     * @brief Permutes the primitives into the order in which the leaves
+     * reference them if the @c reorderPrimitives property is set, so that
+     * m_primitiveIndices becomes the identity. This is not possible if
+     * leaves share primitives (as with spatial splits).
+     */
+    void permuteToLeafOrder() {
+        m_primitivesInLeafOrder = false;
+        if (!m_reorderPrimitives || m_primitiveIndices.empty())
+            return;
+        if (m_primitiveIndices.size() != size_t(numberOfPrimitives())) {
+            logger(EWarn,
+                   "cannot reorder primitives that are referenced by several "
+                   "leaves");
+            return;
+        }
+        if (!permutePrimitives(m_primitiveIndices))
+            return;
 
-        // fill primitive indices with 0 to primitiveCount - 1
-        m_primitiveIndices.resize(numberOfPrimitives());
         std::iota(m_primitiveIndices.begin(), m_primitiveIndices.end(), 0);
+        m_primitivesInLeafOrder = true;
+    }
 
-        // create root node
-        auto &root          = m_nodes.emplace_back();
-        root.leftFirst      = 0;
-        root.primitiveCount = numberOfPrimitives();
-        computeAABB(root);
-        subdivide(root);
+    /// @brief The header of BVH cache files, followed by the nodes and the
+    /// primitive indices.
+    struct CacheHeader {
+        char magic[4] = { 'L', 'W', 'B', 'H' };
+        uint32_t version = CacheVersion;
+        /// @brief The key the tree was built for (see @ref cacheKey ).
+        uint64_t key;
+        uint64_t nodeCount;
+        uint64_t primitiveIndexCount;
+    };
 
+    /// @brief Describes all settings that affect the acceleration structure,
+    /// so that shapes with the same primitives and settings can share it.
+    std::string describeSettings() const {
+        return tfm::format("bvh=%d,compress=%d,builder=%d,nodeOrder=%d,"
+                           "splitBudget=%g,dynamic=%d,rebuildThreshold=%g,"
+                           "reorderPrimitives=%d,leafSize=%d",
+                           int(m_layout),
+                           m_compress,
+                           int(m_builder),
+                           int(m_nodeOrder),
+                           m_splitBudget,
+                           m_dynamic,
+                           m_rebuildThreshold,
+                           m_reorderPrimitives,
+                           m_leafSize);
+    }
+
+    /// @brief Needs to be incremented whenever the builders or the layout of
+    /// the nodes change, so that outdated cache files are ignored.
+    static constexpr uint32_t CacheVersion = 1;
+
+    /// @brief Identifies a binary tree by the primitives it was built for and
+    /// the settings of the builder.
+    uint64_t cacheKey(uint64_t contentHash) const {
+        return hash::fnv1a(CacheVersion,
+                           contentHash,
+                           uint64_t(numberOfPrimitives()),
+                           uint32_t(m_builder),
+                           uint32_t(m_nodeOrder),
+                           std::bit_cast<uint32_t>(m_splitBudget),
+                           uint32_t(m_leafSize),
+                           uint32_t(sizeof(Node)));
+    }
+
+    /**
+     * @brief Loads the binary tree from a cache file written by @ref
+     * saveBinaryTree .
+     * @return false if the file does not exist or does not match the key.
+     */
+    bool loadBinaryTree(const std::filesystem::path &file, uint64_t key) {
+        if (!std::filesystem::exists(file))
+            return false;
+
+        try {
+            const MappedFile mapped(file);
+            return readBinaryTree(mapped.data(),
+                                  mapped.size(),
+                                  key,
+                                  tfm::format("\"%s\"", file.generic_string()));
+        } catch (const std::exception &e) {
+            logger(EWarn,
+                   "could not read BVH cache \"%s\": %s",
+                   file.generic_string(),
+                   e.what());
+            return false;
+        }
+    }
+
+    /**
+     * @brief Restores the binary tree from data written by @ref
+     * writeBinaryTree , where @c source describes the origin of the data for
+     * log messages.
+     * @return false if the data is invalid or does not match the key.
+     */
+    bool readBinaryTree(const uint8_t *data, size_t size, uint64_t key,
+                        const std::string &source) {
+        Timer loadTimer;
+        CacheHeader header;
+        if (size < sizeof(header) ||
+            std::memcmp(data, CacheHeader().magic, 4) != 0) {
+            logger(EWarn, "ignoring invalid BVH %s", source);
+            return false;
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if (header.version != CacheVersion || header.key != key) {
+            logger(EInfo,
+                   "ignoring BVH %s, which was built with other settings",
+                   source);
+            return false;
+        }
+        if (header.nodeCount == 0 ||
+            size != sizeof(header) + header.nodeCount * sizeof(Node) +
+                        header.primitiveIndexCount * sizeof(NodeIndex)) {
+            logger(EWarn, "ignoring invalid BVH %s", source);
+            return false;
+        }
+
+        const uint8_t *nodes   = data + sizeof(header);
+        const uint8_t *indices = nodes + header.nodeCount * sizeof(Node);
+        m_nodes.resize(header.nodeCount);
+        m_primitiveIndices.resize(header.primitiveIndexCount);
+        std::memcpy(m_nodes.data(), nodes, m_nodes.size() * sizeof(Node));
+        std::memcpy(m_primitiveIndices.data(),
+                    indices,
+                    m_primitiveIndices.size() * sizeof(NodeIndex));
+
+        if (!validateBinaryTree()) {
+            logger(EWarn, "ignoring corrupt BVH %s", source);
+            m_nodes.clear();
+            m_primitiveIndices.clear();
+            return false;
+        }
+
+        m_nodeCosts.clear();
+        m_bounds = rootNode().aabb;
         logger(EInfo,
-               "built BVH with %ld nodes for %ld primitives in %.1f ms",
+               "loaded BVH with %ld nodes for %ld primitives from %s in "
+               "%.1f ms",
                m_nodes.size(),
                numberOfPrimitives(),
-               buildTimer.getElapsedTime() * 1000);
+               source,
+               loadTimer.getElapsedTime() * 1000);
+        return true;
+    }
+
+    /// @brief Checks that all indices of a loaded binary tree are in range
+    /// and that it does not exceed the maximum depth, so that corrupt cache
+    /// files cannot cause out-of-bounds accesses.
+    bool validateBinaryTree() const {
+        const auto nodeCount  = int64_t(m_nodes.size());
+        const auto indexCount = int64_t(m_primitiveIndices.size());
+        // children are always stored after their parents. the indices are
+        // checked in 64 bits, as corrupt values would overflow NodeIndex
+        std::vector<int> depth(m_nodes.size(), 0);
+        for (NodeIndex i = 0; i < nodeCount; i++) {
+            const Node &node = m_nodes[i];
+            if (node.primitiveCount < 0)
+                return false;
+            if (node.isLeaf()) {
+                if (node.leftFirst < 0 ||
+                    int64_t(node.leftFirst) + node.primitiveCount > indexCount)
+                    return false;
+                continue;
+            }
+            if (node.leftFirst <= i ||
+                int64_t(node.leftFirst) + 1 >= nodeCount ||
+                depth[i] >= bvh::MaxDepth)
+                return false;
+            depth[node.leftChildIndex()]  = depth[i] + 1;
+            depth[node.rightChildIndex()] = depth[i] + 1;
+        }
+        for (const NodeIndex index : m_primitiveIndices) {
+            if (index < 0 || index >= numberOfPrimitives())
+                return false;
+        }
+        return true;
+    }
+
+    /// @brief Writes the binary tree in the format read by @ref
+    /// readBinaryTree .
+    void writeBinaryTree(std::ostream &stream, uint64_t key) const {
+        CacheHeader header;
+        header.key                 = key;
+        header.nodeCount           = m_nodes.size();
+        header.primitiveIndexCount = m_primitiveIndices.size();
+
+        stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        stream.write(reinterpret_cast<const char *>(m_nodes.data()),
+                     m_nodes.size() * sizeof(Node));
+        stream.write(reinterpret_cast<const char *>(m_primitiveIndices.data()),
+                     m_primitiveIndices.size() * sizeof(NodeIndex));
+    }
+
+    /// @brief Stores the binary tree in a cache file.
+    void saveBinaryTree(const std::filesystem::path &file,
+                        uint64_t key) const {
+        // write to a temporary file first, so that other processes never
+        // load a partially written cache
+        std::filesystem::path temporary = file;
+        temporary += tfm::format(".%08x.tmp", std::random_device()());
+
+        std::error_code error;
+        std::filesystem::create_directories(file.parent_path(), error);
+        {
+            std::ofstream stream(temporary, std::ios::binary);
+            writeBinaryTree(stream, key);
+            if (!stream) {
+                error = std::make_error_code(std::errc::io_error);
+            }
+        }
+        if (!error) {
+            std::filesystem::rename(temporary, file, error);
+        }
+        if (error) {
+            logger(EWarn,
+                   "could not write BVH cache \"%s\": %s",
+                   file.generic_string(),
+                   error.message());
+            std::filesystem::remove(temporary, error);
+        }
+    }
+
+    /// @brief Creates the wide (and compressed) nodes from the binary tree,
+    /// depending on the layout.
+    void buildWideTree() {
+        if (m_layout == Layout::Wide4) {
+            collapseBinaryTree(m_wideNodes4);
+            if (m_compress)
+                compressWideTree(m_wideNodes4, m_compressedNodes4);
+        } else if (m_layout == Layout::Wide8) {
+            collapseBinaryTree(m_wideNodes8);
+            if (m_compress)
+                compressWideTree(m_wideNodes8, m_compressedNodes8);
+        }
+    }
+
+    /**
+     * @brief Creates the nodes used for traversal once the binary tree is
+     * complete. Statistics and the node dump are produced before, since wide
+     * BVHs might discard the binary tree.
+     */
+    void finishBuild() {
+        if (m_primitiveIndices.empty()) {
+            buildWideTree();
+            return; // the root is not a valid node in this case
+        }
+
+        std::optional<Statistics> statistics;
+        if (m_statistics)
+            statistics = computeStatistics();
+        if (!m_statisticsFile.empty())
+            dumpNodes(m_statisticsFile);
+        buildWideTree();
+        if (statistics)
+            logStatistics(*statistics);
+    }
+
+    /// @brief Replaces a wide BVH by its compressed version.
+    template <int Width>
+    void compressWideTree(std::vector<WideNode<Width>> &wideNodes,
+                          std::vector<CompressedNode<Width>> &nodes) {
+        Timer compressTimer;
+        compressTree(wideNodes, nodes);
+
+        const size_t wideSize = wideNodes.size() * sizeof(WideNode<Width>);
+        const size_t compressedSize =
+            nodes.size() * sizeof(CompressedNode<Width>);
+        const float wideCost       = sahCost(wideNodes);
+        const float compressedCost = sahCost(nodes);
+        logger(EInfo,
+               "compressed BVH nodes in %.1f ms: %.2f MiB instead of %.2f MiB "
+               "(%.1f%% saved), SAH cost %.2f instead of %.2f (%+.1f%%)",
+               compressTimer.getElapsedTime() * 1000,
+               compressedSize / (1024.0 * 1024.0),
+               wideSize / (1024.0 * 1024.0),
+               wideSize > 0 ? 100.0 * (1 - double(compressedSize) / wideSize)
+                            : 0.0,
+               compressedCost,
+               wideCost,
+               wideCost > 0 ? 100 * (compressedCost / wideCost - 1) : 0.0f);
+
+        // the uncompressed nodes are no longer needed for traversal
+        wideNodes.clear();
+        wideNodes.shrink_to_fit();
+    }
+
+    /// @brief Replaces the binary BVH by a wide BVH with the given nodes.
+    template <int Width>
+    void collapseBinaryTree(std::vector<WideNode<Width>> &nodes) {
+        Timer collapseTimer;
+        nodes.clear();
+        if (!m_primitiveIndices.empty()) {
+            nodes.reserve(m_nodes.size() / (Width - 1) + 1);
+            collapse(rootNode(), nodes);
+        }
+        nodes.shrink_to_fit();
+
+        logger(EInfo,
+               "collapsed %ld binary BVH nodes into %ld %d-wide nodes in "
+               "%.1f ms",
+               m_nodes.size(),
+               nodes.size(),
+               Width,
+               collapseTimer.getElapsedTime() * 1000);
+
+        // the binary tree is no longer needed for traversal (unless the BVH
+        // is refit later)
+        if (!m_dynamic) {
+            m_nodes.clear();
+            m_nodes.shrink_to_fit();
+        }
+    }
+
+    AccelerationStructure() = default;
+
+    /// @brief Reads the options of the acceleration structure from the given
+    /// properties.
+    AccelerationStructure(const Properties &properties) {
+        m_layout = properties.getEnum<Layout>("bvh",
+                                              Layout::Binary,
+                                              {
+                                                  { "bvh2", Layout::Binary },
+                                                  { "bvh4", Layout::Wide4 },
+                                                  { "bvh8", Layout::Wide8 },
+                                              });
+        m_compress = properties.get<bool>("compress", false);
+        m_builder  = properties.getEnum<Builder>(
+            "builder",
+            Builder::SAH,
+            {
+                { "sah", Builder::SAH },
+                { "sbvh", Builder::SpatialSplits },
+                { "lbvh", Builder::Linear },
+            });
+        m_nodeOrder = properties.getEnum<NodeOrder>(
+            "nodeOrder",
+            NodeOrder::DepthFirst,
+            {
+                { "build", NodeOrder::Build },
+                { "depthfirst", NodeOrder::DepthFirst },
+                { "treelets", NodeOrder::Treelets },
+            });
+        m_splitBudget =
+            std::max(properties.get<float>("splitBudget", m_splitBudget), 0.f);
+        m_dynamic = properties.get<bool>("dynamic", false);
+        m_leafSize =
+            std::max(properties.get<int>("leafSize", m_leafSize), 1);
+        m_rebuildThreshold =
+            properties.get<float>("rebuildThreshold", m_rebuildThreshold);
+        m_reorderPrimitives =
+            properties.get<bool>("reorderPrimitives", m_reorderPrimitives);
+        m_statistics = properties.get<bool>("statistics", m_statistics);
+        m_statisticsFile =
+            properties.get<std::filesystem::path>("statisticsFile", {});
+        if (m_compress && m_layout == Layout::Binary) {
+            logger(EWarn,
+                   "BVH compression requires a wide BVH, using bvh4 instead");
+            m_layout = Layout::Wide4;
+        }
     }
 
 public:
+    /**
+     * @brief Updates the BVH after the bounding boxes of the primitives have
+     * changed (e.g., because a mesh was deformed). The bounds of all nodes
+     * are recomputed bottom-up, and subtrees whose SAH cost has grown by
+     * more than the @c rebuildThreshold property are rebuilt.
+     * @note Wide BVHs can only be refit if the @c dynamic property is set,
+     * otherwise they are rebuilt from scratch.
+     * @note The spatial split builder references primitives from several
+     * subtrees, hence its subtrees are only refit and never rebuilt.
+     */
+    void refitAccelerationStructure() {
+        if (m_nodes.empty()) {
+            // the binary tree has been discarded after collapsing it
+            buildAccelerationStructure();
+            return;
+        }
+        if (m_primitiveIndices.empty())
+            return;
+
+        Timer refitTimer;
+        if (m_nodeCosts.empty()) {
+            // the nodes still have the bounds they were built with
+            m_nodeCosts.resize(m_nodes.size());
+            computeCosts(0, m_nodeCosts);
+        }
+
+        std::vector<float> costs(m_nodes.size());
+        refitNode(0,
+                  costs,
+                  numberOfPrimitives() >= bvh::ParallelSubtreeThreshold
+                      ? ParallelRefitDepth
+                      : 0);
+
+        std::vector<std::pair<NodeIndex, int>> degraded;
+        if (m_builder != Builder::SpatialSplits)
+            findDegradedSubtrees(0, 0, costs, degraded);
+
+        // the primitives are only fetched once for all rebuilt subtrees
+        BuildContext ctx;
+        if (!degraded.empty())
+            fetchPrimitives(ctx);
+
+        NodeIndex rebuiltPrimitives = 0;
+        for (const auto &[index, depth] : degraded)
+            rebuiltPrimitives += rebuildSubtree(index, depth, ctx);
+        if (!degraded.empty()) {
+            reorderNodes();
+            // rebuilding partitions the primitive indices anew
+            permuteToLeafOrder();
+        }
+        m_bounds = rootNode().aabb;
+
+        logger(EInfo,
+               "refit BVH with %ld nodes in %.1f ms, rebuilt %ld subtrees "
+               "with %ld primitives",
+               m_nodes.size(),
+               refitTimer.getElapsedTime() * 1000,
+               degraded.size(),
+               rebuiltPrimitives);
+
+        finishBuild();
+    }
+
+    bool findHit(const Ray &ray, Intersection &its,
+                 Sampler &rng) const override {
+        return intersectPrimitives(ray, its, [&](int primitiveIndex) {
+            return intersect(primitiveIndex, ray, its, rng);
+        });
+    }
+
     bool intersect(const Ray &ray, Intersection &its,
                    Sampler &rng) const override {
-        if (m_primitiveIndices.empty())
-            return false; // exit early if no children exist
-        if (intersectAABB(rootNode().aabb, ray) <
-            its.t) // test root bounding box for potential hit
-            return intersectNode(rootNode(), ray, its, rng);
-        return false;
+        if (!findHit(ray, its, rng))
+            return false;
+        completeHit(ray, its);
+        return true;
     }
 
-    Bounds getBoundingBox() const override { return rootNode().aabb; }
+    /**
+     * @brief Finds the closest hits of a packet of rays. Binary BVHs are
+     * traversed by the whole packet at once, while wide BVHs (whose nodes
+     * already test several children at once) trace the rays one by one.
+     */
+    int findHitPacket(const RayPacket &packet, int mask,
+                      Intersection *its) const override {
+        return intersectPrimitives(
+            packet, mask, its, [&](int primitiveIndex, int active) {
+                return intersectPacket(primitiveIndex, packet, active, its);
+            });
+    }
+
+    int intersectPacket(const RayPacket &packet, int mask,
+                        Intersection *its) const override {
+        const int hits = findHitPacket(packet, mask, its);
+        completeHits(packet, hits, its);
+        return hits;
+    }
+
+    bool occluded(const Ray &ray, float tMax, Sampler &rng) const override {
+        return occludedPrimitives(ray, tMax, [&](int primitiveIndex) {
+            return occluded(primitiveIndex, ray, tMax, rng);
+        });
+    }
 
-    Point getCentroid() const override { return rootNode().aabb.center(); }
+    Bounds getBoundingBox() const override { return m_bounds; }
+
+    Point getCentroid() const override { return m_bounds.center(); }
+};
+
+/**
+ * @brief An acceleration structure that calls the per-primitive methods of @c
+ * Derived directly instead of through virtual calls, which allows the
+ * compiler to inline them into the traversal loops and the gathering of
+ * primitive bounds before a build.
+ *
+ * Subclasses pass themselves as template argument (CRTP) and implement the
+ * same methods as for @ref AccelerationStructure . If these are not public,
+ * the subclass needs to befriend this class. Users of the shape still go
+ * through the virtual @ref Shape interface, which is only called once per ray.
+ */
+template <typename Derived>
+class StaticAccelerationStructure : public AccelerationStructure {
+    const Derived &derived() const {
+        return static_cast<const Derived &>(*this);
+    }
+
+protected:
+    using AccelerationStructure::AccelerationStructure;
+
+    void getPrimitiveBounds(Range range, Bounds *bounds,
+                            Point *centroids) const override {
+        for (int i : range) {
+            bounds[i]    = derived().Derived::getBoundingBox(i);
+            centroids[i] = derived().Derived::getCentroid(i);
+        }
+    }
+
+    bool occluded(int primitiveIndex, const Ray &ray, float tMax,
+                  Sampler &rng) const override {
+        Intersection its(-ray.direction, tMax);
+        return derived().Derived::intersect(primitiveIndex, ray, its, rng);
+    }
+
+    int intersectPacket(int primitiveIndex, const RayPacket &packet, int mask,
+                        Intersection *its) const override {
+        int hits = 0;
+        for (int m = mask; m; m &= m - 1) {
+            const int i = simd::firstBit(m);
+            if (derived().Derived::intersect(
+                    primitiveIndex, packet.rays[i], its[i], *packet.rng[i]))
+                hits |= 1 << i;
+        }
+        return hits;
+    }
+
+public:
+    bool findHit(const Ray &ray, Intersection &its,
+                 Sampler &rng) const override {
+        return intersectPrimitives(ray, its, [&](int primitiveIndex) {
+            return derived().Derived::intersect(primitiveIndex, ray, its, rng);
+        });
+    }
+
+    bool intersect(const Ray &ray, Intersection &its,
+                   Sampler &rng) const override {
+        if (!derived().Derived::findHit(ray, its, rng))
+            return false;
+        completeHit(ray, its);
+        return true;
+    }
+
+    int findHitPacket(const RayPacket &packet, int mask,
+                      Intersection *its) const override {
+        return intersectPrimitives(
+            packet, mask, its, [&](int primitiveIndex, int active) {
+                return derived().Derived::intersectPacket(
+                    primitiveIndex, packet, active, its);
+            });
+    }
+
+    int intersectPacket(const RayPacket &packet, int mask,
+                        Intersection *its) const override {
+        const int hits = derived().Derived::findHitPacket(packet, mask, its);
+        completeHits(packet, hits, its);
+        return hits;
+    }
+
+    bool occluded(const Ray &ray, float tMax, Sampler &rng) const override {
+        return occludedPrimitives(ray, tMax, [&](int primitiveIndex) {
+            return derived().Derived::occluded(
+                primitiveIndex, ray, tMax, rng);
+        });
+    }
 };
 
 } // namespace lightwave
@@ -0,0 +1,275 @@
+/**
+ * @file bvh.hpp
+ * @brief The nodes of binary BVHs and the parts shared by the algorithms that
+ * build them (see @ref AccelerationStructure ).
+ */
+
+#pragma once
+
+#include <lightwave/core.hpp>
+#include <lightwave/iterators.hpp>
+#include <lightwave/math.hpp>
+#include <lightwave/parallel.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lightwave::bvh {
+
+/// @brief The datatype used to index BVH nodes and the primitive index
+/// remapping.
+typedef int32_t NodeIndex;
+
+/// @brief A node in our binary BVH tree.
+struct Node {
+    /// @brief The axis aligned bounding box of this node.
+    Bounds aabb;
+    /**
+     * @brief Either the index of the left child node in m_nodes (for
+     * internal nodes), or the first primitive in m_primitiveIndices
+     * (for leaf nodes).
+     * @note For efficiency, we store the BVH nodes so that the right
+     * child always directly follows the left child, i.e., the index of
+     * the right child is always @code leftFirst + 1 @endcode .
+     * @note For efficiency, we store primitives so that children of a
+     * leaf node are always contigous in m_primitiveIndices.
+     */
+    NodeIndex leftFirst;
+    /// @brief The number of primitives in a leaf node, or 0 to indicate
+    /// that this node is not a leaf node.
+    NodeIndex primitiveCount;
+
+    /// @brief Whether this BVH node is a leaf node.
+    bool isLeaf() const { return primitiveCount != 0; }
+
+    /// @brief For internal nodes: The index of the left child node in
+    /// m_nodes.
+    NodeIndex leftChildIndex() const { return leftFirst; }
+    /// @brief For internal nodes: The index of the right child node in
+    /// m_nodes.
+    NodeIndex rightChildIndex() const { return leftFirst + 1; }
+
+    /// @brief For leaf nodes: The first index in m_primitiveIndices.
+    NodeIndex firstPrimitiveIndex() const { return leftFirst; }
+    /// @brief For leaf nodes: The last index in m_primitiveIndices
+    /// (still included).
+    NodeIndex lastPrimitiveIndex() const {
+        return leftFirst + primitiveCount - 1;
+    }
+};
+
+/// @brief The maximum depth of the BVH, which bounds the size of the
+/// stack needed for traversal.
+constexpr int MaxDepth = 64;
+/// @brief The number of bins used per axis when evaluating the SAH.
+constexpr NodeIndex BinCount = 16;
+/// @brief Subtrees with at least this many primitives are handed to a
+/// separate thread during the build.
+constexpr NodeIndex ParallelSubtreeThreshold = 4096;
+/// @brief Nodes with at least this many primitives have their primitive
+/// range processed in parallel chunks (binning and bounding boxes).
+constexpr NodeIndex ParallelRangeThreshold = 65536;
+/// @brief The number of primitives processed by each parallel chunk.
+constexpr NodeIndex ParallelChunkSize = 16384;
+
+/// @brief Computes the surface area of a bounding box.
+inline float surfaceArea(const Bounds &bounds) {
+    const auto size = bounds.diagonal();
+    return 2 * (size.x() * size.y() + size.x() * size.z() +
+                size.y() * size.z());
+}
+
+struct Bin {
+    Bounds aabb;
+    NodeIndex primitiveCount = 0;
+
+    inline void add(Bounds bounds) {
+        aabb.extend(bounds);
+        primitiveCount++;
+    }
+
+    inline void add(const Bin &other) {
+        aabb.extend(other.aabb);
+        primitiveCount += other.primitiveCount;
+    }
+};
+
+/// @brief State shared by all threads that take part in building the BVH.
+struct BuildContext {
+    /// @brief The number of nodes in m_nodes that have been handed out so
+    /// far.
+    std::atomic<NodeIndex> nodeCount{ 0 };
+    /// @brief The accumulated CPU time (in microseconds) that all threads
+    /// have spent on the build, used to report how many cores were busy.
+    std::atomic<int64_t> cpuTime{ 0 };
+    /// @brief The number of threads currently building subtrees. While
+    /// there are any, the cores are already busy and primitive ranges are
+    /// processed serially instead of spawning further threads.
+    std::atomic<int> subtreeWorkers{ 0 };
+    /// @brief The number of entries in m_primitiveIndices that have been
+    /// handed out to leaves so far (only used by the spatial split
+    /// builder).
+    std::atomic<NodeIndex> referenceCount{ 0 };
+    /// @brief The number of references that may still be added by spatial
+    /// splits.
+    std::atomic<NodeIndex> splitBudget{ 0 };
+    /// @brief The surface area of the root node, used to decide whether
+    /// spatial splits are worth trying.
+    float rootArea = 0;
+    /// @brief The bounding boxes of all primitives, fetched once before
+    /// the build (the SAH builder visits every primitive on every level).
+    std::vector<Bounds> primitiveBounds;
+    /// @brief The centroids of all primitives.
+    std::vector<Point> primitiveCentroids;
+
+    /// @brief Adds the CPU time the calling thread spent since @c start
+    /// (as reported by @ref threadCpuTime ).
+    void addCpuTime(double start) {
+        cpuTime += int64_t((threadCpuTime() - start) * 1e6);
+    }
+};
+
+/// @brief The number of threads that may still be spawned for building
+/// subtrees, shared by all acceleration structures that are built
+/// concurrently.
+inline std::atomic<int> freeBuildThreads{ int(
+    std::thread::hardware_concurrency()) };
+
+/// @brief Attempts to reserve a thread from the build thread budget.
+inline bool acquireBuildThread() {
+#ifdef SINGLE_THREADED
+    return false;
+#endif
+    int available = freeBuildThreads.load();
+    while (available > 0) {
+        if (freeBuildThreads.compare_exchange_weak(available, available - 1))
+            return true;
+    }
+    return false;
+}
+
+/// @brief Returns a thread to the build thread budget.
+inline void releaseBuildThread() { freeBuildThreads++; }
+
+/**
+ * @brief Base class of the algorithms that build a binary BVH. Builders
+ * operate on the nodes and primitive indices of an acceleration structure,
+ * and read the bounding boxes and centroids of the primitives from the @ref
+ * BuildContext .
+ */
+class BinaryTreeBuilder {
+protected:
+    /// @brief The nodes of the tree, the root is always the first element.
+    std::vector<Node> &m_nodes;
+    /// @brief The primitives referenced by the leaves (see @ref Node ).
+    std::vector<int> &m_primitiveIndices;
+    /// @brief The number of primitives up to which nodes are not split any
+    /// further.
+    NodeIndex m_leafSize;
+
+    /**
+     * @brief Makes room at the end of m_nodes for a subtree with up to @c
+     * leafCount leaves, whose nodes are then handed out by @ref
+     * allocateChildren . A binary tree with n leaves has at most 2n - 1 nodes,
+     * so m_nodes is never reallocated during the build, and references to its
+     * nodes remain valid while other threads add nodes.
+     */
+    void reserveNodes(NodeIndex leafCount, BuildContext &ctx) {
+        ctx.nodeCount = NodeIndex(m_nodes.size());
+        m_nodes.resize(m_nodes.size() + std::max(2 * leafCount - 1, 1));
+    }
+
+    /// @brief Replaces m_nodes by the nodes of a new tree with up to @c
+    /// leafCount leaves (see @ref reserveNodes ), and returns its root.
+    Node &allocateRoot(NodeIndex leafCount, BuildContext &ctx) {
+        m_nodes.clear();
+        reserveNodes(leafCount, ctx);
+        return m_nodes[ctx.nodeCount++];
+    }
+
+    /// @brief Turns a node into an internal node with two newly allocated
+    /// children, and returns the index of the left child. The right child
+    /// always directly follows it.
+    NodeIndex allocateChildren(Node &parent, BuildContext &ctx) {
+        const NodeIndex leftChildIndex = ctx.nodeCount.fetch_add(2);
+        parent.primitiveCount = 0; // mark the parent node as internal node
+        parent.leftFirst      = leftChildIndex;
+        return leftChildIndex;
+    }
+
+    /**
+     * @brief Splits a leaf into two children (see @ref allocateChildren ),
+     * where the left child receives the primitives of the leaf before @c
+     * firstRightIndex and the right child receives the remaining ones.
+     */
+    NodeIndex splitLeaf(Node &leaf, NodeIndex firstRightIndex,
+                        BuildContext &ctx) {
+        const NodeIndex first          = leaf.firstPrimitiveIndex();
+        const NodeIndex count          = leaf.primitiveCount;
+        const NodeIndex leftChildIndex = allocateChildren(leaf, ctx);
+
+        m_nodes[leftChildIndex].leftFirst      = first;
+        m_nodes[leftChildIndex].primitiveCount = firstRightIndex - first;
+
+        m_nodes[leftChildIndex + 1].leftFirst = firstRightIndex;
+        m_nodes[leftChildIndex + 1].primitiveCount =
+            first + count - firstRightIndex;
+        return leftChildIndex;
+    }
+
+    /**
+     * @brief Invokes @c f for all primitives of a node, split into ranges of
+     * indices into m_primitiveIndices. For large nodes near the root, the
+     * ranges are processed in parallel, hence @c f must be safe to call
+     * concurrently. Once subtrees are built on separate threads, nested
+     * parallel loops would only oversubscribe the cores.
+     */
+    template <typename F>
+    void forEachPrimitiveRange(const Node &node, BuildContext &ctx, F f) {
+        const Range range(node.firstPrimitiveIndex(),
+                          node.lastPrimitiveIndex() + 1);
+#ifdef SINGLE_THREADED
+        f(range);
+        return;
+#endif
+        if (node.primitiveCount < ParallelRangeThreshold ||
+            ctx.subtreeWorkers > 0) {
+            f(range);
+            return;
+        }
+
+        for_each_parallel(ChunkedRange(node.firstPrimitiveIndex(),
+                                       node.lastPrimitiveIndex() + 1,
+                                       ParallelChunkSize),
+                          [&](Range chunk) {
+                              const double start = threadCpuTime();
+                              f(chunk);
+                              ctx.addCpuTime(start);
+                          });
+    }
+
+    /// @brief Computes the axis aligned bounding box for a leaf BVH node
+    void computeAABB(Node &node, BuildContext &ctx) {
+        std::mutex mutex;
+        node.aabb = Bounds::empty();
+        forEachPrimitiveRange(node, ctx, [&](Range range) {
+            Bounds aabb;
+            for (NodeIndex i : range) {
+                aabb.extend(ctx.primitiveBounds[m_primitiveIndices[i]]);
+            }
+
+            std::unique_lock lock{ mutex };
+            node.aabb.extend(aabb);
+        });
+    }
+
+public:
+    BinaryTreeBuilder(std::vector<Node> &nodes,
+                      std::vector<int> &primitiveIndices, NodeIndex leafSize)
+        : m_nodes(nodes), m_primitiveIndices(primitiveIndices),
+          m_leafSize(leafSize) {}
+};
+
+} // namespace lightwave::bvh
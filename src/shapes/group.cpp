@@ -11,7 +11,9 @@ namespace lightwave {
  * provides noticeable speed-up by using an acceleration structure under the
  * hood.
  */
-class Group final : public AccelerationStructure {
+class Group final : public StaticAccelerationStructure<Group> {
+    friend StaticAccelerationStructure;
+
     std::vector<ref<Shape>> m_children;
 
 protected:
@@ -19,7 +21,18 @@ protected:
 
     bool intersect(int primitiveIndex, const Ray &ray, Intersection &its,
                    Sampler &rng) const override {
-        return m_children[primitiveIndex]->intersect(ray, its, rng);
+        // the surface data is only computed for the closest child
+        return m_children[primitiveIndex]->findHit(ray, its, rng);
+    }
+
+    bool occluded(int primitiveIndex, const Ray &ray, float tMax,
+                  Sampler &rng) const override {
+        return m_children[primitiveIndex]->occluded(ray, tMax, rng);
+    }
+
+    int intersectPacket(int primitiveIndex, const RayPacket &packet, int mask,
+                        Intersection *its) const override {
+        return m_children[primitiveIndex]->findHitPacket(packet, mask, its);
     }
 
     Bounds getBoundingBox(int primitiveIndex) const override {
@@ -30,8 +43,17 @@ protected:
         return m_children[primitiveIndex]->getCentroid();
     }
 
+    bool permutePrimitives(const std::vector<int> &order) override {
+        std::vector<ref<Shape>> children(order.size());
+        for (size_t i = 0; i < order.size(); i++)
+            children[i] = std::move(m_children[order[i]]);
+        m_children = std::move(children);
+        return true;
+    }
+
 public:
-    Group(const Properties &properties) {
+    Group(const Properties &properties)
+        : StaticAccelerationStructure(properties) {
         m_children = properties.getChildren<Shape>();
         buildAccelerationStructure();
     }
@@ -41,6 +63,11 @@ public:
             child->markAsVisible();
     }
 
+    void prepareAreaSampling(const Emission *emission) override {
+        for (auto &child : m_children)
+            child->prepareAreaSampling(emission);
+    }
+
     AreaSample sampleArea(Sampler &rng) const override {
         int childIndex = int(rng.next() * m_children.size());
         childIndex     = std::min(childIndex, int(m_children.size()) - 1);
@@ -0,0 +1,235 @@
+/**
+ * @file lbvhbuilder.hpp
+ * @brief Builds binary BVHs by sorting the primitives along a Morton curve
+ * (LBVH).
+ */
+
+#pragma once
+
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+namespace lightwave::bvh {
+
+/**
+ * @brief Builds the binary tree by sorting the primitives along a Morton
+ * curve and splitting at the highest differing bit, which is much faster
+ * than the SAH builders but yields worse trees.
+ */
+class LinearBuilder : public BinaryTreeBuilder {
+    /// @brief A primitive along with the Morton code of its centroid.
+    struct MortonPrimitive {
+        uint64_t code;
+        NodeIndex primitiveIndex;
+    };
+
+    /// @brief The number of bits sorted by each pass of the radix sort.
+    static constexpr int RadixBits = 8;
+    /// @brief Meshes with up to this many primitives use 30-bit Morton codes,
+    /// larger meshes use 63-bit codes to avoid running out of precision.
+    static constexpr NodeIndex ShortMortonCodeThreshold = 1 << 20;
+
+    /// @brief Inserts two zero bits after each of the lowest 21 bits of @c x ,
+    /// so that three such values can be interleaved into a Morton code.
+    static uint64_t expandBits(uint64_t x) {
+        x &= 0x1fffff;
+        x = (x | x << 32) & 0x1f00000000ffff;
+        x = (x | x << 16) & 0x1f0000ff0000ff;
+        x = (x | x << 8) & 0x100f00f00f00f00f;
+        x = (x | x << 4) & 0x10c30c30c30c30c3;
+        x = (x | x << 2) & 0x1249249249249249;
+        return x;
+    }
+
+    /// @brief Interleaves the bits of the three (quantized) coordinates.
+    static uint64_t mortonCode(uint64_t x, uint64_t y, uint64_t z) {
+        return expandBits(x) << 2 | expandBits(y) << 1 | expandBits(z);
+    }
+
+    /**
+     * @brief Sorts the primitives by their Morton codes, of which only the
+     * lowest @c bits may be set. Every pass of the (least significant digit)
+     * radix sort counts the digits of parallel chunks, from which the
+     * position of every primitive follows, and then scatters the chunks in
+     * parallel.
+     */
+    static void radixSort(std::vector<MortonPrimitive> &primitives, int bits,
+                          BuildContext &ctx) {
+        constexpr int BucketCount = 1 << RadixBits;
+        const NodeIndex count     = NodeIndex(primitives.size());
+        const NodeIndex chunkSize = std::max(
+            ParallelChunkSize,
+            NodeIndex(count / std::max(std::thread::hardware_concurrency(),
+                                       1u) +
+                      1));
+        const int chunkCount = (count + chunkSize - 1) / chunkSize;
+
+        std::vector<MortonPrimitive> sorted(primitives.size());
+        std::vector<std::array<NodeIndex, BucketCount>> offsets(chunkCount);
+        const auto forEachChunk = [&](auto f) {
+            for_each_parallel(Range(0, chunkCount), [&](int chunk) {
+                const double start = threadCpuTime();
+                f(chunk,
+                  chunk * chunkSize,
+                  std::min(count, (chunk + 1) * chunkSize));
+                ctx.addCpuTime(start);
+            });
+        };
+
+        for (int shift = 0; shift < bits; shift += RadixBits) {
+            const auto digit = [&](const MortonPrimitive &primitive) {
+                return (primitive.code >> shift) & (BucketCount - 1);
+            };
+
+            forEachChunk([&](int chunk, NodeIndex first, NodeIndex last) {
+                auto &histogram = offsets[chunk];
+                histogram.fill(0);
+                for (NodeIndex i = first; i < last; i++)
+                    histogram[digit(primitives[i])]++;
+            });
+
+            // turn the histograms into offsets, where all chunks with the
+            // same digit follow each other to keep the sort stable
+            NodeIndex offset = 0;
+            for (int bucket = 0; bucket < BucketCount; bucket++) {
+                for (int chunk = 0; chunk < chunkCount; chunk++) {
+                    const NodeIndex bucketSize = offsets[chunk][bucket];
+                    offsets[chunk][bucket]     = offset;
+                    offset += bucketSize;
+                }
+            }
+
+            forEachChunk([&](int chunk, NodeIndex first, NodeIndex last) {
+                auto &next = offsets[chunk];
+                for (NodeIndex i = first; i < last; i++)
+                    sorted[next[digit(primitives[i])]++] = primitives[i];
+            });
+            primitives.swap(sorted);
+        }
+    }
+
+    /**
+     * @brief Builds the subtree of a node whose primitives have been sorted by
+     * their Morton codes, splitting at the highest bit in which the codes of
+     * the primitives differ. The bounds of the nodes are computed bottom-up.
+     */
+    void emit(NodeIndex nodeIndex,
+              const std::vector<MortonPrimitive> &primitives,
+              BuildContext &ctx, int depth) {
+        Node &node            = m_nodes[nodeIndex];
+        const NodeIndex first = node.firstPrimitiveIndex();
+        const NodeIndex count = node.primitiveCount;
+        if (count <= m_leafSize || depth >= MaxDepth) {
+            computeAABB(node, ctx);
+            return;
+        }
+
+        const uint64_t firstCode = primitives[first].code;
+        const uint64_t lastCode  = primitives[first + count - 1].code;
+        NodeIndex split;
+        if (firstCode == lastCode) {
+            // primitives with the same code cannot be told apart
+            split = first + count / 2;
+        } else {
+            // all codes of the range agree above the highest differing bit,
+            // hence the codes with this bit set form a suffix of the range
+            const uint64_t mask = uint64_t(1)
+                                  << (63 - std::countl_zero(firstCode ^
+                                                            lastCode));
+            split = NodeIndex(
+                std::partition_point(primitives.begin() + first,
+                                     primitives.begin() + first + count,
+                                     [&](const MortonPrimitive &primitive) {
+                                         return !(primitive.code & mask);
+                                     }) -
+                primitives.begin());
+        }
+
+        const NodeIndex leftChildIndex = splitLeaf(node, split, ctx);
+
+        std::thread worker;
+        if (split - first >= ParallelSubtreeThreshold && acquireBuildThread()) {
+            worker = std::thread([&, leftChildIndex, depth]() {
+                const double start = threadCpuTime();
+                emit(leftChildIndex, primitives, ctx, depth + 1);
+                ctx.addCpuTime(start);
+                releaseBuildThread();
+            });
+        } else {
+            emit(leftChildIndex, primitives, ctx, depth + 1);
+        }
+
+        emit(leftChildIndex + 1, primitives, ctx, depth + 1);
+
+        if (worker.joinable()) {
+            worker.join();
+        }
+
+        node.aabb = m_nodes[leftChildIndex].aabb;
+        node.aabb.extend(m_nodes[leftChildIndex + 1].aabb);
+    }
+
+public:
+    using BinaryTreeBuilder::BinaryTreeBuilder;
+
+    /// @brief Builds the tree over all primitives, whose centroids must have
+    /// been fetched into @c ctx .
+    void build(BuildContext &ctx) {
+        const NodeIndex primitiveCount =
+            NodeIndex(ctx.primitiveCentroids.size());
+        std::vector<MortonPrimitive> primitives(primitiveCount);
+        const std::vector<Point> &centroids = ctx.primitiveCentroids;
+        const auto forEachChunk = [&](auto f) {
+            for_each_parallel(ChunkedRange(primitiveCount, ParallelChunkSize),
+                              [&](Range chunk) {
+                                  const double start = threadCpuTime();
+                                  f(chunk);
+                                  ctx.addCpuTime(start);
+                              });
+        };
+
+        std::mutex mutex;
+        Bounds centroidBounds;
+        forEachChunk([&](Range chunk) {
+            Bounds bounds;
+            for (NodeIndex i : chunk)
+                bounds.extend(centroids[i]);
+            std::unique_lock lock{ mutex };
+            centroidBounds.extend(bounds);
+        });
+
+        // quantize the centroids to a grid of 2^bits cells along each axis
+        const int bits = primitiveCount <= ShortMortonCodeThreshold ? 10 : 21;
+        const float cells = float((1 << bits) - 1);
+        Vector scale;
+        for (int axis = 0; axis < 3; axis++) {
+            const float extent = centroidBounds.diagonal()[axis];
+            scale[axis]        = extent > 0 ? cells / extent : 0;
+        }
+        forEachChunk([&](Range chunk) {
+            for (NodeIndex i : chunk) {
+                const Vector cell =
+                    (centroids[i] - centroidBounds.min()) * scale;
+                primitives[i] = { mortonCode(uint64_t(cell.x()),
+                                             uint64_t(cell.y()),
+                                             uint64_t(cell.z())),
+                                  i };
+            }
+        });
+        radixSort(primitives, 3 * bits, ctx);
+
+        m_primitiveIndices.resize(primitiveCount);
+        for (NodeIndex i = 0; i < primitiveCount; i++)
+            m_primitiveIndices[i] = primitives[i].primitiveIndex;
+
+        auto &root          = allocateRoot(primitiveCount, ctx);
+        root.leftFirst      = 0;
+        root.primitiveCount = primitiveCount;
+        emit(0, primitives, ctx, 0);
+    }
+};
+
+} // namespace lightwave::bvh
@@ -1,37 +1,130 @@
 #include <lightwave.hpp>
 
+#include "../core/meshfile.hpp"
 #include "../core/plyparser.hpp"
 #include "accel.hpp"
 
+#include <future>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
 namespace lightwave {
 
 /**
- * @brief A shape consisting of many (potentially millions) of triangles, which
- * share an index and vertex buffer. Since individual triangles are rarely
- * needed (and would pose an excessive amount of overhead), collections of
- * triangles are combined in a single shape.
+ * @brief The triangles and vertices of a mesh file along with their BVH.
+ * Since they do not change once loaded, they can be shared by all mesh shapes
+ * that reference the same file with the same options (see @ref TriangleMesh
+ * ).
  */
-class TriangleMesh : public AccelerationStructure {
+class MeshGeometry final
+    : public StaticAccelerationStructure<MeshGeometry> {
     /**
      * @brief The index buffer of the triangles.
      * The n-th element corresponds to the n-th triangle, and each component of
-     * the element corresponds to one vertex index (into @c m_vertices ) of the
+     * the element corresponds to one vertex index (into @c m_positions ) of the
      * triangle. This list will always contain as many elements as there are
      * triangles.
      */
     std::vector<Vector3i> m_triangles;
     /**
-     * @brief The vertex buffer of the triangles, indexed by m_triangles.
+     * @brief The vertex positions of the triangles, indexed by m_triangles.
      * Note that multiple triangles can share vertices, hence there can also be
      * fewer than @code 3 * numTriangles @endcode vertices.
+     * The positions are kept apart from the other vertex attributes, which
+     * are only needed once a hit has been found.
      */
-    std::vector<Vertex> m_vertices;
+    std::vector<Point> m_positions;
+
+    /// @brief The texture coordinates and normal of a vertex.
+    struct VertexAttributes {
+        Vector2 uv;
+        Vector normal;
+    };
+    /// @brief The vertex attributes in full precision, indexed like @ref
+    /// m_positions (empty if @ref m_compactVertices is set).
+    std::vector<VertexAttributes> m_attributes;
+
+    /// @brief The vertex attributes in 8 bytes instead of 20.
+    struct PackedAttributes {
+        /// @brief The octahedral encoding of the normal, with 16 bits per
+        /// coordinate.
+        uint32_t normal;
+        /// @brief The texture coordinates, as 16 bit fixed point numbers
+        /// within the texture coordinate bounds of the mesh.
+        uint16_t uv[2];
+    };
+    /// @brief The vertex attributes in compact form, indexed like @ref
+    /// m_positions (empty unless @ref m_compactVertices is set).
+    std::vector<PackedAttributes> m_packedAttributes;
+    /// @brief The smallest texture coordinates of the mesh, which packed
+    /// texture coordinates are relative to.
+    Vector2 m_uvOrigin;
+    /// @brief The extent of the texture coordinates of the mesh.
+    Vector2 m_uvExtent;
+    /// @brief Whether to store the vertex attributes in compact form, which
+    /// saves memory for the price of a little precision.
+    bool m_compactVertices;
     /// @brief The file this mesh was loaded from, for logging and debugging
     /// purposes.
     std::filesystem::path m_originalPath;
-    /// @brief Whether to interpolate the normals from m_vertices, or report the
+    /// @brief Whether to interpolate the vertex normals, or report the
     /// geometric normal instead.
     bool m_smoothNormals;
+    /// @brief Whether normals generated for PLY files without any are shared
+    /// by vertices at the same position, which hides texture seams but also
+    /// smooths hard edges.
+    bool m_weldNormals;
+    /// @brief The directory in which the BVH is cached, or an empty path if
+    /// it should not be cached.
+    std::filesystem::path m_cacheDirectory;
+
+    /// @brief The algorithm used to intersect rays with the triangles.
+    enum class TriangleTest {
+        /// @brief Solves for the hit with Cramer's rule (four determinants).
+        Cramer,
+        /// @brief The Möller-Trumbore test, which shares cross products
+        /// between the barycentric coordinates and the distance.
+        MollerTrumbore,
+        /// @brief The watertight test by Woop et al., which never lets rays
+        /// slip through edges or vertices shared by neighboring triangles.
+        Watertight,
+    } m_triangleTest;
+    /// @brief Whether to store the first vertex and the two edges of every
+    /// triangle (in the order of m_triangles), which saves the indirection
+    /// through m_positions in the Möller-Trumbore test.
+    bool m_precomputeEdges;
+
+    /// @brief A triangle as used by the Möller-Trumbore test.
+    struct TriangleEdges {
+        Point origin;
+        Vector edge1;
+        Vector edge2;
+    };
+    /// @brief The precomputed edges of the triangles (see @ref
+    /// m_precomputeEdges ), or empty if they are computed on the fly.
+    std::vector<TriangleEdges> m_edges;
+
+    /// @brief The number of triangles that are intersected at once with SIMD
+    /// instructions (4 or 8), or 0 to intersect them one by one.
+    int m_blockWidth;
+
+    /**
+     * @brief The vertex positions of @c Width consecutive positions of the
+     * leaf ranges, stored as structure of arrays so that a ray can be tested
+     * against all of them at once. Positions past the end of the leaf ranges
+     * hold degenerate triangles.
+     */
+    template <int Width> struct TriangleBlock {
+        /// @brief Indexed as @code vertices[vertex][axis][lane] @endcode .
+        float vertices[3][3][Width];
+    };
+    /// @brief The blocks for a width of 4, covering the leaf ranges in order.
+    std::vector<TriangleBlock<4>> m_blocks4;
+    /// @brief The blocks for a width of 8.
+    std::vector<TriangleBlock<8>> m_blocks8;
+
+    friend StaticAccelerationStructure;
 
 protected:
     int numberOfPrimitives() const override { return int(m_triangles.size()); }
@@ -40,36 +133,156 @@ protected:
                          const Point &position, float u, float v) const {
         surf.position = position;
 
-        const Vertex v1 = m_vertices[m_triangles[primitiveIndex][0]];
-        const Vertex v2 = m_vertices[m_triangles[primitiveIndex][1]];
-        const Vertex v3 = m_vertices[m_triangles[primitiveIndex][2]];
-        surf.uv         = (1.f - u - v) * v1.uv + u * v2.uv + v * v3.uv;
-
-        const Vector v1v = Vector(v1.position);
-        const Vector v2v = Vector(v2.position);
-        const Vector v3v = Vector(v3.position);
+        const VertexAttributes v1 = attributes(m_triangles[primitiveIndex][0]);
+        const VertexAttributes v2 = attributes(m_triangles[primitiveIndex][1]);
+        const VertexAttributes v3 = attributes(m_triangles[primitiveIndex][2]);
+        surf.uv = interpolateBarycentric(Vector2(u, v), v1.uv, v2.uv, v3.uv);
 
-        surf.geometryNormal = (v2v - v1v).cross(v3v - v1v).normalized();
+        const TriangleEdges edges = triangleEdges(primitiveIndex);
+        surf.geometryNormal = edges.edge1.cross(edges.edge2).normalized();
 
         surf.shadingNormal =
-            m_smoothNormals ? Vertex::interpolate(Vector2(u, v), v1, v2, v3)
-                                  .normal.normalized()
-                            : surf.geometryNormal;
+            m_smoothNormals
+                ? interpolateBarycentric(
+                      Vector2(u, v), v1.normal, v2.normal, v3.normal)
+                      .normalized()
+                : surf.geometryNormal;
 
-        surf.tangent = (v2v - v1v).normalized();
+        surf.tangent = edges.edge1.normalized();
 
         surf.pdf = 0.0f;
     }
 
-    bool intersect(int primitiveIndex, const Ray &ray, Intersection &its,
-                   Sampler &rng) const override {
+    /// @brief Encodes a unit vector by projecting it onto an octahedron,
+    /// which is then unfolded into a square.
+    static uint32_t encodeOctahedral(const Vector &normal) {
+        const float norm =
+            std::abs(normal.x()) + std::abs(normal.y()) + std::abs(normal.z());
+        if (!(norm > 0))
+            return 0;
+        float x = normal.x() / norm;
+        float y = normal.y() / norm;
+        if (normal.z() < 0) {
+            // fold the lower half onto the corners of the square
+            const float fx = (1 - std::abs(y)) * (x < 0 ? -1 : 1);
+            const float fy = (1 - std::abs(x)) * (y < 0 ? -1 : 1);
+            x              = fx;
+            y              = fy;
+        }
+        const auto quantize = [](float value) {
+            return uint16_t(int16_t(std::round(clamp(value, -1.f, 1.f) * 32767)));
+        };
+        return uint32_t(quantize(x)) | uint32_t(quantize(y)) << 16;
+    }
+
+    /// @brief Decodes a unit vector encoded by @ref encodeOctahedral .
+    static Vector decodeOctahedral(uint32_t packed) {
+        float x       = int16_t(packed & 0xffff) / 32767.f;
+        float y       = int16_t(packed >> 16) / 32767.f;
+        const float z = 1 - std::abs(x) - std::abs(y);
+        if (z < 0) {
+            const float fx = (1 - std::abs(y)) * (x < 0 ? -1 : 1);
+            const float fy = (1 - std::abs(x)) * (y < 0 ? -1 : 1);
+            x              = fx;
+            y              = fy;
+        }
+        return Vector(x, y, z).normalized();
+    }
+
+    /// @brief Returns the texture coordinates and normal of a vertex, decoding
+    /// them if they are stored in compact form.
+    VertexAttributes attributes(int vertexIndex) const {
+        if (!m_compactVertices)
+            return m_attributes[vertexIndex];
+
+        const PackedAttributes &packed = m_packedAttributes[vertexIndex];
+        return {
+            .uv     = m_uvOrigin + Vector2(packed.uv[0] * m_uvExtent.x(),
+                                       packed.uv[1] * m_uvExtent.y()) /
+                                   65535,
+            .normal = decodeOctahedral(packed.normal),
+        };
+    }
+
+    /// @brief Splits the vertices into the position and attribute streams.
+    void storeVertices(const std::vector<Vertex> &vertices) {
+        m_positions.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+            m_positions[i] = vertices[i].position;
+
+        m_attributes.clear();
+        m_packedAttributes.clear();
+        if (!m_compactVertices) {
+            m_attributes.resize(vertices.size());
+            for (size_t i = 0; i < vertices.size(); i++)
+                m_attributes[i] = { vertices[i].uv, vertices[i].normal };
+            return;
+        }
+
+        Vector2 uvMin(Infinity), uvMax(-Infinity);
+        for (const Vertex &vertex : vertices) {
+            uvMin = elementwiseMin(uvMin, vertex.uv);
+            uvMax = elementwiseMax(uvMax, vertex.uv);
+        }
+        m_uvOrigin = vertices.empty() ? Vector2(0) : uvMin;
+        m_uvExtent = vertices.empty() ? Vector2(0) : uvMax - uvMin;
+
+        m_packedAttributes.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            PackedAttributes &packed = m_packedAttributes[i];
+            packed.normal            = encodeOctahedral(vertices[i].normal);
+            for (int dim = 0; dim < 2; dim++) {
+                const float relative =
+                    m_uvExtent[dim] > 0
+                        ? (vertices[i].uv[dim] - m_uvOrigin[dim]) /
+                              m_uvExtent[dim]
+                        : 0;
+                packed.uv[dim] = uint16_t(
+                    std::round(clamp(relative, 0.f, 1.f) * 65535));
+            }
+        }
+    }
 
+    /// @brief Returns the first vertex and the edges of a triangle.
+    TriangleEdges triangleEdges(int primitiveIndex) const {
+        if (!m_edges.empty())
+            return m_edges[primitiveIndex];
+
+        const Point &v1 = m_positions[m_triangles[primitiveIndex][0]];
+        const Point &v2 = m_positions[m_triangles[primitiveIndex][1]];
+        const Point &v3 = m_positions[m_triangles[primitiveIndex][2]];
+        return { v1, v2 - v1, v3 - v1 };
+    }
+
+    /// @brief Precomputes the edges of all triangles (if enabled), which needs
+    /// to happen whenever the vertices or the order of the triangles change.
+    void computeEdges() {
+        m_edges.clear();
+        // blocks store the vertices themselves
+        if (!m_precomputeEdges || m_blockWidth > 0 ||
+            m_triangleTest != TriangleTest::MollerTrumbore)
+            return;
+
+        std::vector<TriangleEdges> edges(m_triangles.size());
+        for_each_parallel(ChunkedRange(int(edges.size()), 16384),
+                          [&](Range chunk) {
+                              for (int i : chunk)
+                                  edges[i] = triangleEdges(i);
+                          });
+        m_edges = std::move(edges);
+    }
+
+    /// @brief Intersects a triangle by solving for the hit with Cramer's
+    /// rule.
+    inline bool intersectCramer(int primitiveIndex, const Ray &ray,
+                                float tMax, float &t, float &u,
+                                float &v) const {
         const Vector v1 =
-            Vector(m_vertices[m_triangles[primitiveIndex][0]].position);
+            Vector(m_positions[m_triangles[primitiveIndex][0]]);
         const Vector v2 =
-            Vector(m_vertices[m_triangles[primitiveIndex][1]].position);
+            Vector(m_positions[m_triangles[primitiveIndex][1]]);
         const Vector v3 =
-            Vector(m_vertices[m_triangles[primitiveIndex][2]].position);
+            Vector(m_positions[m_triangles[primitiveIndex][2]]);
 
         const Vector c = Vector(ray.origin) - v1;
 
@@ -85,9 +298,9 @@ protected:
 
         Matrix3x3 mt = m;
         mt.setColumn(0, c);
-        float t = mt.determinant() / detM;
+        t = mt.determinant() / detM;
 
-        if (t < Epsilon || t > its.t) {
+        if (t < Epsilon || t > tMax) {
             return false;
         }
 
@@ -95,31 +308,429 @@ protected:
         Matrix3x3 mv = m;
         mu.setColumn(1, c);
         mv.setColumn(2, c);
-        float u = mu.determinant() / detM;
-        float v = mv.determinant() / detM;
+        u = mu.determinant() / detM;
+        v = mv.determinant() / detM;
 
         if (u + v > 1.0f || u < 0.0f || v < 0.0f) {
             return false;
         }
 
-        its.t = t;
-        populate(primitiveIndex, its, ray(t), u, v);
+        return true;
+    }
+
+    /// @brief Intersects a triangle with the Möller-Trumbore test.
+    inline bool intersectMollerTrumbore(int primitiveIndex, const Ray &ray,
+                                        float tMax, float &t, float &u,
+                                        float &v) const {
+        const TriangleEdges edges = triangleEdges(primitiveIndex);
+
+        const Vector p  = ray.direction.cross(edges.edge2);
+        const float det = edges.edge1.dot(p);
+        if (det == 0)
+            return false; // the ray is parallel to the triangle
+
+        const float invDet = 1 / det;
+        const Vector s     = ray.origin - edges.origin;
+        u                  = s.dot(p) * invDet;
+        if (u < 0 || u > 1)
+            return false;
+
+        const Vector q = s.cross(edges.edge1);
+        v              = ray.direction.dot(q) * invDet;
+        if (v < 0 || u + v > 1)
+            return false;
+
+        t = edges.edge2.dot(q) * invDet;
+        return t >= Epsilon && t <= tMax;
+    }
+
+    /**
+     * @brief Intersects a triangle with the watertight test by Woop et al.
+     * The vertices are transformed into a space in which the ray points along
+     * the z-axis, where the edge functions of neighboring triangles are
+     * evaluated identically for their shared edge, so that no ray can pass
+     * between them.
+     */
+    inline bool intersectWatertight(int primitiveIndex, const Ray &ray,
+                                    float tMax, float &t, float &u,
+                                    float &v) const {
+        // permute the axes such that the direction is largest along z, and
+        // keep the winding of the triangle by swapping x and y if necessary
+        const Vector absDirection(abs(ray.direction.x()),
+                                  abs(ray.direction.y()),
+                                  abs(ray.direction.z()));
+        const int kz = absDirection.maxComponentIndex();
+        int kx       = (kz + 1) % 3;
+        int ky       = (kx + 1) % 3;
+        if (ray.direction[kz] < 0)
+            std::swap(kx, ky);
+
+        // shear constants that align the direction with the z-axis
+        const float sx = ray.direction[kx] / ray.direction[kz];
+        const float sy = ray.direction[ky] / ray.direction[kz];
+        const float sz = 1 / ray.direction[kz];
+
+        const Vector a =
+            m_positions[m_triangles[primitiveIndex][0]] - ray.origin;
+        const Vector b =
+            m_positions[m_triangles[primitiveIndex][1]] - ray.origin;
+        const Vector c =
+            m_positions[m_triangles[primitiveIndex][2]] - ray.origin;
+
+        const float ax = a[kx] - sx * a[kz];
+        const float ay = a[ky] - sy * a[kz];
+        const float bx = b[kx] - sx * b[kz];
+        const float by = b[ky] - sy * b[kz];
+        const float cx = c[kx] - sx * c[kz];
+        const float cy = c[ky] - sy * c[kz];
+
+        // scaled barycentric coordinates of the vertices
+        float e0 = cx * by - cy * bx;
+        float e1 = ax * cy - ay * cx;
+        float e2 = bx * ay - by * ax;
+        if (e0 == 0 || e1 == 0 || e2 == 0) {
+            // the ray passes (almost) exactly through an edge, which needs
+            // to be decided with higher precision
+            e0 = float(double(cx) * double(by) - double(cy) * double(bx));
+            e1 = float(double(ax) * double(cy) - double(ay) * double(cx));
+            e2 = float(double(bx) * double(ay) - double(by) * double(ax));
+        }
+        if ((e0 < 0 || e1 < 0 || e2 < 0) && (e0 > 0 || e1 > 0 || e2 > 0))
+            return false;
+
+        const float det = e0 + e1 + e2;
+        if (det == 0)
+            return false;
+
+        const float scaledT =
+            sz * (e0 * a[kz] + e1 * b[kz] + e2 * c[kz]);
+        const float invDet = 1 / det;
+        t                  = scaledT * invDet;
+        if (!(t >= Epsilon && t <= tMax))
+            return false;
+
+        u = e1 * invDet;
+        v = e2 * invDet;
+        return true;
+    }
+
+    /**
+     * @brief Intersects a single triangle with the ray, reporting the
+     * distance and barycentric coordinates of the hit if it lies between
+     * Epsilon and @c tMax .
+     */
+    inline bool intersectTriangle(int primitiveIndex, const Ray &ray,
+                                  float tMax, float &t, float &u,
+                                  float &v) const {
+        switch (m_triangleTest) {
+        case TriangleTest::Cramer:
+            return intersectCramer(primitiveIndex, ray, tMax, t, u, v);
+        case TriangleTest::MollerTrumbore:
+            return intersectMollerTrumbore(primitiveIndex, ray, tMax, t, u, v);
+        default:
+            return intersectWatertight(primitiveIndex, ray, tMax, t, u, v);
+        }
+    }
+
+    /// @brief Copies the triangles into blocks in the order of the leaf
+    /// ranges, which needs to happen whenever the BVH changes.
+    template <int Width>
+    void buildBlocks(std::vector<TriangleBlock<Width>> &blocks) const {
+        const int positions = int(leafRangeSize());
+        blocks.assign((positions + Width - 1) / Width, TriangleBlock<Width>{});
+        for_each_parallel(
+            ChunkedRange(int(blocks.size()), 4096), [&](Range chunk) {
+                for (int block : chunk) {
+                    for (int lane = 0; lane < Width; lane++) {
+                        const int position = block * Width + lane;
+                        if (position >= positions)
+                            break;
+
+                        const Vector3i &triangle =
+                            m_triangles[primitiveAt(position)];
+                        for (int vertex = 0; vertex < 3; vertex++) {
+                            const Point &p = m_positions[triangle[vertex]];
+                            for (int axis = 0; axis < 3; axis++)
+                                blocks[block].vertices[vertex][axis][lane] =
+                                    p[axis];
+                        }
+                    }
+                }
+            });
+    }
+
+    /// @brief Rebuilds the blocks of the configured width.
+    void buildBlocks() {
+        m_blocks4.clear();
+        m_blocks8.clear();
+        if (m_blockWidth == 4)
+            buildBlocks(m_blocks4);
+        else if (m_blockWidth == 8)
+            buildBlocks(m_blocks8);
+    }
+
+    /// @brief A ray prepared for intersecting blocks, including the shear
+    /// transformation of the watertight test.
+    struct BlockRay {
+        const Ray &ray;
+        int kx, ky, kz;
+        float sx, sy, sz;
+
+        explicit BlockRay(const Ray &ray) : ray(ray) {
+            // same axis permutation as in intersectWatertight
+            const Vector absDirection(abs(ray.direction.x()),
+                                      abs(ray.direction.y()),
+                                      abs(ray.direction.z()));
+            kz = absDirection.maxComponentIndex();
+            kx = (kz + 1) % 3;
+            ky = (kx + 1) % 3;
+            if (ray.direction[kz] < 0)
+                std::swap(kx, ky);
+
+            sx = ray.direction[kx] / ray.direction[kz];
+            sy = ray.direction[ky] / ray.direction[kz];
+            sz = 1 / ray.direction[kz];
+        }
+    };
+
+    /**
+     * @brief Intersects the triangles of a block whose lane is set in @c mask
+     * with the ray, using the same arithmetic as the scalar tests. Returns
+     * the bitmask of the lanes that are hit between Epsilon and @c tMax , and
+     * writes the distances and barycentric coordinates of all lanes to @c t ,
+     * @c u and @c v .
+     * @param first The position of the first lane in the leaf ranges.
+     */
+    template <int Width>
+    int intersectBlock(const TriangleBlock<Width> &block, const BlockRay &br,
+                       int first, int mask, float tMax, float *t, float *u,
+                       float *v) const {
+        using Float = simd::Float<Width>;
+        const Float zero = Float::broadcast(0);
+        const Float one  = Float::broadcast(1);
+        const Ray &ray   = br.ray;
+
+        if (m_triangleTest == TriangleTest::MollerTrumbore) {
+            Float v0[3], e1[3], e2[3];
+            for (int axis = 0; axis < 3; axis++) {
+                v0[axis] = Float::load(block.vertices[0][axis]);
+                e1[axis] = Float::load(block.vertices[1][axis]) - v0[axis];
+                e2[axis] = Float::load(block.vertices[2][axis]) - v0[axis];
+            }
+            Float d[3];
+            for (int axis = 0; axis < 3; axis++)
+                d[axis] = Float::broadcast(ray.direction[axis]);
+            const auto cross = [](const Float *a, const Float *b, Float *r) {
+                r[0] = a[1] * b[2] - a[2] * b[1];
+                r[1] = a[2] * b[0] - a[0] * b[2];
+                r[2] = a[0] * b[1] - a[1] * b[0];
+            };
+            const auto dot = [](const Float *a, const Float *b) {
+                return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+            };
+
+            Float p[3], q[3], sv[3];
+            cross(d, e2, p);
+            const Float det    = dot(e1, p);
+            const Float invDet = one / det;
+            for (int axis = 0; axis < 3; axis++)
+                sv[axis] = Float::broadcast(ray.origin[axis]) - v0[axis];
+            const Float uu = dot(sv, p) * invDet;
+            cross(sv, e1, q);
+            const Float vv = dot(d, q) * invDet;
+            const Float tt = dot(e2, q) * invDet;
+
+            tt.store(t);
+            uu.store(u);
+            vv.store(v);
+            // comparisons with NaN fail, which rejects parallel rays
+            return mask & (lessThan(det, zero) | lessThan(zero, det)) &
+                   lessEqual(zero, uu) & lessEqual(uu, one) &
+                   lessEqual(zero, vv) & lessEqual(uu + vv, one) &
+                   lessEqual(Float::broadcast(Epsilon), tt) &
+                   lessEqual(tt, Float::broadcast(tMax));
+        }
+
+        // watertight test: shear the vertices into the space of the ray
+        Float x[3], y[3], z[3];
+        for (int vertex = 0; vertex < 3; vertex++) {
+            z[vertex] = Float::load(block.vertices[vertex][br.kz]) -
+                        Float::broadcast(ray.origin[br.kz]);
+            x[vertex] = Float::load(block.vertices[vertex][br.kx]) -
+                        Float::broadcast(ray.origin[br.kx]) -
+                        Float::broadcast(br.sx) * z[vertex];
+            y[vertex] = Float::load(block.vertices[vertex][br.ky]) -
+                        Float::broadcast(ray.origin[br.ky]) -
+                        Float::broadcast(br.sy) * z[vertex];
+        }
+
+        const Float e0 = x[2] * y[1] - y[2] * x[1];
+        const Float e1 = x[0] * y[2] - y[0] * x[2];
+        const Float e2 = x[1] * y[0] - y[1] * x[0];
+        const int negative =
+            lessThan(e0, zero) | lessThan(e1, zero) | lessThan(e2, zero);
+        const int positive =
+            lessThan(zero, e0) | lessThan(zero, e1) | lessThan(zero, e2);
+        // lanes with an edge function of exactly zero need the double
+        // precision fallback of the scalar test
+        const int onEdge = ~((lessThan(e0, zero) | lessThan(zero, e0)) &
+                             (lessThan(e1, zero) | lessThan(zero, e1)) &
+                             (lessThan(e2, zero) | lessThan(zero, e2)));
+
+        const Float det    = e0 + e1 + e2;
+        const Float invDet = one / det;
+        const Float tt     = Float::broadcast(br.sz) *
+                         (e0 * z[0] + e1 * z[1] + e2 * z[2]) * invDet;
+        tt.store(t);
+        (e1 * invDet).store(u);
+        (e2 * invDet).store(v);
+
+        int hits = mask & ~onEdge & ~(negative & positive) &
+                   (lessThan(det, zero) | lessThan(zero, det)) &
+                   lessEqual(Float::broadcast(Epsilon), tt) &
+                   lessEqual(tt, Float::broadcast(tMax));
+        for (int m = mask & onEdge; m; m &= m - 1) {
+            const int lane = simd::firstBit(m);
+            if (intersectWatertight(primitiveAt(first + lane),
+                                    ray,
+                                    tMax,
+                                    t[lane],
+                                    u[lane],
+                                    v[lane]))
+                hits |= 1 << lane;
+        }
+        return hits;
+    }
+
+    /**
+     * @brief Intersects the triangles of a leaf block by block, recording the
+     * closest hit in @c its.hit (unless @c AnyHit is set).
+     */
+    template <bool AnyHit, int Width>
+    bool intersectLeafBlocks(const std::vector<TriangleBlock<Width>> &blocks,
+                             const BlockRay &blockRay, int first, int count,
+                             Intersection &its) const {
+        its.stats.primCounter += count;
+
+        // leaves are not aligned to blocks, hence lanes outside of the leaf
+        // are masked out
+        const int end       = first + count;
+        bool wasIntersected = false;
+        for (int block = first / Width; block * Width < end; block++) {
+            const int base = block * Width;
+            int mask       = (1 << Width) - 1;
+            if (base < first)
+                mask &= ~((1 << (first - base)) - 1);
+            if (base + Width > end)
+                mask &= (1 << (end - base)) - 1;
+
+            float t[Width], u[Width], v[Width];
+            int hits = intersectBlock(
+                blocks[block], blockRay, base, mask, its.t, t, u, v);
+            if constexpr (AnyHit) {
+                if (hits)
+                    return true;
+                continue;
+            }
+
+            for (; hits; hits &= hits - 1) {
+                const int lane = simd::firstBit(hits);
+                if (t[lane] <= its.t) {
+                    its.t   = t[lane];
+                    its.hit = {
+                        .shape          = this,
+                        .primitiveIndex = primitiveAt(base + lane),
+                        .uv             = { u[lane], v[lane] },
+                    };
+                    wasIntersected = true;
+                }
+            }
+        }
+        return wasIntersected;
+    }
+
+    /**
+     * @brief Traverses the BVH and intersects the leaves block by block,
+     * recording the closest hit in @c its.hit (unless @c AnyHit is set).
+     */
+    template <bool AnyHit, int Width>
+    bool traverseBlocks(const std::vector<TriangleBlock<Width>> &blocks,
+                        const Ray &ray, Intersection &its) const {
+        const BlockRay blockRay(ray);
+        return traverseLeaves<AnyHit>(ray, its, [&](auto first, auto count) {
+            return intersectLeafBlocks<AnyHit>(
+                blocks, blockRay, int(first), int(count), its);
+        });
+    }
+
+    /**
+     * @brief Traverses the BVH with a packet of rays and intersects every
+     * leaf block by block with each ray that reaches it.
+     */
+    template <int Width>
+    int traverseBlocks(const std::vector<TriangleBlock<Width>> &blocks,
+                       const RayPacket &packet, int mask,
+                       Intersection *its) const {
+        std::optional<BlockRay> blockRays[RayPacket::MaxSize];
+        for (int m = mask; m; m &= m - 1) {
+            const int i = simd::firstBit(m);
+            blockRays[i].emplace(packet.rays[i]);
+        }
+        return traversePacketLeaves(
+            packet, mask, its,
+            [&](auto first, auto count, int active) {
+                int hits = 0;
+                for (int m = active; m; m &= m - 1) {
+                    const int i = simd::firstBit(m);
+                    if (intersectLeafBlocks<false>(blocks,
+                                                   *blockRays[i],
+                                                   int(first),
+                                                   int(count),
+                                                   its[i]))
+                        hits |= 1 << i;
+                }
+                return hits;
+            });
+    }
+
+    bool intersect(int primitiveIndex, const Ray &ray, Intersection &its,
+                   Sampler &rng) const override {
+        float t, u, v;
+        if (!intersectTriangle(primitiveIndex, ray, its.t, t, u, v)) {
+            return false;
+        }
+
+        // the surface data is only computed for the closest hit (see
+        // populateHit)
+        its.t   = t;
+        its.hit = {
+            .shape          = this,
+            .primitiveIndex = primitiveIndex,
+            .uv             = { u, v },
+        };
         return true;
 
         // hints:
         // * use m_triangles[primitiveIndex] to get the vertex indices of the
         // triangle that should be intersected
-        // * if m_smoothNormals is true, interpolate the vertex normals from
-        // m_vertices
+        // * if m_smoothNormals is true, interpolate the vertex normals (see
+        // attributes)
         //   * make sure that your shading frame stays orthonormal!
         // * if m_smoothNormals is false, use the geometrical normal (can be
         // computed from the vertex positions)
     }
 
+    bool occluded(int primitiveIndex, const Ray &ray, float tMax,
+                  Sampler &rng) const override {
+        // no need to populate the surface event for occlusion tests
+        float t, u, v;
+        return intersectTriangle(primitiveIndex, ray, tMax, t, u, v);
+    }
+
     Bounds getBoundingBox(int primitiveIndex) const override {
-        Vector v1 = Vector(m_vertices[m_triangles[primitiveIndex][0]].position);
-        Vector v2 = Vector(m_vertices[m_triangles[primitiveIndex][1]].position);
-        Vector v3 = Vector(m_vertices[m_triangles[primitiveIndex][2]].position);
+        Vector v1 = Vector(m_positions[m_triangles[primitiveIndex][0]]);
+        Vector v2 = Vector(m_positions[m_triangles[primitiveIndex][1]]);
+        Vector v3 = Vector(m_positions[m_triangles[primitiveIndex][2]]);
 
         return Bounds(Point(std::min({ v1[0], v2[0], v3[0] }),
                             std::min({ v1[1], v2[1], v3[1] }),
@@ -129,36 +740,390 @@ protected:
                             std::max({ v1[2], v2[2], v3[2] })));
     }
 
+    Bounds getClippedBoundingBox(int primitiveIndex,
+                                 const Bounds &clip) const override {
+        // clip the triangle against the six planes of the box
+        // (Sutherland-Hodgman), every plane adds at most one vertex
+        Point polygon[9], clipped[9];
+        int count = 3;
+        for (int i = 0; i < 3; i++)
+            polygon[i] = m_positions[m_triangles[primitiveIndex][i]];
+
+        for (int axis = 0; axis < 3; axis++) {
+            for (int side = 0; side < 2 && count > 0; side++) {
+                const float plane = side ? clip.max()[axis] : clip.min()[axis];
+                const auto inside = [&](const Point &p) {
+                    return side ? p[axis] <= plane : p[axis] >= plane;
+                };
+
+                int clippedCount = 0;
+                for (int i = 0; i < count; i++) {
+                    const Point &a = polygon[i];
+                    const Point &b = polygon[(i + 1) % count];
+                    if (inside(a))
+                        clipped[clippedCount++] = a;
+                    if (inside(a) != inside(b)) {
+                        const float t = (plane - a[axis]) / (b[axis] - a[axis]);
+                        Point p = a + t * (b - a);
+                        p[axis] = plane;
+                        clipped[clippedCount++] = p;
+                    }
+                }
+                std::copy(clipped, clipped + clippedCount, polygon);
+                count = clippedCount;
+            }
+        }
+
+        if (count == 0)
+            return Bounds::empty();
+
+        Bounds result;
+        for (int i = 0; i < count; i++)
+            result.extend(polygon[i]);
+        // rounding errors might place vertices slightly outside of the box
+        return clip.clip(result);
+    }
+
     Point getCentroid(int primitiveIndex) const override {
-        Vector v1 = Vector(m_vertices[m_triangles[primitiveIndex][0]].position);
-        Vector v2 = Vector(m_vertices[m_triangles[primitiveIndex][1]].position);
-        Vector v3 = Vector(m_vertices[m_triangles[primitiveIndex][2]].position);
+        Vector v1 = Vector(m_positions[m_triangles[primitiveIndex][0]]);
+        Vector v2 = Vector(m_positions[m_triangles[primitiveIndex][1]]);
+        Vector v3 = Vector(m_positions[m_triangles[primitiveIndex][2]]);
 
         return (v1 + v2 + v3) / 3.0f;
     }
 
+    bool permutePrimitives(const std::vector<int> &order) override {
+        std::vector<Vector3i> triangles(order.size());
+        for (size_t i = 0; i < order.size(); i++)
+            triangles[i] = m_triangles[order[i]];
+        m_triangles = std::move(triangles);
+        // the edges and blocks are recomputed once the build is complete
+        m_edges.clear();
+        m_blocks4.clear();
+        m_blocks8.clear();
+        return true;
+    }
+
+    /// @brief Hashes the triangles and vertex positions, which is all the
+    /// BVH depends on.
+    uint64_t contentHash() const {
+        hash::fnv1a hash;
+        hash.update(m_triangles.data(), m_triangles.size() * sizeof(Vector3i));
+        hash.update(m_positions.data(), m_positions.size() * sizeof(Point));
+        return hash;
+    }
+
 public:
-    TriangleMesh(const Properties &properties) {
+    using StaticAccelerationStructure::getBoundingBox;
+    using StaticAccelerationStructure::getCentroid;
+    using StaticAccelerationStructure::intersect;
+    using StaticAccelerationStructure::intersectPacket;
+    using StaticAccelerationStructure::occluded;
+
+    bool findHit(const Ray &ray, Intersection &its,
+                 Sampler &rng) const override {
+        if (m_blockWidth == 0)
+            return StaticAccelerationStructure::findHit(ray, its, rng);
+        return m_blockWidth == 8 ? traverseBlocks<false>(m_blocks8, ray, its)
+                                 : traverseBlocks<false>(m_blocks4, ray, its);
+    }
+
+    int findHitPacket(const RayPacket &packet, int mask,
+                      Intersection *its) const override {
+        if (m_blockWidth == 0)
+            return StaticAccelerationStructure::findHitPacket(
+                packet, mask, its);
+        return m_blockWidth == 8 ? traverseBlocks(m_blocks8, packet, mask, its)
+                                 : traverseBlocks(m_blocks4, packet, mask, its);
+    }
+
+    void populateHit(const Ray &ray, Intersection &its) const override {
+        populate(its.hit.primitiveIndex,
+                 its,
+                 ray(its.t),
+                 its.hit.uv.x(),
+                 its.hit.uv.y());
+    }
+
+    bool occluded(const Ray &ray, float tMax, Sampler &rng) const override {
+        if (m_blockWidth == 0)
+            return StaticAccelerationStructure::occluded(ray, tMax, rng);
+
+        Intersection its(-ray.direction, tMax);
+        return m_blockWidth == 8 ? traverseBlocks<true>(m_blocks8, ray, its)
+                                 : traverseBlocks<true>(m_blocks4, ray, its);
+    }
+
+    /// @brief Reads the options of the mesh, but does not load it yet (see
+    /// @ref load ).
+    MeshGeometry(const Properties &properties)
+        : StaticAccelerationStructure(properties) {
         m_originalPath  = properties.get<std::filesystem::path>("filename");
         m_smoothNormals = properties.get<bool>("smooth", true);
-        readPLY(m_originalPath, m_triangles, m_vertices);
+        m_weldNormals   = properties.get<bool>("weldNormals", false);
+        m_triangleTest  = properties.getEnum<TriangleTest>(
+            "triangleTest",
+            TriangleTest::Watertight,
+            {
+                { "cramer", TriangleTest::Cramer },
+                { "mollertrumbore", TriangleTest::MollerTrumbore },
+                { "watertight", TriangleTest::Watertight },
+            });
+        m_precomputeEdges = properties.get<bool>("precomputeEdges", true);
+        m_compactVertices = properties.get<bool>("compactVertices", false);
+        m_blockWidth      = properties.get<int>("triangleBlocks", 0);
+        if (m_blockWidth != 0 && m_blockWidth != 4 && m_blockWidth != 8) {
+            lightwave_throw("unsupported triangle block width %d (must be 0, "
+                            "4 or 8)",
+                            m_blockWidth);
+        }
+        if (m_blockWidth > 0 && m_triangleTest == TriangleTest::Cramer) {
+            logger(EWarn,
+                   "triangle blocks do not support the cramer test, "
+                   "intersecting triangles one by one instead");
+            m_blockWidth = 0;
+        }
+        // the BVH can be stored in a cache directory, so that later runs can
+        // skip building it as long as the mesh does not change
+        m_cacheDirectory =
+            properties.get<std::filesystem::path>("bvhCache", {});
+    }
+
+    /// @brief Identifies the file and all options that affect the loaded
+    /// geometry (apart from where the BVH is cached).
+    std::string key() const {
+        return tfm::format(
+            "%s|smooth=%d|weld=%d|test=%d|edges=%d|blocks=%d|compact=%d|%s",
+            std::filesystem::weakly_canonical(m_originalPath).generic_string(),
+            m_smoothNormals,
+            m_weldNormals,
+            int(m_triangleTest),
+            m_precomputeEdges,
+            m_blockWidth,
+            m_compactVertices,
+            describeSettings());
+    }
+
+    /// @brief Returns whether the mesh is stored in a native mesh file (see
+    /// @ref meshfile ).
+    bool isNative() const { return m_originalPath.extension() == ".lwmesh"; }
+
+    /// @brief Loads the triangles and vertices of a PLY file.
+    void loadPLY() {
+        std::vector<Vertex> vertices;
+        readPLY(m_originalPath, m_triangles, vertices, m_weldNormals);
         logger(EInfo,
                "loaded ply with %d triangles, %d vertices",
                m_triangles.size(),
-               m_vertices.size());
-        buildAccelerationStructure();
+               vertices.size());
+        storeVertices(vertices);
     }
 
-    bool intersect(const Ray &ray, Intersection &its,
-                   Sampler &rng) const override {
-        PROFILE("Triangle mesh")
-        return AccelerationStructure::intersect(ray, its, rng);
+    /**
+     * @brief Loads the triangles and vertices of a native mesh file, which
+     * are stored in the layout used in memory. The vertex attributes are only
+     * converted if they are stored in another form than requested by @ref
+     * m_compactVertices .
+     */
+    void loadNative(const MeshFileReader &file) {
+        Timer loadTimer;
+        m_triangles = file.read<Vector3i>("TRIS");
+        m_positions = file.read<Point>("POSN");
+
+        const bool compact = m_compactVertices;
+        m_compactVertices  = file.has("PACK");
+        m_attributes.clear();
+        m_packedAttributes.clear();
+        if (m_compactVertices) {
+            m_packedAttributes = file.read<PackedAttributes>("PACK");
+            const auto uvRange = file.read<Vector2>("UVRG");
+            if (uvRange.size() != 2)
+                lightwave_throw("invalid texture coordinate range");
+            m_uvOrigin = uvRange[0];
+            m_uvExtent = uvRange[1];
+        } else {
+            m_attributes = file.read<VertexAttributes>("ATTR");
+        }
+
+        const size_t attributeCount = m_compactVertices
+                                          ? m_packedAttributes.size()
+                                          : m_attributes.size();
+        if (attributeCount != m_positions.size()) {
+            lightwave_throw("found %d vertex positions, but %d attributes",
+                            m_positions.size(),
+                            attributeCount);
+        }
+        for (size_t i = 0; i < m_triangles.size(); i++) {
+            for (int elem = 0; elem < 3; elem++) {
+                if (m_triangles[i][elem] < 0 ||
+                    size_t(m_triangles[i][elem]) >= m_positions.size())
+                    lightwave_throw(
+                        "triangle %d references a vertex that does not exist",
+                        i);
+            }
+        }
+
+        if (m_compactVertices != compact) {
+            std::vector<Vertex> vertices(m_positions.size());
+            for (size_t i = 0; i < vertices.size(); i++) {
+                const VertexAttributes attrs = attributes(int(i));
+                vertices[i] = { m_positions[i], attrs.uv, attrs.normal };
+            }
+            m_compactVertices = compact;
+            storeVertices(vertices);
+        }
+
+        logger(EInfo,
+               "loaded native mesh with %d triangles, %d vertices in %.1f ms",
+               m_triangles.size(),
+               m_positions.size(),
+               loadTimer.getElapsedTime() * 1000);
+    }
+
+    /// @brief Loads the mesh file and builds the BVH.
+    void load() {
+        if (isNative()) {
+            logger(EInfo, "loading mesh %s", m_originalPath);
+            try {
+                const MeshFileReader file(m_originalPath);
+                loadNative(file);
+                // the embedded BVH is used unless it was built with other
+                // settings
+                buildAccelerationStructure(
+                    file.has("BVH ") ? file.data("BVH ") : nullptr,
+                    file.has("BVH ") ? file.size("BVH ") : 0,
+                    contentHash(),
+                    tfm::format("\"%s\"", m_originalPath.generic_string()));
+            } catch (...) {
+                lightwave_throw_nested("while loading %s", m_originalPath);
+            }
+        } else {
+            loadPLY();
+            if (m_cacheDirectory.empty()) {
+                buildAccelerationStructure();
+            } else {
+                buildAccelerationStructure(m_cacheDirectory, contentHash());
+            }
+        }
+        computeEdges();
+        buildBlocks();
+    }
+
+    /**
+     * @brief Loads the mesh file and stores it as native mesh file, along
+     * with the BVH built with the current settings. The triangles are stored
+     * in their original order, which the BVH refers to.
+     */
+    void convert(const std::filesystem::path &output) {
+        if (isNative()) {
+            loadNative(MeshFileReader(m_originalPath));
+        } else {
+            loadPLY();
+        }
+        buildBinaryTree();
+
+        MeshFileWriter writer;
+        writer.add("TRIS", m_triangles);
+        writer.add("POSN", m_positions);
+        if (m_compactVertices) {
+            writer.add("PACK", m_packedAttributes);
+            writer.add("UVRG", std::vector<Vector2>{ m_uvOrigin, m_uvExtent });
+        } else {
+            writer.add("ATTR", m_attributes);
+        }
+
+        std::ostringstream tree;
+        writeBinaryTree(tree, cacheKey(contentHash()));
+        const std::string bytes = tree.str();
+        writer.add("BVH ", bytes.data(), bytes.size());
+        writer.write(output);
+        logger(EInfo, "wrote native mesh %s", output);
+    }
+
+    /// @brief Moves the vertices and refits the BVH (see @ref
+    /// TriangleMesh::updateVertexPositions ).
+    void updateVertexPositions(const std::vector<Point> &positions) {
+        if (positions.size() != m_positions.size()) {
+            lightwave_throw("expected %d vertex positions, but got %d",
+                            m_positions.size(),
+                            positions.size());
+        }
+        m_positions = positions;
+        m_edges.clear();
+        refitAccelerationStructure();
+        computeEdges();
+        buildBlocks();
+    }
+
+    /// @brief Returns the surface area of a triangle.
+    float triangleArea(int primitiveIndex) const {
+        const TriangleEdges edges = triangleEdges(primitiveIndex);
+        return edges.edge1.cross(edges.edge2).length() / 2;
+    }
+
+    /// @brief Samples a point uniformly on a triangle, with the pdf given with
+    /// respect to the area of the triangle.
+    AreaSample sampleTriangle(int primitiveIndex, const Point2 &rnd) const {
+        const Point2 bary         = squareToUniformTriangle(rnd);
+        const TriangleEdges edges = triangleEdges(primitiveIndex);
+        AreaSample sample;
+        populate(primitiveIndex,
+                 sample,
+                 edges.origin + bary.x() * edges.edge1 +
+                     bary.y() * edges.edge2,
+                 bary.x(),
+                 bary.y());
+        sample.pdf = 1 / triangleArea(primitiveIndex);
+        return sample;
     }
 
-    AreaSample sampleArea(Sampler &rng) const override{
-        // only implement this if you need triangle mesh area light sampling for
-        // your rendering competition
-        NOT_IMPLEMENTED
+    /**
+     * @brief Returns the weights with which triangles are picked for area
+     * light sampling: their area, or if an emission is given, their area
+     * times the luminance the emission has at their vertices and centroid.
+     * @note Triangles keep a small fraction of the average emission as
+     * weight, since textured emission may be bright inside a triangle even
+     * if it is dark at all points that have been evaluated.
+     */
+    std::vector<float> samplingWeights(const Emission *emission) const {
+        std::vector<float> weights(m_triangles.size());
+        for_each_parallel(
+            ChunkedRange(int(weights.size()), 16384), [&](Range chunk) {
+                for (int i : chunk) {
+                    weights[i] = triangleArea(i);
+                    if (!emission)
+                        continue;
+
+                    const Vector normal(0, 0, 1);
+                    Point2 centroid;
+                    float luminance = 0;
+                    for (int vertex = 0; vertex < 3; vertex++) {
+                        const Point2 uv = attributes(m_triangles[i][vertex]).uv;
+                        luminance +=
+                            emission->evaluate(uv, normal).value.luminance();
+                        centroid += Vector2(uv) / 3;
+                    }
+                    luminance +=
+                        emission->evaluate(centroid, normal).value.luminance();
+                    weights[i] *= luminance / 4;
+                }
+            });
+        if (!emission)
+            return weights;
+
+        double totalArea = 0, totalWeight = 0;
+        for (size_t i = 0; i < weights.size(); i++) {
+            totalArea += triangleArea(int(i));
+            totalWeight += weights[i];
+        }
+        if (!(totalWeight > 0)) {
+            // the emission is black at all evaluated points
+            return samplingWeights(nullptr);
+        }
+        const float floor = float(0.01 * totalWeight / totalArea);
+        for (size_t i = 0; i < weights.size(); i++)
+            weights[i] = std::max(weights[i], floor * triangleArea(int(i)));
+        return weights;
     }
 
     std::string toString() const override {
@@ -168,12 +1133,229 @@ public:
             "  triangles = %d,\n"
             "  filename = \"%s\"\n"
             "]",
-            m_vertices.size(),
+            m_positions.size(),
             m_triangles.size(),
             m_originalPath.generic_string());
     }
 };
 
+/**
+ * @brief Keeps track of the geometry of all meshes that are in use, so that
+ * meshes referencing the same file with the same options only load it once.
+ */
+class GeometryCache {
+    struct Entry {
+        /// @brief Set while the geometry is being loaded, so that meshes
+        /// requesting the same geometry in the meantime can wait for it.
+        std::shared_future<ref<MeshGeometry>> loading;
+        /// @brief The loaded geometry, which is released once no mesh uses
+        /// it anymore.
+        std::weak_ptr<MeshGeometry> geometry;
+    };
+
+    std::mutex m_mutex;
+    /// @brief The geometry by key (see @ref MeshGeometry::key ).
+    std::unordered_map<std::string, Entry> m_entries;
+
+public:
+    /// @brief Returns the geometry that has been loaded with the same options
+    /// as @c geometry , or loads @c geometry if there is none. Loading
+    /// happens without holding the lock, so that different meshes load in
+    /// parallel.
+    ref<MeshGeometry> get(const ref<MeshGeometry> &geometry) {
+        const std::string key = geometry->key();
+        std::promise<ref<MeshGeometry>> promise;
+        {
+            std::unique_lock lock{ m_mutex };
+            auto it = m_entries.find(key);
+            if (it != m_entries.end()) {
+                if (it->second.loading.valid()) {
+                    auto loading = it->second.loading;
+                    lock.unlock();
+                    return loading.get();
+                }
+                if (auto existing = it->second.geometry.lock())
+                    return existing;
+                m_entries.erase(it); // the geometry has been released
+            }
+            m_entries[key].loading = promise.get_future().share();
+        }
+
+        try {
+            geometry->load();
+        } catch (...) {
+            // allow later meshes to attempt loading again
+            {
+                std::unique_lock lock{ m_mutex };
+                m_entries.erase(key);
+            }
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+
+        {
+            std::unique_lock lock{ m_mutex };
+            Entry &entry   = m_entries[key];
+            entry.loading  = {};
+            entry.geometry = geometry;
+        }
+        promise.set_value(geometry);
+        return geometry;
+    }
+
+    /// @brief The cache shared by all meshes of the process.
+    static GeometryCache &instance() {
+        static GeometryCache cache;
+        return cache;
+    }
+};
+
+/**
+ * @brief A shape consisting of many (potentially millions) of triangles, which
+ * share an index and vertex buffer. Since individual triangles are rarely
+ * needed (and would pose an excessive amount of overhead), collections of
+ * triangles are combined in a single shape.
+ *
+ * Meshes that reference the same file with the same options share their
+ * geometry and BVH, so that scenes with many copies of a mesh only load it
+ * once. Meshes with the @c dynamic property get their own copy instead, which
+ * can be deformed using @ref updateVertexPositions .
+ */
+class TriangleMesh : public Shape {
+    /// @brief The triangles, vertices and BVH of the mesh.
+    ref<MeshGeometry> m_geometry;
+    /// @brief Whether the geometry belongs to this mesh alone, which allows
+    /// modifying it.
+    bool m_dynamic;
+    /// @brief Whether area light sampling picks triangles by their estimated
+    /// emitted power instead of their area.
+    bool m_emissionSampling;
+    /// @brief The emission used for @ref m_emissionSampling , if any.
+    const Emission *m_lightEmission = nullptr;
+    /// @brief The distribution of triangles for area light sampling, built by
+    /// @ref prepareAreaSampling .
+    AliasTable m_lightTriangles;
+
+    void buildLightTriangles() {
+        m_lightTriangles =
+            AliasTable(m_geometry->samplingWeights(m_lightEmission));
+    }
+
+public:
+    TriangleMesh(const Properties &properties) {
+        m_dynamic          = properties.get<bool>("dynamic", false);
+        m_emissionSampling = properties.get<bool>("emissionSampling", false);
+        auto geometry = std::make_shared<MeshGeometry>(properties);
+        if (m_dynamic) {
+            geometry->load();
+            m_geometry = geometry;
+        } else {
+            m_geometry = GeometryCache::instance().get(geometry);
+        }
+    }
+
+    /**
+     * @brief Moves the vertices of the mesh (e.g., to the next frame of an
+     * animation) and refits the BVH, which is much cheaper than loading a new
+     * mesh. The normals and texture coordinates of the vertices are kept.
+     * @note Only meshes with the @c dynamic property can be modified, as the
+     * geometry of other meshes may be shared.
+     */
+    void updateVertexPositions(const std::vector<Point> &positions) {
+        if (!m_dynamic) {
+            lightwave_throw("only dynamic meshes can be modified");
+        }
+        m_geometry->updateVertexPositions(positions);
+        // the areas have changed, and the triangles may have been reordered
+        if (!m_lightTriangles.empty())
+            buildLightTriangles();
+    }
+
+    bool intersect(const Ray &ray, Intersection &its,
+                   Sampler &rng) const override {
+        PROFILE("Triangle mesh")
+        return m_geometry->intersect(ray, its, rng);
+    }
+
+    bool findHit(const Ray &ray, Intersection &its,
+                 Sampler &rng) const override {
+        PROFILE("Triangle mesh")
+        return m_geometry->findHit(ray, its, rng);
+    }
+
+    int intersectPacket(const RayPacket &packet, int mask,
+                        Intersection *its) const override {
+        PROFILE("Triangle mesh")
+        return m_geometry->intersectPacket(packet, mask, its);
+    }
+
+    int findHitPacket(const RayPacket &packet, int mask,
+                      Intersection *its) const override {
+        PROFILE("Triangle mesh")
+        return m_geometry->findHitPacket(packet, mask, its);
+    }
+
+    bool occluded(const Ray &ray, float tMax, Sampler &rng) const override {
+        PROFILE("Triangle mesh")
+        return m_geometry->occluded(ray, tMax, rng);
+    }
+
+    Bounds getBoundingBox() const override {
+        return m_geometry->getBoundingBox();
+    }
+
+    Point getCentroid() const override { return m_geometry->getCentroid(); }
+
+    void prepareAreaSampling(const Emission *emission) override {
+        m_lightEmission = m_emissionSampling ? emission : nullptr;
+        buildLightTriangles();
+    }
+
+    AreaSample sampleArea(Sampler &rng) const override {
+        if (m_lightTriangles.empty()) {
+            lightwave_throw("meshes can only be sampled as part of an area "
+                            "light");
+        }
+        const int triangle = m_lightTriangles.sample(rng.next());
+        AreaSample sample  = m_geometry->sampleTriangle(triangle, rng.next2D());
+        sample.pdf *= m_lightTriangles.probability(triangle);
+        return sample;
+    }
+
+    std::string toString() const override { return m_geometry->toString(); }
+};
+
+/**
+ * @brief Converts a mesh file into a native mesh file (.lwmesh) when executed,
+ * which holds the vertex and index buffers in the layout used in memory along
+ * with the BVH, so that loading it requires neither parsing nor building the
+ * BVH. The options of the mesh (e.g., @c compactVertices or the BVH settings)
+ * determine what is stored. This is what @code blob --convert in.ply
+ * out.lwmesh @endcode runs.
+ */
+class MeshConverter : public Executable {
+    /// @brief The mesh to convert, which is only loaded when executed.
+    ref<MeshGeometry> m_geometry;
+    /// @brief The native mesh file to write.
+    std::filesystem::path m_output;
+
+public:
+    MeshConverter(const Properties &properties) {
+        m_output   = properties.get<std::filesystem::path>("output");
+        m_geometry = std::make_shared<MeshGeometry>(properties);
+    }
+
+    void execute() override { m_geometry->convert(m_output); }
+
+    std::string toString() const override {
+        return tfm::format("MeshConverter[\n"
+                           "  output = \"%s\"\n"
+                           "]",
+                           m_output.generic_string());
+    }
+};
+
 } // namespace lightwave
 
 REGISTER_SHAPE(TriangleMesh, "mesh")
+REGISTER_CLASS(MeshConverter, "convert", "mesh")
@@ -34,8 +34,8 @@ class Rectangle : public Shape {
 public:
     Rectangle(const Properties &properties) {}
 
-    bool intersect(const Ray &ray, Intersection &its,
-                   Sampler &rng) const override {
+    bool findHit(const Ray &ray, Intersection &its,
+                 Sampler &rng) const override {
         PROFILE("Rectangle")
 
         // if the ray travels in the xy-plane, we report no intersection
@@ -63,11 +63,25 @@ public:
             return false;
 
         // we have determined there was an intersection! we are now free to
-        // change the intersection object and return true.
-        its.t = t;
+        // change the intersection object and return true. the surface data is
+        // only computed once it is clear that no closer hit exists.
+        its.t         = t;
+        its.hit       = HitRecord{};
+        its.hit.shape = this;
+        return true;
+    }
+
+    void populateHit(const Ray &ray, Intersection &its) const override {
         populate(its,
-                 position); // compute the shading frame, texture coordinates
-                            // and area pdf (same as sampleArea)
+                 ray(its.t)); // compute the shading frame, texture coordinates
+                              // and area pdf (same as sampleArea)
+    }
+
+    bool intersect(const Ray &ray, Intersection &its,
+                   Sampler &rng) const override {
+        if (!findHit(ray, its, rng))
+            return false;
+        completeHit(ray, its);
         return true;
     }
 
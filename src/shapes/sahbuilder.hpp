@@ -0,0 +1,262 @@
+/**
+ * @file sahbuilder.hpp
+ * @brief Builds binary BVHs with binned SAH.
+ */
+
+#pragma once
+
+#include "bvh.hpp"
+
+#include <numeric>
+
+namespace lightwave::bvh {
+
+/**
+ * @brief Builds the binary tree with binned SAH, which partitions the
+ * primitives of every node by their centroids. This is the default builder.
+ */
+class SAHBuilder : public BinaryTreeBuilder {
+    /**
+     * For a given node, computes split axis and split position that
+     * minimize the surface area heuristic.
+     * @param node The BVH node to compute the split for.
+     * @param out bestSplitAxis The optimal split axis, or -1 if no useful
+     * split exists
+     * @param out bestSplitPosition The optimal split position, undefined if
+     * no useful split exists
+     */
+    void binning(const Node &node, BuildContext &ctx, int &bestSplitAxis,
+                 float &bestSplitPosition) {
+        std::mutex mutex;
+
+        // find smallest box that contains all centroids
+        Bounds centroidBounds;
+        forEachPrimitiveRange(node, ctx, [&](Range range) {
+            Bounds bounds;
+            for (NodeIndex i : range) {
+                bounds.extend(ctx.primitiveCentroids[m_primitiveIndices[i]]);
+            }
+
+            std::unique_lock lock{ mutex };
+            centroidBounds.extend(bounds);
+        });
+
+        float lowestSAH = surfaceArea(node.aabb) * node.primitiveCount;
+        bestSplitAxis   = -1;
+
+        float stepSize[3], invStepSize[3];
+        bool validAxis[3];
+        for (int axis = 0; axis < 3; axis++) {
+            stepSize[axis]    = centroidBounds.diagonal()[axis] / BinCount;
+            invStepSize[axis] = 1 / stepSize[axis];
+            // if the step size is too small, there is no usefull split in this
+            // axis (primitives are aligned on one line parallel to the axis).
+            // However, there can be a usefull split in another axis
+            validAxis[axis] = stepSize[axis] >= Epsilon;
+        }
+
+        // assign the primitives to bins (for all axes at once, so that every
+        // primitive only needs to be visited once)
+        Bin bins[3][BinCount];
+        forEachPrimitiveRange(node, ctx, [&](Range range) {
+            Bin localBins[3][BinCount];
+            for (NodeIndex i : range) {
+                const Point &centroid =
+                    ctx.primitiveCentroids[m_primitiveIndices[i]];
+                const Bounds &aabb = ctx.primitiveBounds[m_primitiveIndices[i]];
+                for (int axis = 0; axis < 3; axis++) {
+                    if (!validAxis[axis])
+                        continue;
+
+                    NodeIndex binIdx = clamp(
+                        (NodeIndex) ((centroid[axis] -
+                                      centroidBounds.min()[axis]) *
+                                     invStepSize[axis]),
+                        0,
+                        BinCount - 1);
+                    localBins[axis][binIdx].add(aabb);
+                }
+            }
+
+            std::unique_lock lock{ mutex };
+            for (int axis = 0; axis < 3; axis++) {
+                for (NodeIndex binIdx = 0; binIdx < BinCount; binIdx++) {
+                    bins[axis][binIdx].add(localBins[axis][binIdx]);
+                }
+            }
+        });
+
+        for (int axis = 0; axis < 3; axis++) {
+            if (!validAxis[axis])
+                continue;
+
+            Bounds leftBox, rightBox;
+            NodeIndex leftSum = 0, rightSum = 0;
+            // leftArea[i], leftCount[i] contains bins 0, 1, ..., i
+            // rightArea[i], rightCount[i] contains bins
+            //     i+1, i+2, ..., binCount-1
+            float leftArea[BinCount - 1], rightArea[BinCount - 1];
+            NodeIndex leftCount[BinCount - 1], rightCount[BinCount - 1];
+
+            // compute prefix and suffix sums on bins
+            for (NodeIndex i = 0; i < BinCount - 1; i++) {
+                leftBox.extend(bins[axis][i].aabb);
+                leftArea[i] = surfaceArea(leftBox);
+                leftSum += bins[axis][i].primitiveCount;
+                leftCount[i] = leftSum;
+
+                rightBox.extend(bins[axis][BinCount - i - 1].aabb);
+                rightArea[BinCount - i - 2] = surfaceArea(rightBox);
+                rightSum += bins[axis][BinCount - i - 1].primitiveCount;
+                rightCount[BinCount - i - 2] = rightSum;
+            }
+
+            // find split with lowest surface area
+            for (NodeIndex i = 0; i < BinCount - 1; i++) {
+                if (leftCount[i] > 0 && rightCount[i] > 0) {
+                    float sah = leftCount[i] * leftArea[i] +
+                                rightCount[i] * rightArea[i];
+
+                    if (sah < lowestSAH) {
+                        lowestSAH = sah;
+                        bestSplitPosition = centroidBounds.min()[axis] +
+                                            (i + 1) * stepSize[axis];
+                        bestSplitAxis = axis;
+                    }
+                }
+            }
+        }
+    }
+
+    /// @brief Attempts to subdivide a given BVH node.
+    void subdivide(NodeIndex parentIndex, BuildContext &ctx, int depth) {
+        Node &parent = m_nodes[parentIndex];
+
+        // only subdivide if enough children are available.
+        if (parent.primitiveCount <= m_leafSize) {
+            return;
+        }
+
+        // the traversal stack can only hold nodes up to a certain depth
+        if (depth >= MaxDepth) {
+            return;
+        }
+
+        // set to true when implementing binning
+        static constexpr bool UseSAH = true;
+
+        int splitAxis = -1;
+        float splitPosition;
+        if (UseSAH) {
+            // pick split axis and position using binned SAH
+            binning(parent, ctx, splitAxis, splitPosition);
+        } else {
+            // split in the middle of the longest axis
+            splitAxis     = parent.aabb.diagonal().maxComponentIndex();
+            splitPosition = parent.aabb.center()[splitAxis];
+        }
+
+        if (splitAxis == -1) {
+            // a split axis of -1 indicates that no useful split exists
+            return;
+        }
+
+        // the point at which to split (note that primitives must be
+        // re-ordered so that all children of the left node will have a
+        // smaller index than firstRightIndex, and nodes on the right will
+        // have an index larger or equal to firstRightIndex)
+        NodeIndex firstRightIndex = parent.firstPrimitiveIndex();
+        NodeIndex lastLeftIndex   = parent.lastPrimitiveIndex();
+
+        // partition algorithm (you might remember this from quicksort)
+        while (firstRightIndex <= lastLeftIndex) {
+            if (ctx.primitiveCentroids[m_primitiveIndices[firstRightIndex]]
+                                      [splitAxis] < splitPosition) {
+                firstRightIndex++;
+            } else {
+                std::swap(m_primitiveIndices[firstRightIndex],
+                          m_primitiveIndices[lastLeftIndex--]);
+            }
+        }
+
+        const NodeIndex firstLeftIndex = parent.firstPrimitiveIndex();
+        const NodeIndex leftCount      = firstRightIndex - firstLeftIndex;
+        const NodeIndex rightCount     = parent.primitiveCount - leftCount;
+
+        if (leftCount == 0 || rightCount == 0) {
+            // if either child gets no primitives, we abort subdividing
+            return;
+        }
+
+        // the two children will always be contiguous in our m_nodes list
+        const NodeIndex leftChildIndex =
+            splitLeaf(parent, firstRightIndex, ctx);
+        const NodeIndex rightChildIndex = leftChildIndex + 1;
+
+        // first, process the left child node (and all of its children).
+        // large subtrees are built on a separate thread (if the thread budget
+        // allows), while this thread continues with the right child.
+        std::thread worker;
+        if (leftCount >= ParallelSubtreeThreshold && acquireBuildThread()) {
+            ctx.subtreeWorkers++;
+            worker = std::thread([this, &ctx, leftChildIndex, depth]() {
+                const double start = threadCpuTime();
+                computeAABB(m_nodes[leftChildIndex], ctx);
+                subdivide(leftChildIndex, ctx, depth + 1);
+                ctx.addCpuTime(start);
+                ctx.subtreeWorkers--;
+                releaseBuildThread();
+            });
+        } else {
+            computeAABB(m_nodes[leftChildIndex], ctx);
+            subdivide(leftChildIndex, ctx, depth + 1);
+        }
+
+        // then, process the right child node (and all of its children)
+        computeAABB(m_nodes[rightChildIndex], ctx);
+        subdivide(rightChildIndex, ctx, depth + 1);
+
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+public:
+    using BinaryTreeBuilder::BinaryTreeBuilder;
+
+    /// @brief Builds the tree over all primitives, whose bounds must have
+    /// been fetched into @c ctx .
+    void build(BuildContext &ctx) {
+        const NodeIndex primitiveCount =
+            NodeIndex(ctx.primitiveBounds.size());
+
+        // fill primitive indices with 0 to primitiveCount - 1
+        m_primitiveIndices.resize(primitiveCount);
+        std::iota(m_primitiveIndices.begin(), m_primitiveIndices.end(), 0);
+
+        // create root node
+        auto &root          = allocateRoot(primitiveCount, ctx);
+        root.leftFirst      = 0;
+        root.primitiveCount = primitiveCount;
+        computeAABB(root, ctx);
+        subdivide(0, ctx, 0);
+    }
+
+    /**
+     * @brief Rebuilds the subtree below the node at @c index , whose
+     * primitives are stored contiguously at @c first , from scratch. The new
+     * nodes are appended to m_nodes.
+     */
+    void rebuild(NodeIndex index, NodeIndex first, NodeIndex count, int depth,
+                 BuildContext &ctx) {
+        reserveNodes(count, ctx);
+
+        Node &root          = m_nodes[index];
+        root.leftFirst      = first;
+        root.primitiveCount = count;
+        computeAABB(root, ctx);
+        subdivide(index, ctx, depth);
+    }
+};
+
+} // namespace lightwave::bvh
@@ -0,0 +1,395 @@
+/**
+ * @file sbvhbuilder.hpp
+ * @brief Builds binary BVHs with spatial splits (SBVH).
+ */
+
+#pragma once
+
+#include "bvh.hpp"
+
+#include <functional>
+
+namespace lightwave::bvh {
+
+/**
+ * @brief Builds the binary tree with binned SAH that can also split space,
+ * clipping primitives at split planes and referencing them from several
+ * leaves if that reduces the overlap of nodes (which helps for long, thin
+ * triangles).
+ */
+class SpatialSplitBuilder : public BinaryTreeBuilder {
+public:
+    /// @brief Returns the bounding box of the part of a primitive that lies
+    /// within @c clip , or an empty bounding box if no part of it does.
+    typedef std::function<Bounds(int primitiveIndex, const Bounds &clip)>
+        ClipFunction;
+
+private:
+    /// @brief A reference to a primitive (or to the part of it that lies
+    /// within a node) during the spatial split build.
+    struct Reference {
+        /// @brief The bounding box of the referenced part of the primitive.
+        Bounds aabb;
+        /// @brief The index of the primitive.
+        NodeIndex primitiveIndex;
+    };
+
+    /// @brief A split found by the spatial split builder.
+    struct SplitCandidate {
+        /// @brief The SAH cost of the split (without the traversal cost).
+        float cost = Infinity;
+        /// @brief The split axis, or -1 if no split was found.
+        int axis = -1;
+        /// @brief The position of the split plane along the axis.
+        float position = 0;
+    };
+
+    /// @brief The number of bins used per axis when evaluating spatial splits.
+    static constexpr int SpatialBinCount = 16;
+    /// @brief Spatial splits are only evaluated if the children of the best
+    /// object split overlap by more than this fraction of the root's surface
+    /// area (following Stich et al., "Spatial Splits in Bounding Volume
+    /// Hierarchies", 2009).
+    static constexpr float SpatialSplitAlpha = 1e-5f;
+
+    /// @brief The maximum number of references that may be added, relative
+    /// to the number of primitives.
+    float m_splitBudget;
+    /// @brief Computes the bounds of the clipped parts of primitives.
+    ClipFunction m_clippedBoundingBox;
+
+    /// @brief Reserves one reference from the budget of the spatial split
+    /// builder, returns false if the budget is exhausted.
+    static bool consumeSplitBudget(BuildContext &ctx) {
+        NodeIndex available = ctx.splitBudget.load();
+        while (available > 0) {
+            if (ctx.splitBudget.compare_exchange_weak(available, available - 1))
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Finds the object split (which partitions the references by the
+     * centers of their bounding boxes) with the lowest SAH cost.
+     * @param out leftBounds, rightBounds The bounding boxes of the children
+     * of the best split, used to measure how much they overlap.
+     */
+    SplitCandidate findObjectSplit(const std::vector<Reference> &refs,
+                                   Bounds &leftBounds,
+                                   Bounds &rightBounds) const {
+        Bounds centerBounds;
+        for (const Reference &ref : refs)
+            centerBounds.extend(ref.aabb.center());
+
+        SplitCandidate best;
+        for (int axis = 0; axis < 3; axis++) {
+            const float stepSize = centerBounds.diagonal()[axis] / BinCount;
+            if (stepSize < Epsilon)
+                continue;
+
+            Bin bins[BinCount];
+            for (const Reference &ref : refs) {
+                const NodeIndex binIdx =
+                    clamp(NodeIndex((ref.aabb.center()[axis] -
+                                     centerBounds.min()[axis]) /
+                                    stepSize),
+                          0,
+                          BinCount - 1);
+                bins[binIdx].add(ref.aabb);
+            }
+
+            // right[i] contains bins i+1, i+2, ..., binCount-1
+            Bin right[BinCount - 1];
+            right[BinCount - 2] = bins[BinCount - 1];
+            for (NodeIndex i = BinCount - 3; i >= 0; i--) {
+                right[i] = right[i + 1];
+                right[i].add(bins[i + 1]);
+            }
+
+            Bin left;
+            for (NodeIndex i = 0; i < BinCount - 1; i++) {
+                left.add(bins[i]);
+                if (left.primitiveCount == 0 || right[i].primitiveCount == 0)
+                    continue;
+
+                const float cost =
+                    left.primitiveCount * surfaceArea(left.aabb) +
+                    right[i].primitiveCount * surfaceArea(right[i].aabb);
+                if (cost < best.cost) {
+                    best.cost = cost;
+                    best.axis = axis;
+                    best.position =
+                        centerBounds.min()[axis] + (i + 1) * stepSize;
+                    leftBounds  = left.aabb;
+                    rightBounds = right[i].aabb;
+                }
+            }
+        }
+        return best;
+    }
+
+    /**
+     * @brief Finds the spatial split (which splits the bounds of the node at
+     * a plane, clipping references that straddle it) with the lowest SAH
+     * cost. Straddling references are counted on both sides.
+     */
+    SplitCandidate findSpatialSplit(const std::vector<Reference> &refs,
+                                    const Bounds &bounds) const {
+        SplitCandidate best;
+        for (int axis = 0; axis < 3; axis++) {
+            const float origin   = bounds.min()[axis];
+            const float stepSize = bounds.diagonal()[axis] / SpatialBinCount;
+            if (stepSize < Epsilon)
+                continue;
+
+            // a reference enters the bin its bounding box starts in and
+            // exits the bin it ends in, and contributes the clipped bounds
+            // of the part of it that lies within a bin to every bin it spans
+            Bounds binBounds[SpatialBinCount];
+            NodeIndex entries[SpatialBinCount] = {};
+            NodeIndex exits[SpatialBinCount]   = {};
+            for (const Reference &ref : refs) {
+                const int first =
+                    clamp(int((ref.aabb.min()[axis] - origin) / stepSize),
+                          0,
+                          SpatialBinCount - 1);
+                const int last =
+                    clamp(int((ref.aabb.max()[axis] - origin) / stepSize),
+                          first,
+                          SpatialBinCount - 1);
+                entries[first]++;
+                exits[last]++;
+
+                if (first == last) {
+                    binBounds[first].extend(ref.aabb);
+                    continue;
+                }
+                for (int bin = first; bin <= last; bin++) {
+                    Bounds slab = ref.aabb;
+                    if (bin > first)
+                        slab.min()[axis] = origin + bin * stepSize;
+                    if (bin < last)
+                        slab.max()[axis] = origin + (bin + 1) * stepSize;
+                    binBounds[bin].extend(
+                        m_clippedBoundingBox(ref.primitiveIndex, slab));
+                }
+            }
+
+            // rightBox[i], rightCount[i] contain bins
+            //     i+1, i+2, ..., binCount-1
+            Bounds rightBox[SpatialBinCount - 1];
+            NodeIndex rightCount[SpatialBinCount - 1];
+            Bounds box;
+            NodeIndex count = 0;
+            for (int i = SpatialBinCount - 2; i >= 0; i--) {
+                box.extend(binBounds[i + 1]);
+                count += exits[i + 1];
+                rightBox[i]   = box;
+                rightCount[i] = count;
+            }
+
+            Bounds leftBox;
+            NodeIndex leftCount = 0;
+            for (int i = 0; i < SpatialBinCount - 1; i++) {
+                leftBox.extend(binBounds[i]);
+                leftCount += entries[i];
+                if (leftCount == 0 || rightCount[i] == 0)
+                    continue;
+
+                const float cost = leftCount * surfaceArea(leftBox) +
+                                   rightCount[i] * surfaceArea(rightBox[i]);
+                if (cost < best.cost) {
+                    best.cost     = cost;
+                    best.axis     = axis;
+                    best.position = origin + (i + 1) * stepSize;
+                }
+            }
+        }
+        return best;
+    }
+
+    /**
+     * @brief Distributes the references of a node to its two children, using
+     * either an object split or a spatial split (whichever has the lower SAH
+     * cost).
+     * @return false if no split is cheaper than creating a leaf.
+     */
+    bool splitReferences(const Bounds &bounds,
+                         const std::vector<Reference> &refs,
+                         std::vector<Reference> &left,
+                         std::vector<Reference> &right, BuildContext &ctx) {
+        const float leafCost = surfaceArea(bounds) * refs.size();
+
+        Bounds leftBounds, rightBounds;
+        const SplitCandidate objectSplit =
+            findObjectSplit(refs, leftBounds, rightBounds);
+
+        // spatial splits are only worth trying if the children of the object
+        // split overlap noticeably (or no object split exists at all)
+        SplitCandidate spatialSplit;
+        if (ctx.splitBudget > 0) {
+            const Bounds overlap(
+                elementwiseMax(leftBounds.min(), rightBounds.min()),
+                elementwiseMin(leftBounds.max(), rightBounds.max()));
+            if (objectSplit.axis == -1 ||
+                (!overlap.isEmpty() &&
+                 surfaceArea(overlap) > SpatialSplitAlpha * ctx.rootArea))
+                spatialSplit = findSpatialSplit(refs, bounds);
+        }
+
+        if (std::min(objectSplit.cost, spatialSplit.cost) >= leafCost) {
+            return false;
+        }
+
+        if (objectSplit.cost <= spatialSplit.cost) {
+            for (const Reference &ref : refs) {
+                if (ref.aabb.center()[objectSplit.axis] < objectSplit.position)
+                    left.push_back(ref);
+                else
+                    right.push_back(ref);
+            }
+            return !left.empty() && !right.empty();
+        }
+
+        const int axis       = spatialSplit.axis;
+        const float position = spatialSplit.position;
+        for (const Reference &ref : refs) {
+            if (ref.aabb.max()[axis] <= position) {
+                left.push_back(ref);
+                continue;
+            }
+            if (ref.aabb.min()[axis] >= position) {
+                right.push_back(ref);
+                continue;
+            }
+
+            // the reference straddles the split plane
+            if (consumeSplitBudget(ctx)) {
+                Bounds leftClip = ref.aabb, rightClip = ref.aabb;
+                leftClip.max()[axis]  = position;
+                rightClip.min()[axis] = position;
+                const Reference leftPart{
+                    m_clippedBoundingBox(ref.primitiveIndex, leftClip),
+                    ref.primitiveIndex
+                };
+                const Reference rightPart{
+                    m_clippedBoundingBox(ref.primitiveIndex, rightClip),
+                    ref.primitiveIndex
+                };
+
+                // the primitive might only touch the split plane
+                const bool hasLeft =
+                    leftPart.aabb.min()[axis] <= leftPart.aabb.max()[axis];
+                const bool hasRight =
+                    rightPart.aabb.min()[axis] <= rightPart.aabb.max()[axis];
+                if (hasLeft && hasRight) {
+                    left.push_back(leftPart);
+                    right.push_back(rightPart);
+                    continue;
+                }
+                ctx.splitBudget++;
+                if (hasLeft || hasRight) {
+                    (hasLeft ? left : right).push_back(ref);
+                    continue;
+                }
+            }
+
+            // out of budget, the whole reference goes to one side
+            if (ref.aabb.center()[axis] < position)
+                left.push_back(ref);
+            else
+                right.push_back(ref);
+        }
+        return !left.empty() && !right.empty();
+    }
+
+    /**
+     * @brief Builds the subtree of a node from the given references, using
+     * spatial splits where they pay off.
+     */
+    void subdivide(NodeIndex nodeIndex, std::vector<Reference> refs,
+                   BuildContext &ctx, int depth) {
+        Node &node = m_nodes[nodeIndex];
+        node.aabb  = Bounds::empty();
+        for (const Reference &ref : refs)
+            node.aabb.extend(ref.aabb);
+
+        // same stopping criteria as the object split builder
+        std::vector<Reference> left, right;
+        if (refs.size() <= size_t(m_leafSize) || depth >= MaxDepth ||
+            !splitReferences(node.aabb, refs, left, right, ctx)) {
+            // leaves take their range of m_primitiveIndices in the order
+            // in which they are created
+            const NodeIndex count = NodeIndex(refs.size());
+            const NodeIndex first = ctx.referenceCount.fetch_add(count);
+            for (NodeIndex i = 0; i < count; i++)
+                m_primitiveIndices[first + i] = refs[i].primitiveIndex;
+            node.leftFirst      = first;
+            node.primitiveCount = count;
+            return;
+        }
+
+        // the references of this node are no longer needed
+        std::vector<Reference>().swap(refs);
+
+        const NodeIndex leftChildIndex = allocateChildren(node, ctx);
+
+        std::thread worker;
+        if (NodeIndex(left.size()) >= ParallelSubtreeThreshold &&
+            acquireBuildThread()) {
+            worker = std::thread(
+                [this, &ctx, leftChildIndex, depth, left = std::move(left)]() mutable {
+                    const double start = threadCpuTime();
+                    subdivide(leftChildIndex, std::move(left), ctx, depth + 1);
+                    ctx.addCpuTime(start);
+                    releaseBuildThread();
+                });
+        } else {
+            subdivide(leftChildIndex, std::move(left), ctx, depth + 1);
+        }
+
+        subdivide(leftChildIndex + 1, std::move(right), ctx, depth + 1);
+
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+public:
+    SpatialSplitBuilder(std::vector<Node> &nodes,
+                        std::vector<int> &primitiveIndices, NodeIndex leafSize,
+                        float splitBudget, ClipFunction clippedBoundingBox)
+        : BinaryTreeBuilder(nodes, primitiveIndices, leafSize),
+          m_splitBudget(splitBudget),
+          m_clippedBoundingBox(std::move(clippedBoundingBox)) {}
+
+    /// @brief Builds the tree over all primitives, whose bounds must have
+    /// been fetched into @c ctx .
+    void build(BuildContext &ctx) {
+        // every spatial split adds one reference, so the budget bounds the
+        // number of leaf entries (and hence nodes) that need to be allocated
+        const NodeIndex primitiveCount =
+            NodeIndex(ctx.primitiveBounds.size());
+        const NodeIndex budget = NodeIndex(m_splitBudget * primitiveCount);
+        ctx.splitBudget        = budget;
+        m_primitiveIndices.resize(primitiveCount + budget);
+        allocateRoot(primitiveCount + budget, ctx);
+
+        std::vector<Reference> refs(primitiveCount);
+        Bounds rootBounds;
+        for (NodeIndex i = 0; i < primitiveCount; i++) {
+            refs[i] = { ctx.primitiveBounds[i], i };
+            rootBounds.extend(refs[i].aabb);
+        }
+        ctx.rootArea = surfaceArea(rootBounds);
+
+        subdivide(0, std::move(refs), ctx, 0);
+
+        // release the references that were not needed
+        m_primitiveIndices.resize(ctx.referenceCount);
+        m_primitiveIndices.shrink_to_fit();
+    }
+};
+
+} // namespace lightwave::bvh
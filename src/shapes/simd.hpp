@@ -0,0 +1,301 @@
+/**
+ * @file simd.hpp
+ * @brief Minimal wrappers around SIMD instructions, used to test several
+ * bounding boxes (or primitives) against a ray at once.
+ */
+
+#pragma once
+
+#include <lightwave/core.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#if defined(__AVX__)
+#define LW_SIMD_AVX
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define LW_SIMD_SSE
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define LW_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace lightwave::simd {
+
+/**
+ * @brief A vector of @c Width floats. This generic version is implemented
+ * with plain loops (which the compiler may or may not vectorize), while the
+ * specializations below map directly onto the instruction sets of the target.
+ */
+template <int Width> struct Float {
+    std::array<float, Width> v;
+
+    /// @brief Loads @c Width consecutive floats (no alignment required).
+    static Float load(const float *ptr) {
+        Float result;
+        std::copy(ptr, ptr + Width, result.v.begin());
+        return result;
+    }
+    /// @brief Loads @c Width consecutive bytes, converted to floats.
+    static Float load(const uint8_t *ptr) {
+        Float result;
+        std::copy(ptr, ptr + Width, result.v.begin());
+        return result;
+    }
+    /// @brief Creates a vector whose components all have the value @c s .
+    static Float broadcast(float s) {
+        Float result;
+        result.v.fill(s);
+        return result;
+    }
+    /// @brief Stores the components to @c ptr (no alignment required).
+    void store(float *ptr) const { std::copy(v.begin(), v.end(), ptr); }
+
+    friend Float operator+(const Float &a, const Float &b) {
+        Float result;
+        for (int i = 0; i < Width; i++)
+            result.v[i] = a.v[i] + b.v[i];
+        return result;
+    }
+    friend Float operator-(const Float &a, const Float &b) {
+        Float result;
+        for (int i = 0; i < Width; i++)
+            result.v[i] = a.v[i] - b.v[i];
+        return result;
+    }
+    friend Float operator*(const Float &a, const Float &b) {
+        Float result;
+        for (int i = 0; i < Width; i++)
+            result.v[i] = a.v[i] * b.v[i];
+        return result;
+    }
+    friend Float operator/(const Float &a, const Float &b) {
+        Float result;
+        for (int i = 0; i < Width; i++)
+            result.v[i] = a.v[i] / b.v[i];
+        return result;
+    }
+    friend Float min(const Float &a, const Float &b) {
+        Float result;
+        for (int i = 0; i < Width; i++)
+            result.v[i] = std::min(a.v[i], b.v[i]);
+        return result;
+    }
+    friend Float max(const Float &a, const Float &b) {
+        Float result;
+        for (int i = 0; i < Width; i++)
+            result.v[i] = std::max(a.v[i], b.v[i]);
+        return result;
+    }
+    /// @brief Returns a bitmask whose i-th bit is set if @code a[i] < b[i]
+    /// @endcode .
+    friend int lessThan(const Float &a, const Float &b) {
+        int mask = 0;
+        for (int i = 0; i < Width; i++)
+            mask |= int(a.v[i] < b.v[i]) << i;
+        return mask;
+    }
+    /// @brief Returns a bitmask whose i-th bit is set if @code a[i] <= b[i]
+    /// @endcode .
+    friend int lessEqual(const Float &a, const Float &b) {
+        int mask = 0;
+        for (int i = 0; i < Width; i++)
+            mask |= int(a.v[i] <= b.v[i]) << i;
+        return mask;
+    }
+};
+
+#if defined(LW_SIMD_SSE)
+template <> struct Float<4> {
+    __m128 v;
+
+    static Float load(const float *ptr) { return { _mm_loadu_ps(ptr) }; }
+    static Float load(const uint8_t *ptr) {
+        int32_t bytes;
+        std::memcpy(&bytes, ptr, sizeof(bytes));
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i words =
+            _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+        return { _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero)) };
+    }
+    static Float broadcast(float s) { return { _mm_set1_ps(s) }; }
+    void store(float *ptr) const { _mm_storeu_ps(ptr, v); }
+
+    friend Float operator+(const Float &a, const Float &b) {
+        return { _mm_add_ps(a.v, b.v) };
+    }
+    friend Float operator-(const Float &a, const Float &b) {
+        return { _mm_sub_ps(a.v, b.v) };
+    }
+    friend Float operator*(const Float &a, const Float &b) {
+        return { _mm_mul_ps(a.v, b.v) };
+    }
+    friend Float operator/(const Float &a, const Float &b) {
+        return { _mm_div_ps(a.v, b.v) };
+    }
+    friend Float min(const Float &a, const Float &b) {
+        return { _mm_min_ps(a.v, b.v) };
+    }
+    friend Float max(const Float &a, const Float &b) {
+        return { _mm_max_ps(a.v, b.v) };
+    }
+    friend int lessThan(const Float &a, const Float &b) {
+        return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v));
+    }
+    friend int lessEqual(const Float &a, const Float &b) {
+        return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v));
+    }
+};
+#elif defined(LW_SIMD_NEON)
+template <> struct Float<4> {
+    float32x4_t v;
+
+    static Float load(const float *ptr) { return { vld1q_f32(ptr) }; }
+    static Float load(const uint8_t *ptr) {
+        uint32_t bytes;
+        std::memcpy(&bytes, ptr, sizeof(bytes));
+        const uint16x8_t words =
+            vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(bytes)));
+        return { vcvtq_f32_u32(vmovl_u16(vget_low_u16(words))) };
+    }
+    static Float broadcast(float s) { return { vdupq_n_f32(s) }; }
+    void store(float *ptr) const { vst1q_f32(ptr, v); }
+
+    friend Float operator+(const Float &a, const Float &b) {
+        return { vaddq_f32(a.v, b.v) };
+    }
+    friend Float operator-(const Float &a, const Float &b) {
+        return { vsubq_f32(a.v, b.v) };
+    }
+    friend Float operator*(const Float &a, const Float &b) {
+        return { vmulq_f32(a.v, b.v) };
+    }
+    friend Float operator/(const Float &a, const Float &b) {
+        return { vdivq_f32(a.v, b.v) };
+    }
+    friend Float min(const Float &a, const Float &b) {
+        return { vminq_f32(a.v, b.v) };
+    }
+    friend Float max(const Float &a, const Float &b) {
+        return { vmaxq_f32(a.v, b.v) };
+    }
+    friend int lessThan(const Float &a, const Float &b) {
+        return movemask(vcltq_f32(a.v, b.v));
+    }
+    friend int lessEqual(const Float &a, const Float &b) {
+        return movemask(vcleq_f32(a.v, b.v));
+    }
+
+private:
+    /// @brief Packs the lanes of a comparison result into a bitmask.
+    static int movemask(uint32x4_t mask) {
+        static const uint32_t bits[4] = { 1, 2, 4, 8 };
+        return int(vaddvq_u32(vandq_u32(mask, vld1q_u32(bits))));
+    }
+};
+#endif
+
+#if defined(LW_SIMD_AVX)
+template <> struct Float<8> {
+    __m256 v;
+
+    static Float load(const float *ptr) { return { _mm256_loadu_ps(ptr) }; }
+    static Float load(const uint8_t *ptr) {
+        const __m128i bytes = _mm_loadl_epi64((const __m128i *) ptr);
+        const __m128 lo     = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(bytes));
+        const __m128 hi =
+            _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4)));
+        return { _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1) };
+    }
+    static Float broadcast(float s) { return { _mm256_set1_ps(s) }; }
+    void store(float *ptr) const { _mm256_storeu_ps(ptr, v); }
+
+    friend Float operator+(const Float &a, const Float &b) {
+        return { _mm256_add_ps(a.v, b.v) };
+    }
+    friend Float operator-(const Float &a, const Float &b) {
+        return { _mm256_sub_ps(a.v, b.v) };
+    }
+    friend Float operator*(const Float &a, const Float &b) {
+        return { _mm256_mul_ps(a.v, b.v) };
+    }
+    friend Float operator/(const Float &a, const Float &b) {
+        return { _mm256_div_ps(a.v, b.v) };
+    }
+    friend Float min(const Float &a, const Float &b) {
+        return { _mm256_min_ps(a.v, b.v) };
+    }
+    friend Float max(const Float &a, const Float &b) {
+        return { _mm256_max_ps(a.v, b.v) };
+    }
+    friend int lessThan(const Float &a, const Float &b) {
+        return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ));
+    }
+    friend int lessEqual(const Float &a, const Float &b) {
+        return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ));
+    }
+};
+#elif defined(LW_SIMD_SSE) || defined(LW_SIMD_NEON)
+/// @brief Without AVX, eight floats are processed as two halves of four.
+template <> struct Float<8> {
+    Float<4> lo, hi;
+
+    static Float load(const float *ptr) {
+        return { Float<4>::load(ptr), Float<4>::load(ptr + 4) };
+    }
+    static Float load(const uint8_t *ptr) {
+        return { Float<4>::load(ptr), Float<4>::load(ptr + 4) };
+    }
+    static Float broadcast(float s) {
+        return { Float<4>::broadcast(s), Float<4>::broadcast(s) };
+    }
+    void store(float *ptr) const {
+        lo.store(ptr);
+        hi.store(ptr + 4);
+    }
+
+    friend Float operator+(const Float &a, const Float &b) {
+        return { a.lo + b.lo, a.hi + b.hi };
+    }
+    friend Float operator-(const Float &a, const Float &b) {
+        return { a.lo - b.lo, a.hi - b.hi };
+    }
+    friend Float operator*(const Float &a, const Float &b) {
+        return { a.lo * b.lo, a.hi * b.hi };
+    }
+    friend Float operator/(const Float &a, const Float &b) {
+        return { a.lo / b.lo, a.hi / b.hi };
+    }
+    friend Float min(const Float &a, const Float &b) {
+        return { min(a.lo, b.lo), min(a.hi, b.hi) };
+    }
+    friend Float max(const Float &a, const Float &b) {
+        return { max(a.lo, b.lo), max(a.hi, b.hi) };
+    }
+    friend int lessThan(const Float &a, const Float &b) {
+        return lessThan(a.lo, b.lo) | (lessThan(a.hi, b.hi) << 4);
+    }
+    friend int lessEqual(const Float &a, const Float &b) {
+        return lessEqual(a.lo, b.lo) | (lessEqual(a.hi, b.hi) << 4);
+    }
+};
+#endif
+
+/// @brief Returns the index of the lowest set bit of a non-zero mask.
+inline int firstBit(int mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(unsigned(mask));
+#else
+    int index = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+} // namespace lightwave::simd
@@ -22,8 +22,8 @@ public:
         surf.pdf = Inv4Pi;
     }
 
-    bool intersect(const Ray &ray, Intersection &its,
-                   Sampler &rng) const override {
+    bool findHit(const Ray &ray, Intersection &its,
+                 Sampler &rng) const override {
         const float od = Vector(ray.origin).dot(ray.direction);
         const float oo = Vector(ray.origin).dot(Vector(ray.origin));
         // since the ray direction is normalized, we have dd=1
@@ -41,13 +41,25 @@ public:
             return false;
         }
 
-        its.t          = t;
-        Point position = ray(t);
+        its.t         = t;
+        its.hit       = HitRecord{};
+        its.hit.shape = this;
+        return true;
+    }
+
+    void populateHit(const Ray &ray, Intersection &its) const override {
+        Point position = ray(its.t);
         position.x()   = clamp(position.x(), -1.f, 1.f);
         position.y()   = clamp(position.y(), -1.f, 1.f);
         position.z()   = clamp(position.z(), -1.f, 1.f);
         populate(its, position);
+    }
 
+    bool intersect(const Ray &ray, Intersection &its,
+                   Sampler &rng) const override {
+        if (!findHit(ray, its, rng))
+            return false;
+        completeHit(ray, its);
         return true;
     }
 
@@ -1,5 +1,6 @@
 #include <catch_amalgamated.hpp>
 #include <lightwave/math.hpp>
+#include <lightwave/warp.hpp>
 
 using namespace lightwave;
 
@@ -52,3 +53,20 @@ TEST_CASE( "Matrix tests", "[math]" ) {
         });
     }
 }
+
+TEST_CASE( "Alias table", "[math]" ) {
+    const std::vector<float> weights { 1, 0, 3, 4, 0.5f };
+    const AliasTable table { weights };
+
+    REQUIRE( table.size() == 5 );
+    REQUIRE( table.probability(2) == Catch::Approx(3 / 8.5) );
+
+    // stratified samples reproduce the distribution up to the stratum size
+    const int samples = 85000;
+    std::vector<int> counts(weights.size());
+    for (int i = 0; i < samples; i++)
+        counts[table.sample((i + 0.5f) / samples)]++;
+    for (size_t i = 0; i < weights.size(); i++)
+        REQUIRE( counts[i] == Catch::Approx(samples * table.probability(int(i))).margin(2) );
+    REQUIRE( counts[1] == 0 );
+}
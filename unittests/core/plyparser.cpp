@@ -0,0 +1,219 @@
+#include <catch_amalgamated.hpp>
+#include <core/plyparser.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+using namespace lightwave;
+
+namespace {
+
+/// @brief Returns the message of the innermost exception, which describes
+/// what went wrong without the context added while unwinding.
+std::string innermostMessage(const std::exception &e) {
+    try {
+        std::rethrow_if_nested(e);
+    } catch (const std::exception &nested) {
+        return innermostMessage(nested);
+    }
+    return e.what();
+}
+
+/// @brief Reads a PLY file that is expected to be invalid, and returns the
+/// reason it was rejected.
+std::string readError(const std::filesystem::path &file) {
+    std::vector<Vector3i> triangles;
+    std::vector<Vertex> vertices;
+    try {
+        readPLY(file, triangles, vertices);
+    } catch (const std::exception &e) {
+        return innermostMessage(e);
+    }
+    return "";
+}
+
+std::filesystem::path temporaryPLY() {
+    return std::filesystem::temp_directory_path() /
+           tfm::format("lightwave-ply-%08x.ply", std::random_device()());
+}
+
+void writeFile(const std::filesystem::path &file, const std::string &contents) {
+    std::ofstream stream(file, std::ios::binary);
+    stream.write(contents.data(), contents.size());
+}
+
+/// @brief A grid of n x n vertices in the xy-plane, split into triangles.
+struct Grid {
+    std::vector<Point> positions;
+    std::vector<Vector3i> triangles;
+
+    Grid(int n) {
+        for (int y = 0; y < n; y++) {
+            for (int x = 0; x < n; x++)
+                positions.push_back(Point(float(x), float(y), float((x * y) % 7)));
+        }
+        for (int y = 0; y + 1 < n; y++) {
+            for (int x = 0; x + 1 < n; x++) {
+                const int i = y * n + x;
+                triangles.push_back({ i, i + 1, i + n + 1 });
+                triangles.push_back({ i, i + n + 1, i + n });
+            }
+        }
+    }
+};
+
+/// @brief Appends values to binary PLY contents in either byte order.
+struct BinaryWriter {
+    bool bigEndian;
+    std::string data;
+
+    template <typename T> void put(T value) {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        if (bigEndian)
+            std::reverse(bytes, bytes + sizeof(T));
+        data.append(bytes, sizeof(T));
+    }
+};
+
+} // namespace
+
+// clang-format off
+
+TEST_CASE( "Binary PLY files", "[ply]" ) {
+    // large enough for the vertices and faces to span several parallel chunks
+    const Grid grid { 200 };
+    const bool bigEndian      = GENERATE(false, true);
+    const bool leadingElement = GENERATE(false, true);
+    const auto file = temporaryPLY();
+
+    const auto write = [&](const std::vector<Vector3i> &triangles, size_t truncate) {
+        BinaryWriter writer {
+            bigEndian, tfm::format("ply\nformat %s 1.0\n", bigEndian ? "binary_big_endian" : "binary_little_endian")
+        };
+        if (leadingElement) {
+            // records of varying size that need to be skipped
+            writer.data += "element material 3\nproperty list uchar int ids\nproperty float roughness\n";
+        }
+        writer.data += tfm::format("element vertex %d\n", grid.positions.size()) +
+                       "property float x\nproperty float y\nproperty float z\n"
+                       "property float nx\nproperty float ny\nproperty float nz\n" +
+                       tfm::format("element face %d\n", triangles.size()) +
+                       "property list uchar int vertex_indices\n"
+                       "end_header\n";
+        if (leadingElement) {
+            for (int i = 0; i < 3; i++) {
+                writer.put<uint8_t>(uint8_t(i));
+                for (int j = 0; j < i; j++)
+                    writer.put<int32_t>(j);
+                writer.put<float>(0.5f);
+            }
+        }
+        for (const Point &position : grid.positions) {
+            for (int axis = 0; axis < 3; axis++)
+                writer.put<float>(position[axis]);
+            for (const float normal : { 0.f, 0.f, 1.f })
+                writer.put<float>(normal);
+        }
+        for (const Vector3i &triangle : triangles) {
+            writer.put<uint8_t>(3);
+            for (int corner = 0; corner < 3; corner++)
+                writer.put<int32_t>(triangle[corner]);
+        }
+        writer.data.resize(writer.data.size() - truncate);
+        writeFile(file, writer.data);
+    };
+
+    SECTION( "Vertices and faces are decoded" ) {
+        write(grid.triangles, 0);
+        std::vector<Vector3i> triangles;
+        std::vector<Vertex> vertices;
+        readPLY(file, triangles, vertices);
+
+        REQUIRE( vertices.size() == grid.positions.size() );
+        for (size_t i = 0; i < vertices.size(); i++) {
+            REQUIRE( vertices[i].position == grid.positions[i] );
+            REQUIRE( vertices[i].normal == Vector(0, 0, 1) );
+        }
+        REQUIRE( triangles == grid.triangles );
+    }
+
+    SECTION( "Truncated files are rejected" ) {
+        write(grid.triangles, 2);
+        REQUIRE_THAT( readError(file), Catch::Matchers::ContainsSubstring("truncated") );
+    }
+
+    SECTION( "Out of range indices are rejected" ) {
+        // in the last parallel chunk of faces
+        std::vector<Vector3i> triangles = grid.triangles;
+        triangles[triangles.size() - 10][1] = int(grid.positions.size());
+        write(triangles, 0);
+        REQUIRE_THAT( readError(file), Catch::Matchers::ContainsSubstring("does not exist") );
+    }
+
+    std::filesystem::remove(file);
+}
+
+TEST_CASE( "ASCII PLY files", "[ply]" ) {
+    // large enough to be split into several chunks that are parsed in parallel
+    const Grid grid { 300 };
+    const auto file = temporaryPLY();
+
+    const std::string header = tfm::format("ply\nformat ascii 1.0\n"
+                                           "element vertex %d\n"
+                                           "property float x\nproperty float y\nproperty float z\n"
+                                           "element face %d\n"
+                                           "property list uchar int vertex_indices\n"
+                                           "end_header\n", grid.positions.size(), grid.triangles.size());
+    std::vector<std::string> lines;
+    for (const Point &position : grid.positions)
+        lines.push_back(tfm::format("%d %d %d", position.x(), position.y(), position.z()));
+    for (const Vector3i &triangle : grid.triangles)
+        lines.push_back(tfm::format("3 %d %d %d", triangle.x(), triangle.y(), triangle.z()));
+
+    const auto write = [&](bool terminated) {
+        std::string contents = header;
+        for (const std::string &line : lines)
+            contents += line + "\n";
+        if (!terminated)
+            contents.pop_back();
+        REQUIRE( contents.size() > (3 << 20) );
+        writeFile(file, contents);
+    };
+    // the line number of a face, counted from the start of the file
+    const auto faceLine = [&](int face) {
+        return std::count(header.begin(), header.end(), '\n') + grid.positions.size() + face + 1;
+    };
+
+    SECTION( "Vertices and faces are parsed" ) {
+        write(GENERATE(false, true));
+        std::vector<Vector3i> triangles;
+        std::vector<Vertex> vertices;
+        readPLY(file, triangles, vertices);
+
+        REQUIRE( vertices.size() == grid.positions.size() );
+        for (size_t i = 0; i < vertices.size(); i++)
+            REQUIRE( vertices[i].position == grid.positions[i] );
+        REQUIRE( triangles == grid.triangles );
+    }
+
+    SECTION( "The earliest error is reported" ) {
+        // both errors lie after the first chunk, in different chunks
+        const int first = 100000, second = 170000;
+        lines[grid.positions.size() + first]  = "3 1 2";
+        lines[grid.positions.size() + second] = "3 1 2 -1";
+        write(true);
+        REQUIRE_THAT( readError(file), Catch::Matchers::EndsWith(tfm::format(" line %d: invalid face", faceLine(first))) );
+    }
+
+    SECTION( "Errors in an unterminated last line are reported" ) {
+        const int last = int(grid.triangles.size()) - 1;
+        lines.back() = tfm::format("3 0 1 %d", grid.positions.size());
+        write(false);
+        REQUIRE_THAT( readError(file), Catch::Matchers::EndsWith(tfm::format(" line %d: vertex index %d is out of range", faceLine(last), grid.positions.size())) );
+    }
+
+    std::filesystem::remove(file);
+}
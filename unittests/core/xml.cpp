@@ -0,0 +1,124 @@
+#include <catch_amalgamated.hpp>
+#include <core/xml.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+using namespace lightwave;
+
+namespace {
+
+/// @brief Records the events reported by the parser as strings.
+struct Recorder : public XMLParser::Delegate {
+    std::vector<std::string> events;
+
+    void open(const std::string &tag,
+              const XMLParser::SourceLocation &loc) override {
+        events.push_back(tfm::format("open %s %d:%d", tag, loc.line, loc.column));
+    }
+    void enter() override { events.push_back("enter"); }
+    void close() override { events.push_back("close"); }
+    void attribute(const std::string &name,
+                   const std::string &value) override {
+        events.push_back(tfm::format("%s=%s", name, value));
+    }
+    void stop() override { events.push_back("stop"); }
+};
+
+/// @brief Parses the input from a stream, and returns the events and the
+/// message of the error (if any).
+std::pair<std::vector<std::string>, std::string> parseStream(const std::string &input) {
+    Recorder recorder;
+    std::istringstream stream(input);
+    try {
+        XMLParser(recorder, stream);
+    } catch (const std::exception &e) {
+        return { recorder.events, e.what() };
+    }
+    return { recorder.events, "" };
+}
+
+/// @brief Parses the input from a file, and returns the events and the
+/// message of the error (if any).
+std::pair<std::vector<std::string>, std::string> parseFile(const std::string &input) {
+    const auto file = std::filesystem::temp_directory_path() /
+                      tfm::format("lightwave-xml-%08x.xml", std::random_device()());
+    std::ofstream(file, std::ios::binary) << input;
+
+    Recorder recorder;
+    std::string error;
+    try {
+        XMLParser(recorder, file);
+    } catch (const std::exception &e) {
+        // the error names the file instead of the stream
+        error = e.what();
+        const size_t position = error.find(file.string());
+        if (position != std::string::npos)
+            error.replace(position, file.string().size(), "stream");
+    }
+    std::filesystem::remove(file);
+    return { recorder.events, error };
+}
+
+} // namespace
+
+// clang-format off
+
+TEST_CASE( "XML parser", "[xml]" ) {
+    const auto parse = [](const std::string &input) {
+        const auto fromStream = parseStream(input);
+        // mapped files and streams are parsed the same way
+        REQUIRE( parseFile(input) == fromStream );
+        return fromStream;
+    };
+
+    SECTION( "Nodes, attributes and locations are reported" ) {
+        const auto [events, error] = parse("<scene>\n"
+                                           "  <integer name=\"width\"\tvalue=\"512\"/>\r\n"
+                                           "  <camera id=\"c1\">\n"
+                                           "  </camera>\n"
+                                           "</scene>\n");
+        REQUIRE( error == "" );
+        REQUIRE( events == std::vector<std::string> {
+            "open scene 1:7", "enter",
+            "open integer 2:11", "name=width", "value=512", "enter", "close",
+            "open camera 3:10", "id=c1", "enter", "close",
+            "close",
+        });
+    }
+
+    SECTION( "Comments may contain dashes" ) {
+        const auto [events, error] = parse("<!-- a - b -- c --->\n"
+                                           "<a/><!---->");
+        REQUIRE( error == "" );
+        REQUIRE( events == std::vector<std::string> { "open a 2:3", "enter", "close" });
+    }
+
+    SECTION( "Escape sequences in strings" ) {
+        const auto [events, error] = parse("<a b=\"x\\ny\\tz\\r\" c=\"\"/>");
+        REQUIRE( error == "" );
+        REQUIRE( events == std::vector<std::string> { "open a 1:3", "b=x\ny\tz\r", "c=", "enter", "close" });
+    }
+
+    SECTION( "Errors report their location" ) {
+        const auto [events, error] = parse("<a>\n"
+                                           "  <b x=\"1\"/>\n"
+                                           "  <c y=2/>\n"
+                                           "</a>\n");
+        REQUIRE( events.back() == "stop" );
+        REQUIRE_THAT( error, Catch::Matchers::EndsWith("while parsing stream:3:9") );
+    }
+
+    SECTION( "Errors at the end of the input report their location" ) {
+        const std::string input = GENERATE(std::string("<a>\n  <b/>\n"),
+                                           std::string("<a>\n  <b/>\n<!-- unterminated"),
+                                           std::string("<a>\n  <b c=\"unterminated"));
+        const auto [events, error] = parse(input);
+        const int lines  = int(std::count(input.begin(), input.end(), '\n'));
+        const int column = int(input.size() - input.rfind('\n'));
+        REQUIRE( events.back() == "stop" );
+        REQUIRE_THAT( error, Catch::Matchers::EndsWith(tfm::format("while parsing stream:%d:%d", lines + 1, column)) );
+    }
+}
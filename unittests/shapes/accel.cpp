@@ -0,0 +1,386 @@
+#include <catch_amalgamated.hpp>
+#include <samplers/independent.cpp>
+#include <shapes/accel.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <random>
+
+using namespace lightwave;
+
+namespace {
+
+/// @brief A cloud of small spheres, used to compare BVH traversal against
+/// brute force intersection.
+class SphereCloud : public AccelerationStructure {
+    std::vector<Point> m_centers;
+    /// @brief The index each sphere had when it was passed in, which changes
+    /// if the spheres are permuted into leaf order.
+    std::vector<int> m_ids;
+    float m_radius;
+
+protected:
+    int numberOfPrimitives() const override { return int(m_centers.size()); }
+
+    bool intersect(int primitiveIndex, const Ray &ray, Intersection &its,
+                   Sampler &rng) const override {
+        const Vector oc = ray.origin - m_centers[primitiveIndex];
+        const float b   = oc.dot(ray.direction);
+        const float c   = oc.lengthSquared() - sqr(m_radius);
+        const float d   = b * b - c;
+        if (d < 0)
+            return false;
+
+        const float t = -b - sqrt(d);
+        if (t < Epsilon || t > its.t)
+            return false;
+
+        its.t = t;
+        return true;
+    }
+
+    Bounds getBoundingBox(int primitiveIndex) const override {
+        return Bounds(m_centers[primitiveIndex] - Vector(m_radius),
+                      m_centers[primitiveIndex] + Vector(m_radius));
+    }
+
+    Point getCentroid(int primitiveIndex) const override {
+        return m_centers[primitiveIndex];
+    }
+
+    bool permutePrimitives(const std::vector<int> &order) override {
+        std::vector<Point> centers(order.size());
+        std::vector<int> ids(order.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            centers[i] = m_centers[order[i]];
+            ids[i]     = m_ids[order[i]];
+        }
+        m_centers = std::move(centers);
+        m_ids     = std::move(ids);
+        return true;
+    }
+
+public:
+    using AccelerationStructure::intersect;
+
+    SphereCloud(const Properties &properties, std::vector<Point> centers,
+                float radius,
+                const std::filesystem::path &cacheDirectory = {})
+        : AccelerationStructure(properties), m_centers(std::move(centers)),
+          m_ids(m_centers.size()), m_radius(radius) {
+        std::iota(m_ids.begin(), m_ids.end(), 0);
+        if (cacheDirectory.empty()) {
+            buildAccelerationStructure();
+        } else {
+            hash::fnv1a hash;
+            hash.update(m_centers.data(), m_centers.size() * sizeof(Point));
+            buildAccelerationStructure(cacheDirectory, hash);
+        }
+    }
+
+    /// @brief Moves the spheres and refits the BVH.
+    void moveCenters(const std::vector<Point> &centers) {
+        for (size_t i = 0; i < m_centers.size(); i++)
+            m_centers[i] = centers[m_ids[i]];
+        refitAccelerationStructure();
+    }
+
+    /// @brief Intersects all spheres without using the BVH.
+    bool intersectBruteForce(const Ray &ray, Intersection &its,
+                             Sampler &rng) const {
+        bool wasIntersected = false;
+        for (int i = 0; i < numberOfPrimitives(); i++)
+            wasIntersected |= intersect(i, ray, its, rng);
+        return wasIntersected;
+    }
+
+    std::string toString() const override { return "SphereCloud[]"; }
+};
+
+// clang-format off
+
+/// @brief Returns a random point in the cube [-scale,scale]^3.
+Point randomPoint(std::mt19937 &gen, float scale = 1) {
+    std::uniform_real_distribution<float> uniform(-1, 1);
+    return Point(scale * uniform(gen), scale * uniform(gen), scale * uniform(gen));
+}
+
+/// @brief Traces random rays through the sphere cloud and requires the BVH
+/// to find the same closest hits as brute force intersection.
+/// @return The number of rays that hit.
+int requireMatchesBruteForce(const SphereCloud &cloud, std::mt19937 &gen,
+                             int count) {
+    Properties props;
+    Independent sampler { props };
+    int hits = 0;
+    for (int i = 0; i < count; i++) {
+        const Ray ray { randomPoint(gen, 2), (randomPoint(gen) - randomPoint(gen)).normalized() };
+
+        Intersection expected, actual;
+        const bool expectedHit = cloud.intersectBruteForce(ray, expected, sampler);
+        REQUIRE( cloud.intersect(ray, actual, sampler) == expectedHit );
+        REQUIRE( actual.t == expected.t );
+        REQUIRE( cloud.occluded(ray, Infinity, sampler) == expectedHit );
+        if (expectedHit) {
+            REQUIRE( !cloud.occluded(ray, 0.99f * expected.t, sampler) );
+            // the statistics are used by the aov integrator
+            REQUIRE( actual.stats.bvhCounter > 0 );
+            REQUIRE( actual.stats.primCounter > 0 );
+        }
+        hits += expectedHit;
+    }
+    return hits;
+}
+
+} // namespace
+
+TEST_CASE( "BVH tests", "[accel]" ) {
+    std::mt19937 gen(42);
+    std::vector<Point> centers(5000);
+    for (auto &center : centers)
+        center = randomPoint(gen);
+    const std::string layout = GENERATE("bvh2", "bvh4", "bvh8");
+    const bool compress      = GENERATE(false, true);
+    const std::string builder = GENERATE("sah", "sbvh", "lbvh");
+    const bool reorder        = GENERATE(false, true);
+    Properties props;
+    props.set<std::string>("bvh", layout);
+    props.set<bool>("compress", compress);
+    props.set<std::string>("builder", builder);
+    props.set<bool>("reorderPrimitives", reorder);
+    const SphereCloud cloud { props, centers, 0.02f };
+
+    Independent sampler { props };
+
+    SECTION( "BVH traversal agrees with brute force" ) {
+        REQUIRE( requireMatchesBruteForce(cloud, gen, 2000) > 0 );
+    }
+
+    SECTION( "BVH traversal handles axis-aligned rays" ) {
+        for (int i = 0; i < 200; i++) {
+            Vector direction { 0, 0, 0 };
+            direction[i % 3] = i % 2 ? 1 : -1;
+            const Ray ray { randomPoint(gen), direction };
+
+            Intersection expected, actual;
+            const bool expectedHit = cloud.intersectBruteForce(ray, expected, sampler);
+            REQUIRE( cloud.intersect(ray, actual, sampler) == expectedHit );
+            REQUIRE( actual.t == expected.t );
+        }
+    }
+
+    SECTION( "Packet traversal agrees with brute force" ) {
+        int hits = 0;
+        for (int i = 0; i < 500; i++) {
+            // rays share an origin and spread out slightly, like camera rays
+            const Point origin = randomPoint(gen, 2);
+            const Vector axis  = (randomPoint(gen) - origin).normalized();
+            RayPacket packet;
+            packet.size = 1 + i % RayPacket::MaxSize;
+            for (int j = 0; j < packet.size; j++) {
+                Vector direction = (axis + 0.1f * (randomPoint(gen) - Point(0))).normalized();
+                if (j == 3) {
+                    // axis-aligned rays have infinite inverse directions
+                    direction = Vector(0, 0, 0);
+                    direction[i % 3] = i % 2 ? 1 : -1;
+                }
+                packet.rays[j] = Ray(origin, direction);
+                packet.rng[j]  = &sampler;
+            }
+
+            // leave out some of the rays to test partially active packets
+            const int mask = i % 4 ? packet.mask() : packet.mask() & 0x5555;
+            Intersection actual[RayPacket::MaxSize];
+            const int hitMask = cloud.intersectPacket(packet, mask, actual);
+            for (int j = 0; j < packet.size; j++) {
+                if (!(mask & (1 << j))) {
+                    REQUIRE( !(hitMask & (1 << j)) );
+                    REQUIRE( actual[j].t == Infinity );
+                    continue;
+                }
+
+                Intersection expected;
+                const bool expectedHit = cloud.intersectBruteForce(packet.rays[j], expected, sampler);
+                REQUIRE( bool(hitMask & (1 << j)) == expectedHit );
+                REQUIRE( actual[j].t == expected.t );
+                hits += expectedHit;
+            }
+        }
+        REQUIRE( hits > 0 );
+    }
+}
+
+TEST_CASE( "BVH with large leaves", "[accel]" ) {
+    // spheres sharing the same center cannot be split by the builder, which
+    // results in a leaf that exceeds the maximum leaf size of compressed nodes
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> uniform(-1, 1);
+    std::vector<Point> centers(100, Point(0.5f, 0.25f, 0));
+    for (int i = 0; i < 100; i++)
+        centers.push_back(Point(uniform(gen), uniform(gen), uniform(gen)));
+
+    const std::string layout = GENERATE("bvh2", "bvh4", "bvh8");
+    const std::string order  = GENERATE("build", "depthfirst", "treelets");
+    Properties props;
+    props.set<std::string>("bvh", layout);
+    props.set<bool>("compress", layout != "bvh2");
+    props.set<std::string>("nodeOrder", order);
+    const SphereCloud cloud { props, centers, 0.1f };
+
+    Independent sampler { props };
+    for (int i = 0; i < 500; i++) {
+        const Point target { uniform(gen), uniform(gen), uniform(gen) };
+        const Point origin { 3 * uniform(gen), 3 * uniform(gen), 3 * uniform(gen) };
+        const Ray ray { origin, (target - origin).normalized() };
+
+        Intersection expected, actual;
+        const bool expectedHit = cloud.intersectBruteForce(ray, expected, sampler);
+        REQUIRE( cloud.intersect(ray, actual, sampler) == expectedHit );
+        REQUIRE( actual.t == expected.t );
+    }
+}
+
+TEST_CASE( "BVH refitting", "[accel]" ) {
+    std::mt19937 gen(11);
+    std::vector<Point> centers(5000);
+    for (auto &center : centers)
+        center = randomPoint(gen);
+
+    const std::string layout = GENERATE("bvh2", "bvh4", "bvh8");
+    const bool dynamic       = GENERATE(false, true);
+    const bool reorder       = GENERATE(false, true);
+    const std::string builder = GENERATE("sah", "lbvh");
+    Properties props;
+    props.set<std::string>("builder", builder);
+    props.set<std::string>("bvh", layout);
+    props.set<bool>("dynamic", dynamic);
+    props.set<bool>("reorderPrimitives", reorder);
+    props.set<bool>("compress", layout == "bvh8");
+    SphereCloud cloud { props, centers, 0.02f };
+
+    // small motions are handled by refitting, while scrambling a part of
+    // the spheres degrades the tree enough to rebuild subtrees
+    for (int frame = 0; frame < 3; frame++) {
+        for (size_t i = 0; i < centers.size(); i++) {
+            if (frame == 2 && i % 3 == 0)
+                centers[i] = randomPoint(gen);
+            else
+                centers[i] = centers[i] + 0.05f * Vector(randomPoint(gen));
+        }
+        cloud.moveCenters(centers);
+        requireMatchesBruteForce(cloud, gen, 500);
+    }
+}
+
+TEST_CASE( "BVH cache", "[accel]" ) {
+    std::mt19937 gen(5);
+    std::vector<Point> centers(2000);
+    for (auto &center : centers)
+        center = randomPoint(gen);
+
+    const auto cacheDirectory = std::filesystem::temp_directory_path() /
+                                tfm::format("lightwave-bvh-cache-%08x", std::random_device()());
+    const auto cacheFiles = [&]() {
+        std::vector<std::filesystem::path> files;
+        for (const auto &entry : std::filesystem::directory_iterator(cacheDirectory))
+            files.push_back(entry.path());
+        return files;
+    };
+
+    Properties props;
+    props.set<std::string>("bvh", "bvh4");
+    props.set<bool>("reorderPrimitives", GENERATE(false, true));
+    const SphereCloud built { props, centers, 0.02f, cacheDirectory };
+    REQUIRE( cacheFiles().size() == 1 );
+
+    SECTION( "BVH is loaded from the cache" ) {
+        const SphereCloud loaded { props, centers, 0.02f, cacheDirectory };
+        REQUIRE( cacheFiles().size() == 1 );
+        requireMatchesBruteForce(loaded, gen, 500);
+    }
+
+    SECTION( "Changed primitives are not loaded from the cache" ) {
+        centers[0] = Point(5, 5, 5);
+        const SphereCloud changed { props, centers, 0.02f, cacheDirectory };
+        REQUIRE( cacheFiles().size() == 2 );
+        requireMatchesBruteForce(changed, gen, 500);
+    }
+
+    SECTION( "Corrupt cache files are ignored" ) {
+        const auto file = cacheFiles().front();
+        std::filesystem::resize_file(file, std::filesystem::file_size(file) / 2);
+        const SphereCloud rebuilt { props, centers, 0.02f, cacheDirectory };
+        requireMatchesBruteForce(rebuilt, gen, 500);
+    }
+
+    SECTION( "Cache files with out of range nodes are ignored" ) {
+        // the header is followed by the nodes, which end with leftFirst and
+        // primitiveCount, and then by the primitive indices
+        const auto file = cacheFiles().front();
+        std::fstream stream(file, std::ios::in | std::ios::out | std::ios::binary);
+        uint64_t counts[2];
+        stream.seekg(16);
+        stream.read(reinterpret_cast<char *>(counts), sizeof(counts));
+        const size_t nodeSize = (std::filesystem::file_size(file) - 32 -
+                                 counts[1] * sizeof(int32_t)) / counts[0];
+
+        // the indices of the right child or the last primitive would
+        // overflow if computed in 32 bits
+        const int32_t root[2] = { INT32_MAX, GENERATE(0, 2) };
+        stream.seekp(32 + nodeSize - sizeof(root));
+        stream.write(reinterpret_cast<const char *>(root), sizeof(root));
+        stream.close();
+
+        const SphereCloud rebuilt { props, centers, 0.02f, cacheDirectory };
+        requireMatchesBruteForce(rebuilt, gen, 500);
+    }
+
+    std::filesystem::remove_all(cacheDirectory);
+}
+
+TEST_CASE( "BVH statistics", "[accel]" ) {
+    std::mt19937 gen(13);
+    std::uniform_real_distribution<float> uniform(-1, 1);
+    std::vector<Point> centers(3000);
+    for (auto &center : centers)
+        center = Point(uniform(gen), uniform(gen), uniform(gen));
+
+    const auto file = std::filesystem::temp_directory_path() /
+                      tfm::format("lightwave-bvh-nodes-%08x.csv", std::random_device()());
+    Properties props;
+    props.set<std::string>("bvh", GENERATE("bvh2", "bvh8"));
+    props.set<std::string>("builder", GENERATE("sah", "lbvh"));
+    props.set<bool>("statistics", true);
+    props.set<std::string>("statisticsFile", file.string());
+    const SphereCloud cloud { props, centers, 0.02f };
+
+    std::ifstream stream(file);
+    std::string line;
+    REQUIRE( std::getline(stream, line) );
+    REQUIRE( line.starts_with("index,parent,depth,leaf,first,count,") );
+
+    // nodes are listed depth-first, so parents always come before children
+    std::map<int, int> depths;
+    int nodes = 0, primitives = 0;
+    while (std::getline(stream, line)) {
+        int index, parent, depth, leaf, first, count;
+        REQUIRE( std::sscanf(line.c_str(), "%d,%d,%d,%d,%d,%d", &index, &parent, &depth, &leaf, &first, &count) == 6 );
+        if (nodes++ == 0) {
+            REQUIRE( parent == -1 );
+            REQUIRE( depth == 0 );
+        } else {
+            REQUIRE( depths.count(parent) == 1 );
+            REQUIRE( depth == depths[parent] + 1 );
+        }
+        depths[index] = depth;
+        REQUIRE( (leaf == 1) == (count > 0) );
+        primitives += count;
+    }
+    // a binary tree has one fewer internal nodes than leaves
+    REQUIRE( nodes % 2 == 1 );
+    REQUIRE( primitives == int(centers.size()) );
+
+    stream.close();
+    std::filesystem::remove(file);
+}
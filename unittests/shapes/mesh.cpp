@@ -0,0 +1,513 @@
+#include <catch_amalgamated.hpp>
+#include <samplers/independent.cpp>
+#include <shapes/mesh.cpp>
+
+#include <fstream>
+#include <random>
+#include <thread>
+
+using namespace lightwave;
+
+// clang-format off
+
+namespace {
+
+/// @brief Rays that start anywhere within the given bounds, which resembles
+/// the secondary rays of interior scenes.
+std::vector<Ray> benchmarkRays(const Bounds &bounds, int count) {
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<float> uniform(0, 1);
+    std::vector<Ray> rays;
+    rays.reserve(count);
+    for (int i = 0; i < count; i++) {
+        Point origin;
+        for (int dim = 0; dim < 3; dim++)
+            origin[dim] = bounds.min()[dim] + uniform(gen) * bounds.diagonal()[dim];
+        const Vector direction = squareToUniformSphere({ uniform(gen), uniform(gen) });
+        rays.emplace_back(origin, direction);
+    }
+    return rays;
+}
+
+struct BenchmarkResult {
+    /// @brief The time of the fastest run in seconds.
+    float bestTime;
+    int hits;
+};
+
+/// @brief Intersects all rays with the shape several times and reports the
+/// fastest run to reduce noise.
+BenchmarkResult bestOfRuns(const std::vector<Ray> &rays, const Shape &shape) {
+    Properties props;
+    Independent sampler { props };
+    BenchmarkResult result { .bestTime = Infinity, .hits = 0 };
+    for (int run = 0; run < 5; run++) {
+        result.hits = 0;
+        const Timer timer;
+        for (const Ray &ray : rays) {
+            Intersection its;
+            result.hits += shape.intersect(ray, its, sampler);
+        }
+        result.bestTime = std::min(result.bestTime, timer.getElapsedTime());
+    }
+    return result;
+}
+
+/// @brief Intersects random rays with both shapes and requires them to
+/// agree on every hit, both for single rays and for packets of them. The
+/// rays start anywhere within three times the given bounds, so that some of
+/// them miss.
+/// @return The number of rays that hit.
+int requireSameHits(const Shape &expected, const Shape &actual,
+                    const Bounds &bounds, int count) {
+    Properties props;
+    Independent sampler { props };
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<float> uniform(0, 1);
+    RayPacket packet;
+    Intersection packetExpected[RayPacket::MaxSize];
+    bool packetExpectedHit[RayPacket::MaxSize];
+    int hits = 0;
+    for (int i = 0; i < count; i++) {
+        Point origin;
+        for (int dim = 0; dim < 3; dim++)
+            origin[dim] = bounds.min()[dim] + (3 * uniform(gen) - 1) * bounds.diagonal()[dim];
+        const Ray ray { origin, squareToUniformSphere({ uniform(gen), uniform(gen) }) };
+
+        Intersection expectedIts, actualIts;
+        const bool expectedHit = expected.intersect(ray, expectedIts, sampler);
+
+        packetExpected[packet.size]    = expectedIts;
+        packetExpectedHit[packet.size] = expectedHit;
+        packet.rays[packet.size]       = ray;
+        packet.rng[packet.size++]      = &sampler;
+        if (packet.size == RayPacket::MaxSize || i == count - 1) {
+            Intersection packetActual[RayPacket::MaxSize];
+            const int hitMask = actual.intersectPacket(packet, packet.mask(), packetActual);
+            for (int j = 0; j < packet.size; j++) {
+                REQUIRE( bool(hitMask >> j & 1) == packetExpectedHit[j] );
+                if (packetExpectedHit[j])
+                    REQUIRE( packetActual[j].t == Catch::Approx(packetExpected[j].t).epsilon(1e-5) );
+            }
+            packet.size = 0;
+        }
+        REQUIRE( actual.intersect(ray, actualIts, sampler) == expectedHit );
+        REQUIRE( actual.occluded(ray, Infinity, sampler) == expectedHit );
+        if (!expectedHit)
+            continue;
+        REQUIRE( actualIts.t == Catch::Approx(expectedIts.t).epsilon(1e-5) );
+        REQUIRE( (actualIts.position - expectedIts.position).length() < 1e-4f * bounds.diagonal().length() );
+        REQUIRE( actualIts.geometryNormal.dot(expectedIts.geometryNormal) > 0.99999f );
+        REQUIRE( actualIts.shadingNormal.dot(expectedIts.shadingNormal) > 0.99999f );
+        REQUIRE( actualIts.uv.x() == Catch::Approx(expectedIts.uv.x()).margin(1e-4) );
+        REQUIRE( actualIts.uv.y() == Catch::Approx(expectedIts.uv.y()).margin(1e-4) );
+        REQUIRE( !actual.occluded(ray, 0.99f * expectedIts.t, sampler) );
+        hits++;
+    }
+    return hits;
+}
+
+} // namespace
+
+TEST_CASE( "Triangle tests", "[mesh]" ) {
+    // rays from the inside of a closed mesh must always hit it
+    const auto meshFile = std::filesystem::path(__FILE__).parent_path() / "../../tests/meshes/icosphere.ply";
+    std::vector<Vector3i> triangles;
+    std::vector<Vertex> vertices;
+    readPLY(meshFile, triangles, vertices);
+
+    const std::string test = GENERATE("cramer", "mollertrumbore", "watertight");
+    const bool precompute  = GENERATE(false, true);
+    const int blocks       = GENERATE(0, 4, 8);
+    Properties props;
+    props.set<std::string>("filename", meshFile.string());
+    props.set<std::string>("triangleTest", test);
+    props.set<bool>("precomputeEdges", precompute);
+    props.set<int>("triangleBlocks", blocks);
+    props.set<int>("leafSize", blocks ? blocks : 2);
+    MeshGeometry geometry { props };
+    geometry.load();
+
+    const Point center = geometry.getBoundingBox().center();
+    Independent sampler { props };
+
+    SECTION( "Random rays hit the mesh" ) {
+        std::mt19937 gen(5);
+        std::uniform_real_distribution<float> uniform(0, 1);
+        for (int i = 0; i < 10000; i++) {
+            const Ray ray { center, squareToUniformSphere({ uniform(gen), uniform(gen) }) };
+            Intersection its;
+            REQUIRE( geometry.intersect(ray, its, sampler) );
+            REQUIRE( geometry.occluded(ray, Infinity, sampler) );
+            REQUIRE( its.t > 0.5f * geometry.getBoundingBox().diagonal().minComponent() / 2 );
+            REQUIRE( its.geometryNormal.dot(ray.direction) != 0 );
+        }
+    }
+
+    if (test == "watertight") {
+        SECTION( "Rays through shared vertices and edges do not leak" ) {
+            for (const Vector3i &triangle : triangles) {
+                for (int i = 0; i < 3; i++) {
+                    const Point &a = vertices[triangle[i]].position;
+                    const Point &b = vertices[triangle[(i + 1) % 3]].position;
+                    for (const Point &target : { a, a + 0.5f * (b - a) }) {
+                        const Ray ray { center, (target - center).normalized() };
+                        Intersection its;
+                        REQUIRE( geometry.intersect(ray, its, sampler) );
+                        REQUIRE( its.t == Catch::Approx((target - center).length()).epsilon(1e-3) );
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE( "PLY polygons and property types", "[mesh]" ) {
+    // a cube made of quads, with double positions and without normals
+    const int quads[6][4] = {
+        { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 },
+        { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 },
+    };
+    const bool binary = GENERATE(false, true);
+    const auto file = std::filesystem::temp_directory_path() /
+                      tfm::format("lightwave-cube-%08x.ply", std::random_device()());
+    {
+        std::ofstream stream(file, std::ios::binary);
+        stream << "ply\n"
+               << (binary ? "format binary_little_endian 1.0\n" : "format ascii 1.0\n")
+               << "element vertex 8\n"
+               << "property double x\nproperty double y\nproperty double z\n"
+               << "property uchar red\n"
+               << "element face 6\n"
+               << "property short flags\n"
+               << "property list uchar ushort vertex_indices\n"
+               << "end_header\n";
+        for (int i = 0; i < 8; i++) {
+            const double position[3] = { double(i & 1), double((i >> 1) & 1), double((i >> 2) & 1) };
+            const uint8_t red = 255;
+            if (binary) {
+                stream.write(reinterpret_cast<const char *>(position), sizeof(position));
+                stream.write(reinterpret_cast<const char *>(&red), 1);
+            } else {
+                stream << position[0] << " " << position[1] << " " << position[2] << " " << int(red) << "\n";
+            }
+        }
+        for (const auto &quad : quads) {
+            const int16_t flags = 7;
+            const uint8_t count = 4;
+            if (binary) {
+                stream.write(reinterpret_cast<const char *>(&flags), sizeof(flags));
+                stream.write(reinterpret_cast<const char *>(&count), 1);
+                for (const int index : quad) {
+                    const uint16_t value = uint16_t(index);
+                    stream.write(reinterpret_cast<const char *>(&value), sizeof(value));
+                }
+            } else {
+                stream << flags << " 4 " << quad[0] << " " << quad[1] << " " << quad[2] << " " << quad[3] << "\n";
+            }
+        }
+    }
+
+    std::vector<Vector3i> triangles;
+    std::vector<Vertex> vertices;
+    readPLY(file, triangles, vertices);
+    std::filesystem::remove(file);
+
+    REQUIRE( vertices.size() == 8 );
+    REQUIRE( triangles.size() == 12 );
+    for (size_t i = 0; i < triangles.size(); i++) {
+        // quads are split into fans that keep their orientation
+        REQUIRE( triangles[i][0] == quads[i / 2][0] );
+        const Point &a = vertices[triangles[i][0]].position;
+        const Point &b = vertices[triangles[i][1]].position;
+        const Point &c = vertices[triangles[i][2]].position;
+        REQUIRE( (b - a).cross(c - a).dot(a - Point(0.5f)) > 0 );
+    }
+
+    // the angles at a corner of a cube are the same for all faces, however
+    // the quads were split
+    for (const Vertex &vertex : vertices) {
+        const Vector expected = (vertex.position - Point(0.5f)).normalized();
+        REQUIRE( vertex.normal.dot(expected) == Catch::Approx(1) );
+    }
+}
+
+TEST_CASE( "PLY hard edges", "[mesh]" ) {
+    // a cube whose faces have vertices of their own, which keeps its edges
+    // sharp unless the normals are welded
+    const Vector faceNormals[6] = {
+        { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 },
+    };
+    const auto file = std::filesystem::temp_directory_path() /
+                      tfm::format("lightwave-hard-cube-%08x.ply", std::random_device()());
+    {
+        std::ofstream stream(file);
+        stream << "ply\nformat ascii 1.0\n"
+               << "element vertex 24\n"
+               << "property float x\nproperty float y\nproperty float z\n"
+               << "element face 6\n"
+               << "property list uchar int vertex_indices\n"
+               << "end_header\n";
+        for (const Vector &n : faceNormals) {
+            // two axes spanning the face, ordered so that the face points outwards
+            const int dim = std::abs(n.x()) > 0 ? 0 : std::abs(n.y()) > 0 ? 1 : 2;
+            Vector a(0), b(0);
+            a[(dim + 1) % 3] = 1;
+            b[(dim + 2) % 3] = 1;
+            if (n[dim] < 0)
+                std::swap(a, b);
+            const Point center = Point(0.5f) + 0.5f * n;
+            for (const auto &[s, t] : { std::pair(-1.f, -1.f), std::pair(1.f, -1.f), std::pair(1.f, 1.f), std::pair(-1.f, 1.f) }) {
+                const Point p = center + 0.5f * (s * a + t * b);
+                stream << p.x() << " " << p.y() << " " << p.z() << "\n";
+            }
+        }
+        for (int face = 0; face < 6; face++)
+            stream << "4 " << 4 * face << " " << 4 * face + 1 << " " << 4 * face + 2 << " " << 4 * face + 3 << "\n";
+    }
+
+    const bool weld = GENERATE(false, true);
+    std::vector<Vector3i> triangles;
+    std::vector<Vertex> vertices;
+    readPLY(file, triangles, vertices, weld);
+    std::filesystem::remove(file);
+
+    REQUIRE( vertices.size() == 24 );
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const Vector expected = weld ? (vertices[i].position - Point(0.5f)).normalized() : faceNormals[i / 4];
+        REQUIRE( vertices[i].normal.dot(expected) == Catch::Approx(1) );
+    }
+}
+
+// hidden by default, run with: blob --order decl "[benchmark]"
+TEST_CASE( "BVH memory layout benchmark", "[.][benchmark]" ) {
+    const auto meshDirectory = std::filesystem::path(__FILE__).parent_path() / "../../tests/meshes";
+    const std::string mesh = GENERATE("bunny.ply", "sibenik.ply");
+
+    std::vector<Ray> rays;
+    int expectedHits = -1;
+    const std::pair<std::string, bool> layouts[] = {
+        { "build", false }, { "depthfirst", false }, { "treelets", false }, { "depthfirst", true }, { "treelets", true },
+    };
+    for (const auto &[order, reorder] : layouts) {
+        Properties props;
+        props.set<std::string>("filename", (meshDirectory / mesh).string());
+        props.set<std::string>("nodeOrder", order);
+        props.set<bool>("reorderPrimitives", reorder);
+        MeshGeometry geometry { props };
+        geometry.load();
+
+        if (rays.empty())
+            rays = benchmarkRays(geometry.getBoundingBox(), 1 << 20);
+
+        const auto [bestTime, hits] = bestOfRuns(rays, geometry);
+        logger(EInfo, "%s with %s node order%s: %.1f ns per ray", mesh, order,
+               reorder ? " and reordered primitives" : "", bestTime * 1e9 / rays.size());
+
+        // the memory layout must not affect the results
+        if (expectedHits < 0)
+            expectedHits = hits;
+        REQUIRE( hits == expectedHits );
+    }
+}
+
+TEST_CASE( "Triangle blocks", "[mesh]" ) {
+    const auto meshFile = std::filesystem::path(__FILE__).parent_path() / "../../tests/meshes/bunny.ply";
+    const std::string test   = GENERATE("mollertrumbore", "watertight");
+    const std::string layout = GENERATE("bvh2", "bvh8");
+    const std::string builder = GENERATE("sah", "sbvh");
+
+    // one by one
+    Properties props;
+    props.set<std::string>("filename", meshFile.string());
+    props.set<std::string>("triangleTest", test);
+    MeshGeometry scalar { props };
+    scalar.load();
+
+    for (const int width : { 4, 8 }) {
+        Properties blockProps;
+        blockProps.set<std::string>("filename", meshFile.string());
+        blockProps.set<std::string>("triangleTest", test);
+        blockProps.set<std::string>("bvh", layout);
+        blockProps.set<bool>("compress", layout != "bvh2");
+        blockProps.set<std::string>("builder", builder);
+        blockProps.set<int>("triangleBlocks", width);
+        blockProps.set<int>("leafSize", 6);
+        MeshGeometry blocked { blockProps };
+        blocked.load();
+
+        REQUIRE( requireSameHits(scalar, blocked, scalar.getBoundingBox(), 20000) > 0 );
+    }
+}
+
+TEST_CASE( "Compact vertices", "[mesh]" ) {
+    const auto meshFile = std::filesystem::path(__FILE__).parent_path() / "../../tests/meshes/rubber_duck_toy_1k.ply";
+
+    Properties props;
+    props.set<std::string>("filename", meshFile.string());
+    MeshGeometry full { props };
+    full.load();
+    props.set<bool>("compactVertices", true);
+    MeshGeometry compact { props };
+    compact.load();
+
+    // positions are not quantized, so the hits are the same
+    REQUIRE( requireSameHits(full, compact, full.getBoundingBox(), 20000) > 0 );
+}
+
+TEST_CASE( "Native mesh files", "[mesh]" ) {
+    const auto meshFile = std::filesystem::path(__FILE__).parent_path() / "../../tests/meshes/rubber_duck_toy_1k.ply";
+    const auto nativeFile = std::filesystem::temp_directory_path() /
+                            tfm::format("lightwave-mesh-%08x.lwmesh", std::random_device()());
+
+    Properties converterProps;
+    converterProps.set<std::string>("filename", meshFile.string());
+    converterProps.set<bool>("compactVertices", GENERATE(false, true));
+    MeshGeometry { converterProps }.convert(nativeFile);
+
+    Properties props;
+    props.set<std::string>("filename", meshFile.string());
+    MeshGeometry ply { props };
+    ply.load();
+
+    Properties nativeProps;
+    nativeProps.set<std::string>("filename", nativeFile.string());
+
+    SECTION( "Loaded meshes match their source" ) {
+        MeshGeometry native { nativeProps };
+        native.load();
+
+        const Bounds bounds = ply.getBoundingBox();
+        REQUIRE( native.getBoundingBox().min() == bounds.min() );
+        REQUIRE( native.getBoundingBox().max() == bounds.max() );
+
+        REQUIRE( requireSameHits(ply, native, bounds, 5000) > 0 );
+    }
+
+    SECTION( "Truncated files are rejected" ) {
+        std::filesystem::resize_file(nativeFile, std::filesystem::file_size(nativeFile) / 2);
+        MeshGeometry native { nativeProps };
+        REQUIRE_THROWS( native.load() );
+    }
+
+    std::filesystem::remove(nativeFile);
+}
+
+TEST_CASE( "Shared geometry", "[mesh]" ) {
+    const auto meshFile = std::filesystem::path(__FILE__).parent_path() / "../../tests/meshes/icosphere.ply";
+    Properties props;
+    props.set<std::string>("filename", meshFile.string());
+
+    // meshes requested concurrently wait for the one that loads the geometry
+    std::vector<ref<MeshGeometry>> shared(8);
+    std::vector<std::thread> threads;
+    for (auto &geometry : shared) {
+        threads.emplace_back([&]() {
+            geometry = GeometryCache::instance().get(std::make_shared<MeshGeometry>(props));
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    for (const auto &geometry : shared)
+        REQUIRE( geometry == shared.front() );
+
+    // released geometry is loaded again
+    const std::weak_ptr<MeshGeometry> released = shared.front();
+    shared.clear();
+    REQUIRE( released.expired() );
+    const auto reloaded = GeometryCache::instance().get(std::make_shared<MeshGeometry>(props));
+    Independent sampler { props };
+    Intersection its;
+    REQUIRE( reloaded->intersect(Ray { Point(0), Vector(0, 0, 1) }, its, sampler) );
+    REQUIRE( GeometryCache::instance().get(std::make_shared<MeshGeometry>(props)) == reloaded );
+
+    // failed loads are not cached
+    Properties missingProps;
+    missingProps.set<std::string>("filename", "does_not_exist.ply");
+    for (int attempt = 0; attempt < 2; attempt++)
+        REQUIRE_THROWS( GeometryCache::instance().get(std::make_shared<MeshGeometry>(missingProps)) );
+}
+
+TEST_CASE( "Area sampling", "[mesh]" ) {
+    const auto meshFile = std::filesystem::path(__FILE__).parent_path() / "../../tests/meshes/rubber_duck_toy_1k.ply";
+
+    // emits light only on one half of the texture
+    class HalfEmission : public Emission {
+    public:
+        EmissionEval evaluate(const Point2 &uv, const Vector &wo) const override {
+            return { .value = Color(uv.x() < 0.5f ? 1.f : 0.f) };
+        }
+        std::string toString() const override { return "HalfEmission[]"; }
+    } emission;
+
+    Properties props;
+    props.set<std::string>("filename", meshFile.string());
+    MeshGeometry geometry { props };
+    geometry.load();
+    double totalArea = 0;
+    for (float area : geometry.samplingWeights(nullptr))
+        totalArea += area;
+
+    Independent sampler { props };
+    double areaEstimates[2], emissionEstimates[2];
+    for (const bool emissionSampling : { false, true }) {
+        Properties meshProps;
+        meshProps.set<std::string>("filename", meshFile.string());
+        meshProps.set<bool>("emissionSampling", emissionSampling);
+        TriangleMesh mesh { meshProps };
+        REQUIRE_THROWS( mesh.sampleArea(sampler) );
+        mesh.prepareAreaSampling(&emission);
+
+        const int samples = 200000;
+        double area = 0, emitted = 0;
+        for (int i = 0; i < samples; i++) {
+            const AreaSample sample = mesh.sampleArea(sampler);
+            REQUIRE( sample.pdf > 0 );
+            REQUIRE( sample.geometryNormal.length() == Catch::Approx(1) );
+            area += 1 / sample.pdf;
+            emitted += emission.evaluate(sample.uv, Vector(0, 0, 1)).value.r() / sample.pdf;
+        }
+        areaEstimates[emissionSampling]     = area / samples;
+        emissionEstimates[emissionSampling] = emitted / samples;
+    }
+
+    // area sampling integrates the area exactly, and both strategies agree
+    // on the emitted power
+    REQUIRE( areaEstimates[false] == Catch::Approx(totalArea).epsilon(1e-3) );
+    REQUIRE( emissionEstimates[true] == Catch::Approx(emissionEstimates[false]).epsilon(0.02) );
+}
+
+// hidden by default, run with: blob --order decl "[benchmark]"
+TEST_CASE( "Triangle test benchmark", "[.][benchmark]" ) {
+    const auto meshFile = std::filesystem::path(__FILE__).parent_path() / "../../tests/meshes/sibenik.ply";
+
+    std::vector<Ray> rays;
+    int expectedHits = -1;
+    const std::tuple<std::string, bool, int> tests[] = {
+        { "cramer", false, 0 }, { "mollertrumbore", false, 0 }, { "mollertrumbore", true, 0 }, { "watertight", false, 0 },
+        { "mollertrumbore", false, 4 }, { "mollertrumbore", false, 8 }, { "watertight", false, 4 }, { "watertight", false, 8 },
+    };
+    for (const auto &[test, precompute, blocks] : tests) {
+        Properties props;
+        props.set<std::string>("filename", meshFile.string());
+        props.set<std::string>("triangleTest", test);
+        props.set<bool>("precomputeEdges", precompute);
+        props.set<int>("triangleBlocks", blocks);
+        props.set<int>("leafSize", blocks ? blocks : 2);
+        MeshGeometry geometry { props };
+        geometry.load();
+
+        if (rays.empty())
+            rays = benchmarkRays(geometry.getBoundingBox(), 1 << 20);
+
+        const auto [bestTime, hits] = bestOfRuns(rays, geometry);
+        logger(EInfo, "%s test%s%s: %.1f ns per ray, %d hits", test,
+               precompute ? " with precomputed edges" : "",
+               blocks ? tfm::format(" in blocks of %d", blocks) : "", bestTime * 1e9 / rays.size(), hits);
+
+        // the kernels may only disagree for rays that graze edges
+        if (expectedHits < 0)
+            expectedHits = hits;
+        REQUIRE( std::abs(hits - expectedHits) < rays.size() / 1000 );
+    }
+}